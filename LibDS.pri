@@ -18,6 +18,10 @@ win32* {
     LIBS += -lws2_32
 }
 
+linux* {
+    LIBS += -lrt
+}
+
 HEADERS += \
     $$PWD/include/DS_Client.h \
     $$PWD/include/DS_Config.h \
@@ -32,7 +36,13 @@ HEADERS += \
     $$PWD/include/DS_DefaultProtocols.h \
     $$PWD/include/DS_Timer.h \
     $$PWD/include/DS_Queue.h \
-    $$PWD/include/DS_String.h
+    $$PWD/include/DS_String.h \
+    $$PWD/include/DS_Atomic.h \
+    $$PWD/include/DS_Packet.h \
+    $$PWD/include/DS_Histogram.h \
+    $$PWD/include/DS_Link.h \
+    $$PWD/include/DS_Shm.h \
+    $$PWD/include/DS_Recorder.h
 
 SOURCES += \
     $$PWD/src/protocols/frc_2014.c \
@@ -47,10 +57,16 @@ SOURCES += \
     $$PWD/src/socket.c \
     $$PWD/src/utils.c \
     $$PWD/src/crc32.c \
+    $$PWD/src/quantize.c \
     $$PWD/src/array.c \
     $$PWD/src/timer.c \
     $$PWD/src/queue.c \
-    $$PWD/src/string.c
+    $$PWD/src/string.c \
+    $$PWD/src/packet.c \
+    $$PWD/src/histogram.c \
+    $$PWD/src/link.c \
+    $$PWD/src/shm.c \
+    $$PWD/src/recorder.c
     
 include ($$PWD/lib/Socky/Socky.pri)
 
@@ -43,6 +43,9 @@ int main()
     /* Initialize the DS (and its event loop) */
     DS_Init();
 
+    /* Export the DS state to other processes (e.g. ShmTail) */
+    DS_ShmExport (NULL);
+
     /* Connect to the FRC simulator (or OpenRIO Sim) */
     DS_SetCustomRobotAddress ("127.0.0.1");
 
@@ -58,12 +61,11 @@ int main()
     DS_Protocol frc2016 = DS_GetProtocolFRC_2016();
     DS_ConfigureProtocol (&frc2016);
 
-    /* Run the application's event loop (unrelated to DS) */
+    /* Run the application's event loop (waits up to 20 ms for DS events) */
     while (running) {
         process_events();
         update_interface();
         update_joysticks();
-        DS_Sleep (20);
     }
 
     /* Close the DS and the application modules */
@@ -76,13 +78,16 @@ int main()
 }
 
 /**
- * Checks if the LibDS has any new events and displays them
- * on the console screen.
+ * Waits for new LibDS events (for up to 20 milliseconds) and displays
+ * them on the console screen.
  */
 static void process_events()
 {
     DS_Event event;
-    while (DS_PollEvent (&event)) {
+    if (!DS_WaitEvent (&event, 20))
+        return;
+
+    do {
         switch (event.type) {
         case DS_JOYSTICK_COUNT_CHANGED:
             set_has_joysticks (DS_GetJoystickCount());
@@ -116,7 +121,7 @@ static void process_events()
         default:
             break;
         }
-    }
+    } while (DS_PollEvent (&event));
 }
 
 /**
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <LibDS.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Time (in milliseconds) between reads of the segment
+ */
+#define READ_INTERVAL 50
+
+/**
+ * Returns the name of the given control \a mode
+ */
+static const char* mode_name (const DS_ControlMode mode)
+{
+    switch (mode) {
+    case DS_CONTROL_TEST:
+        return "Test";
+    case DS_CONTROL_AUTONOMOUS:
+        return "Autonomous";
+    case DS_CONTROL_TELEOPERATED:
+        return "Teleoperated";
+    default:
+        return "Unknown";
+    }
+}
+
+/**
+ * Prints the given \a state on a single line
+ */
+static void print_state (const DS_ShmState* state)
+{
+    const DS_RobotState* robot = &state->robot;
+
+    printf ("[%10.3f] #%-6u team %-5d %-12s %-8s %s%s%s "
+            "%5.2f V  CPU %3d%%  CAN %3d%%  RTT p50 %.1f ms  lost %llu  "
+            "joysticks %d\n",
+            state->timestamp / 1e9,
+            state->generation,
+            robot->team,
+            mode_name (robot->mode),
+            robot->enabled ? "Enabled" : "Disabled",
+            robot->robot_connected ? "comms " : "no-comms ",
+            robot->code ? "code " : "no-code ",
+            robot->estopped ? "ESTOP " : "",
+            robot->voltage,
+            robot->cpu_usage,
+            robot->can_util,
+            state->link.rtt.p50 / 1e6,
+            (unsigned long long) state->link.lost,
+            state->joystick_count);
+}
+
+/**
+ * Main entry point of the application
+ */
+int main (int argc, char** argv)
+{
+    char line [DS_SHM_LINE_LENGTH];
+    const char* name = (argc > 1) ? argv [1] : DS_SHM_NAME;
+
+    /* Wait for the DS to export the segment */
+    DS_ShmReader reader;
+    while (!DS_ShmAttach (&reader, name)) {
+        fprintf (stderr, "Waiting for segment %s...\n", name);
+        DS_Sleep (1000);
+    }
+
+    /* Print the state and NetConsole messages as they change */
+    uint32_t generation = 0;
+    while (1) {
+        if (DS_ShmGeneration (&reader) != generation) {
+            DS_ShmState state;
+            DS_ShmReadState (&reader, &state);
+            generation = state.generation;
+            print_state (&state);
+        }
+
+        uint64_t timestamp;
+        while (DS_ShmReadLine (&reader, line, sizeof (line), &timestamp))
+            printf ("[%10.3f] NetConsole: %s\n", timestamp / 1e9, line);
+
+        fflush (stdout);
+        DS_Sleep (READ_INTERVAL);
+    }
+
+    DS_ShmDetach (&reader);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_ATOMIC_H
+#define _LIB_DS_ATOMIC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Minimal set of atomic operations on 32-bit counters, used by the lock-free
+ * structures of the library. Loads have acquire semantics and stores have
+ * release semantics.
+ */
+#if defined (_MSC_VER)
+    #include <windows.h>
+    #define DS_INLINE __inline
+#else
+    #define DS_INLINE inline
+#endif
+
+/**
+ * Returns the value of the given counter (acquire)
+ */
+static DS_INLINE uint32_t DS_AtomicLoad (volatile uint32_t* ptr)
+{
+#if defined (_MSC_VER)
+    return (uint32_t) InterlockedCompareExchange ((volatile LONG*) ptr, 0, 0);
+#else
+    return __atomic_load_n (ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * Changes the value of the given counter (release)
+ */
+static DS_INLINE void DS_AtomicStore (volatile uint32_t* ptr, uint32_t value)
+{
+#if defined (_MSC_VER)
+    InterlockedExchange ((volatile LONG*) ptr, (LONG) value);
+#else
+    __atomic_store_n (ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * Adds \a value to the given counter and returns the new value
+ */
+static DS_INLINE uint32_t DS_AtomicAdd (volatile uint32_t* ptr, uint32_t value)
+{
+#if defined (_MSC_VER)
+    return (uint32_t) InterlockedExchangeAdd ((volatile LONG*) ptr,
+                                              (LONG) value) + value;
+#else
+    return __atomic_add_fetch (ptr, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/**
+ * Sets the given bits of the given counter and returns the new value
+ */
+static DS_INLINE uint32_t DS_AtomicOr (volatile uint32_t* ptr, uint32_t bits)
+{
+#if defined (_MSC_VER)
+    return (uint32_t) InterlockedOr ((volatile LONG*) ptr, (LONG) bits) | bits;
+#else
+    return __atomic_or_fetch (ptr, bits, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/**
+ * Prevents the compiler and the CPU from reordering memory operations
+ * across this call (full memory barrier)
+ */
+static DS_INLINE void DS_AtomicFence (void)
+{
+#if defined (_MSC_VER)
+    MemoryBarrier();
+#else
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * Replaces the value of the given counter and returns its previous value
+ */
+static DS_INLINE uint32_t DS_AtomicExchange (volatile uint32_t* ptr, uint32_t value)
+{
+#if defined (_MSC_VER)
+    return (uint32_t) InterlockedExchange ((volatile LONG*) ptr, (LONG) value);
+#else
+    return __atomic_exchange_n (ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * Returns the value of the given pointer (acquire)
+ */
+static DS_INLINE void* DS_AtomicLoadPtr (void* volatile* ptr)
+{
+#if defined (_MSC_VER)
+    return InterlockedCompareExchangePointer (ptr, NULL, NULL);
+#else
+    return __atomic_load_n (ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * Changes the value of the given pointer (release)
+ */
+static DS_INLINE void DS_AtomicStorePtr (void* volatile* ptr, void* value)
+{
+#if defined (_MSC_VER)
+    InterlockedExchangePointer (ptr, value);
+#else
+    __atomic_store_n (ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * Replaces the value of the given counter with \a desired if it is equal
+ * to \a expected. On failure, \a expected is updated with the current value.
+ *
+ * \returns \c 1 if the value was replaced, \c 0 otherwise
+ */
+static DS_INLINE int DS_AtomicCompareExchange (volatile uint32_t* ptr,
+                                               uint32_t* expected,
+                                               uint32_t desired)
+{
+#if defined (_MSC_VER)
+    uint32_t previous = (uint32_t) InterlockedCompareExchange (
+                            (volatile LONG*) ptr, (LONG) desired, (LONG) *expected);
+    if (previous == *expected)
+        return 1;
+
+    *expected = previous;
+    return 0;
+#else
+    return __atomic_compare_exchange_n (ptr, expected, desired, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
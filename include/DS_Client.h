@@ -28,8 +28,34 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include "DS_Types.h"
 
+/**
+ * \brief Consistent copy of the robot and DS state
+ *
+ * The \c generation counter changes every time that the state is updated,
+ * so that applications can skip snapshots that did not change.
+ */
+typedef struct {
+    uint32_t generation;
+    int team;
+    int code;
+    int enabled;
+    int estopped;
+    int can_util;
+    int cpu_usage;
+    int ram_usage;
+    int disk_usage;
+    float voltage;
+    int fms_connected;
+    int radio_connected;
+    int robot_connected;
+    DS_ControlMode mode;
+    DS_Alliance alliance;
+    DS_Position position;
+} DS_RobotState;
+
 /* Init/Close functions */
 extern void Client_Init (void);
 extern void Client_Close (void);
@@ -71,6 +97,10 @@ extern int DS_GetRobotCANUtilization (void);
 extern DS_ControlMode DS_GetControlMode (void);
 extern float DS_GetMaximumBatteryVoltage (void);
 
+/* State snapshots */
+extern uint32_t DS_GetStateGeneration (void);
+extern void DS_GetStateSnapshot (DS_RobotState* state);
+
 /* Setters */
 extern void DS_RebootRobot (void);
 extern void DS_RestartRobotCode (void);
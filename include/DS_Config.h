@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 #include "DS_Types.h"
+#include "DS_Client.h"
 #include "DS_Socket.h"
 
 /*
@@ -49,6 +50,12 @@ extern "C" {
 /* Misc */
 extern void CFG_ReconfigureAddresses (const int flags);
 
+/* State snapshots */
+extern void CFG_BeginStateUpdate (void);
+extern void CFG_EndStateUpdate (void);
+extern uint32_t CFG_GetStateGeneration (void);
+extern void CFG_GetStateSnapshot (DS_RobotState* snapshot);
+
 /* NetConsole ouput */
 extern void CFG_AddNotification (const DS_String* msg);
 extern void CFG_AddNetConsoleMessage (const DS_String* msg);
@@ -56,11 +56,34 @@ typedef enum {
     DS_STATUS_STRING_CHANGED    = 0x18,
 } DS_EventType;
 
+/**
+ * \brief Fields shared by all events
+ *
+ * The \c sequence number is assigned by \c DS_AddEvent() and grows by one
+ * with every generated event. The \c timestamp is the monotonic time (in
+ * nanoseconds, see \c DS_GetMonotonicTime()) at which the datagram that
+ * triggered the event was received, or the time at which the event was
+ * generated if it was not caused by a received datagram.
+ *
+ * The queued events are polled in \c sequence order. When telemetry events
+ * are coalesced (see \c DS_SetEventCoalescing()), they are polled after
+ * every queued event, so a polled telemetry event may have a lower
+ * \c sequence than the event polled before it. The sequence numbers of
+ * the telemetry events that were replaced before being polled are skipped.
+ */
+typedef struct {
+    DS_EventType type;
+    uint32_t sequence;
+    uint64_t timestamp;
+} DS_EventHeader;
+
 /**
  * \brief FMS event fields
  */
 typedef struct {
     DS_EventType type;
+    uint32_t sequence;
+    uint64_t timestamp;
     int connected;
 } DS_FMSEvent;
 
@@ -69,6 +92,8 @@ typedef struct {
  */
 typedef struct {
     DS_EventType type;
+    uint32_t sequence;
+    uint64_t timestamp;
     int connected;
 } DS_RadioEvent;
 
@@ -77,6 +102,8 @@ typedef struct {
  */
 typedef struct {
     DS_EventType type;
+    uint32_t sequence;
+    uint64_t timestamp;
     int code;
     int enabled;
     int can_util;
@@ -94,6 +121,8 @@ typedef struct {
  */
 typedef struct {
     DS_EventType type;
+    uint32_t sequence;
+    uint64_t timestamp;
     int count;
 } DS_JoystickEvent;
 
@@ -102,6 +131,8 @@ typedef struct {
  */
 typedef struct {
     DS_EventType type;
+    uint32_t sequence;
+    uint64_t timestamp;
     char* message;
 } DS_NetConsoleEvent;
 
@@ -110,6 +141,7 @@ typedef struct {
  */
 typedef union {
     DS_EventType type;
+    DS_EventHeader header;
     DS_FMSEvent fms;
     DS_RobotEvent robot;
     DS_RadioEvent radio;
@@ -117,10 +149,37 @@ typedef union {
     DS_NetConsoleEvent netconsole;
 } DS_Event;
 
+/**
+ * \brief Event subscriber callback
+ *
+ * Called from the thread that generated the \a event (usually the protocol
+ * thread), the event is only valid during the call. Callbacks should return
+ * quickly, since they delay the processing of the received packets, and
+ * must not call \c DS_ConfigureProtocol().
+ */
+typedef void (*DS_EventCallback) (const DS_Event* event, void* data);
+
+/**
+ * Returns the subscription mask bit of the given event \a type
+ */
+#define DS_EVENT_MASK(type) (1u << (type))
+
+/**
+ * Subscription mask that matches all event types
+ */
+#define DS_ALL_EVENTS 0xffffffffu
+
 extern void Events_Init (void);
 extern void Events_Close (void);
 extern void DS_AddEvent (DS_Event* event);
+extern void DS_SetEventOrigin (const uint64_t timestamp);
+extern int DS_GetEventFD (void);
+extern int DS_GetEventCoalescing (void);
+extern void DS_SetEventCoalescing (const int enabled);
+extern int DS_Subscribe (const uint32_t mask, DS_EventCallback callback, void* data);
+extern int DS_Unsubscribe (DS_EventCallback callback, void* data);
 extern int DS_PollEvent (DS_Event* event);
+extern int DS_WaitEvent (DS_Event* event, const int timeout_ms);
 
 #ifdef __cplusplus
 }
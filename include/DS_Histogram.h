@@ -0,0 +1,75 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_HISTOGRAM_H
+#define _LIB_DS_HISTOGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Each power of two is split in 128 linear sub-buckets (below 1% error),
+ * values above 2^40 are stored in the last bucket
+ */
+#define DS_HISTOGRAM_SUB_BUCKETS 128
+#define DS_HISTOGRAM_BUCKETS 4352
+
+/**
+ * Log-linear histogram of 64-bit values (e.g. intervals in nanoseconds).
+ * Recording a value does not allocate memory and takes constant time.
+ */
+typedef struct {
+    uint64_t count;  /**< Number of recorded values */
+    uint64_t min;    /**< Smallest recorded value */
+    uint64_t max;    /**< Largest recorded value */
+    uint64_t sum;    /**< Sum of the recorded values */
+    uint32_t buckets [DS_HISTOGRAM_BUCKETS]; /**< Values in each bucket */
+} DS_Histogram;
+
+/**
+ * Summary of a histogram, all the values have the same unit as the
+ * recorded values
+ */
+typedef struct {
+    uint64_t count; /**< Number of recorded values */
+    uint64_t min;   /**< Smallest recorded value */
+    uint64_t p50;   /**< Median */
+    uint64_t p99;   /**< 99th percentile */
+    uint64_t max;   /**< Largest recorded value */
+} DS_HistogramSummary;
+
+extern void DS_HistogramReset (DS_Histogram* histogram);
+extern void DS_HistogramAdd (DS_Histogram* histogram, const uint64_t value);
+extern uint64_t DS_HistogramPercentile (const DS_Histogram* histogram,
+                                        const double percentile);
+extern void DS_HistogramSummarize (const DS_Histogram* histogram,
+                                   DS_HistogramSummary* summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,8 +28,40 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
+#include "DS_Histogram.h"
+
+/*
+ * Maximum number of joysticks and joystick inputs stored by the LibDS. These
+ * are storage limits for every protocol (including custom ones), each
+ * protocol only sends the inputs allowed by its own \c max_* counts.
+ */
+#define DS_MAX_JOYSTICKS        6
+#define DS_MAX_JOYSTICK_AXES    12
+#define DS_MAX_JOYSTICK_HATS    4
+#define DS_MAX_JOYSTICK_BUTTONS 32
+
+/**
+ * \brief Values of all the joysticks (structure of arrays)
+ */
+typedef struct {
+    int count;                                  /**< Number of joysticks */
+    int num_axes [DS_MAX_JOYSTICKS];            /**< Axes of each joystick */
+    int num_hats [DS_MAX_JOYSTICKS];            /**< Hats of each joystick */
+    int num_buttons [DS_MAX_JOYSTICKS];         /**< Buttons of each joystick */
+    uint32_t buttons [DS_MAX_JOYSTICKS];        /**< Button bitmasks */
+    uint32_t generation [DS_MAX_JOYSTICKS];     /**< Changes with the values */
+    uint64_t input_time [DS_MAX_JOYSTICKS];     /**< Newest input time (or 0) */
+    int hats [DS_MAX_JOYSTICKS][DS_MAX_JOYSTICK_HATS];
+    float axes [DS_MAX_JOYSTICKS][DS_MAX_JOYSTICK_AXES];
+} DS_JoystickFrame;
+
 extern void Joysticks_Init (void);
 extern void Joysticks_Close (void);
+extern void Joysticks_PacketSent (const uint64_t time);
+
+extern const DS_JoystickFrame* DS_JoysticksAcquireFrame (void);
 
 extern int DS_GetJoystickCount (void);
 extern int DS_GetJoystickNumHats (int joystick);
@@ -39,6 +71,11 @@ extern int DS_GetJoystickNumButtons (int joystick);
 extern int DS_GetJoystickHat (int joystick, int hat);
 extern float DS_GetJoystickAxis (int joystick, int axis);
 extern int DS_GetJoystickButton (int joystick, int button);
+extern uint32_t DS_GetJoystickButtons (int joystick);
+extern uint32_t DS_GetJoystickGeneration (int joystick);
+
+extern void DS_ResetJoystickLatencyStats (void);
+extern void DS_GetJoystickLatencyStats (int joystick, DS_HistogramSummary* stats);
 
 extern void DS_JoysticksReset (void);
 extern void DS_JoysticksAdd (const int axes, const int hats, const int buttons);
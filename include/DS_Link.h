@@ -0,0 +1,94 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_LINK_H
+#define _LIB_DS_LINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "DS_Histogram.h"
+
+/*
+ * Number of sent packets that can wait for a reply, packets that are not
+ * answered before the window wraps around are counted as lost
+ */
+#define DS_LINK_WINDOW 64
+
+/**
+ * Send time of a packet that is waiting for its reply
+ */
+typedef struct {
+    uint16_t index;   /**< Packet index (sequence number) */
+    int pending;      /**< Set to 1 until the reply is received */
+    int echoed;       /**< Set to 1 once the reply is received */
+    uint64_t sent;    /**< Monotonic time (ns) at which the packet was sent */
+} DS_LinkSlot;
+
+/**
+ * Tracks the quality of a link in which the remote end echoes the index
+ * of every packet that it receives
+ */
+typedef struct {
+    pthread_mutex_t lock;     /**< Protects the link data */
+    int has_reply;            /**< Set to 1 once a reply is received */
+    uint16_t last_index;      /**< Newest index that has been echoed */
+    uint64_t last_reply;      /**< Monotonic time of the last reply */
+    uint64_t sent;            /**< Number of sent packets */
+    uint64_t received;        /**< Number of matched replies */
+    uint64_t lost;            /**< Packets without reply */
+    uint64_t duplicated;      /**< Replies received more than once */
+    uint64_t reordered;       /**< Replies older than a previous reply */
+    DS_Histogram rtt;         /**< Round-trip times (ns) */
+    DS_Histogram gap;         /**< Time between consecutive replies (ns) */
+    DS_LinkSlot window [DS_LINK_WINDOW]; /**< Packets waiting for a reply */
+} DS_Link;
+
+/**
+ * Link quality statistics, times are in nanoseconds
+ */
+typedef struct _link_stats {
+    uint64_t sent;            /**< Number of sent packets */
+    uint64_t received;        /**< Number of matched replies */
+    uint64_t lost;            /**< Packets without reply */
+    uint64_t duplicated;      /**< Replies received more than once */
+    uint64_t reordered;       /**< Replies older than a previous reply */
+    DS_HistogramSummary rtt;  /**< Round-trip times */
+    DS_HistogramSummary gap;  /**< Time between consecutive replies */
+} DS_LinkStats;
+
+extern void DS_LinkInit (DS_Link* link);
+extern void DS_LinkReset (DS_Link* link);
+extern void DS_LinkGetStats (DS_Link* link, DS_LinkStats* stats);
+extern void DS_LinkSent (DS_Link* link, const uint16_t index, const uint64_t time);
+extern void DS_LinkReceived (DS_Link* link, const uint16_t index, const uint64_t time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_PACKET_H
+#define _LIB_DS_PACKET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Largest packet that a protocol may generate
+ */
+#define DS_MAX_PACKET_SIZE 2048
+
+/**
+ * Writes big-endian values into a buffer provided by the caller. Writing
+ * past the end of the buffer does nothing but raise the overflow flag, so
+ * that the caller only needs to check the flag once the packet is complete.
+ */
+typedef struct {
+    uint8_t* buf;    /**< Buffer provided by the caller */
+    size_t capacity; /**< Size of the buffer */
+    size_t length;   /**< Number of bytes written so far */
+    int overflow;    /**< Set to 1 if a write did not fit in the buffer */
+} DS_PacketWriter;
+
+/**
+ * Reads big-endian values from a received packet. Reading past the end of
+ * the packet returns 0 and raises the overflow flag.
+ */
+typedef struct {
+    const uint8_t* buf; /**< Packet data */
+    size_t length;      /**< Length of the packet */
+    size_t position;    /**< Offset of the next byte to read */
+    int overflow;       /**< Set to 1 if a read went past the packet end */
+} DS_PacketReader;
+
+/*
+ * Writer functions
+ */
+extern void DS_PacketWriterInit (DS_PacketWriter* writer, void* buf, size_t capacity);
+extern void DS_PacketPutU8 (DS_PacketWriter* writer, const uint8_t value);
+extern void DS_PacketPutU16BE (DS_PacketWriter* writer, const uint16_t value);
+extern void DS_PacketPutU32BE (DS_PacketWriter* writer, const uint32_t value);
+extern void DS_PacketPutBytes (DS_PacketWriter* writer, const void* bytes, size_t len);
+extern void DS_PacketPad (DS_PacketWriter* writer, size_t length);
+extern void DS_PacketSetU32BE (DS_PacketWriter* writer, size_t offset, const uint32_t value);
+
+/*
+ * Reader functions
+ */
+extern void DS_PacketReaderInit (DS_PacketReader* reader, const void* buf, size_t len);
+extern uint8_t DS_PacketGetU8 (DS_PacketReader* reader);
+extern uint16_t DS_PacketGetU16BE (DS_PacketReader* reader);
+extern uint32_t DS_PacketGetU32BE (DS_PacketReader* reader);
+extern void DS_PacketGetBytes (DS_PacketReader* reader, void* bytes, size_t len);
+extern void DS_PacketSkip (DS_PacketReader* reader, size_t len);
+extern uint8_t DS_PacketPeekU8 (DS_PacketReader* reader, size_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,6 +28,9 @@
 extern "C" {
 #endif
 
+#include "DS_Packet.h"
+#include "DS_Link.h"
+#include "DS_Histogram.h"
 #include "DS_Socket.h"
 #include "DS_String.h"
 
@@ -37,9 +40,9 @@ typedef struct _protocol {
     DS_String (*radio_address) (void);
     DS_String (*robot_address) (void);
 
-    DS_String (*create_fms_packet) (void);
-    DS_String (*create_radio_packet) (void);
-    DS_String (*create_robot_packet) (void);
+    void (*create_fms_packet) (DS_PacketWriter*);
+    void (*create_radio_packet) (DS_PacketWriter*);
+    void (*create_robot_packet) (DS_PacketWriter*);
 
     int (*read_fms_packet) (const DS_String*);
     int (*read_radio_packet) (const DS_String*);
@@ -68,6 +71,17 @@ typedef struct _protocol {
     DS_Socket netconsole_socket;
 } DS_Protocol;
 
+/**
+ * Statistics of the intervals (in nanoseconds) between consecutive packets,
+ * and of the time between an urgent robot packet request and its sending
+ */
+typedef struct _send_jitter_stats {
+    DS_HistogramSummary fms;
+    DS_HistogramSummary radio;
+    DS_HistogramSummary robot;
+    DS_HistogramSummary urgent;
+} DS_SendJitterStats;
+
 extern void Protocols_Init();
 extern void Protocols_Close();
 extern void DS_ConfigureProtocol (const DS_Protocol* ptr);
@@ -92,6 +106,15 @@ extern void DS_ResetFMSPackets();
 extern void DS_ResetRadioPackets();
 extern void DS_ResetRobotPackets();
 
+extern void DS_ResetRobotLinkStats();
+extern void DS_RobotPacketSent (const uint16_t index);
+extern void DS_RobotPacketEchoed (const uint16_t index);
+extern void DS_GetRobotLinkStats (DS_LinkStats* stats);
+
+extern void DS_SendUrgentRobotPacket();
+extern void DS_ResetSendJitterStats();
+extern void DS_GetSendJitterStats (DS_SendJitterStats* stats);
+
 extern DS_Protocol* DS_CurrentProtocol();
 
 #ifdef __cplusplus
@@ -28,22 +28,57 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Size of a cache line, used to keep the producer and consumer positions
+ * (and the queue cells) in separate cache lines
+ */
+#define DS_CACHE_LINE 64
+
+/**
+ * Defines what happens when an item is pushed to a full queue
+ */
+typedef enum {
+    DS_QUEUE_DROP_OLDEST = 0, /**< Discard the oldest item in the queue */
+    DS_QUEUE_BLOCK       = 1, /**< Wait until a consumer pops an item */
+} DS_QueuePolicy;
+
+/**
+ * Bounded multi-producer/multi-consumer queue. The items are copied into
+ * a contiguous, cache-line aligned ring of cells. Each cell has a sequence
+ * number that tells producers and consumers if the cell is free or full,
+ * so pushing and popping only needs one compare-and-swap operation.
+ */
 typedef struct _queue {
-    int count;
-    int capacity;
-    int item_size;
+    volatile uint32_t enqueue_pos;          /**< Next cell to write */
+    char pad0 [DS_CACHE_LINE - sizeof (uint32_t)];
+    volatile uint32_t dequeue_pos;          /**< Next cell to read */
+    char pad1 [DS_CACHE_LINE - sizeof (uint32_t)];
+
+    volatile uint32_t dropped;              /**< Items discarded when full */
+    volatile uint32_t waiters;              /**< Producers waiting (block) */
+
+    uint32_t mask;                          /**< Number of cells minus one */
+    size_t stride;                          /**< Size of each cell */
+    size_t item_size;                       /**< Size of each item */
+    DS_QueuePolicy policy;                  /**< Behavior when full */
 
-    int rear;
-    int front;
+    char* cells;                            /**< Aligned cell array */
+    void* memory;                           /**< Allocated memory */
 
-    void** buffer;
+    pthread_cond_t not_full;                /**< Signaled when popping */
+    pthread_mutex_t lock;                   /**< Used to wait (block) */
 } DS_Queue;
 
-extern int DS_QueuePop (DS_Queue* queue);
 extern void DS_QueueFree (DS_Queue* queue);
-extern void* DS_QueueGetFirst (DS_Queue* queue);
-extern void DS_QueuePush (DS_Queue* queue, void* item);
-extern void DS_QueueInit (DS_Queue* queue, int initial_count, int item_size);
+extern int DS_QueuePop (DS_Queue* queue, void* item);
+extern int DS_QueuePush (DS_Queue* queue, const void* item);
+extern unsigned int DS_QueueDropped (DS_Queue* queue);
+extern void DS_QueueInit (DS_Queue* queue, int capacity, int item_size,
+                          DS_QueuePolicy policy);
 
 #ifdef __cplusplus
 }
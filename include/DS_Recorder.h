@@ -0,0 +1,100 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_RECORDER_H
+#define _LIB_DS_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Recording file identification, the version changes with the file layout
+ */
+#define DS_RECORDING_MAGIC   0x524a5344
+#define DS_RECORDING_VERSION 1
+
+/**
+ * Types of the recorded joystick calls
+ */
+typedef enum {
+    DS_RECORD_ADD = 1,      /**< \c DS_JoysticksAdd() */
+    DS_RECORD_RESET = 2,    /**< \c DS_JoysticksReset() */
+    DS_RECORD_AXIS = 3,     /**< \c DS_SetJoystickAxis() */
+    DS_RECORD_HAT = 4,      /**< \c DS_SetJoystickHat() */
+    DS_RECORD_BUTTON = 5,   /**< \c DS_SetJoystickButton() */
+} DS_RecordType;
+
+/**
+ * \brief Header at the start of a recording file
+ *
+ * Recording files consist of this header followed by fixed-size records
+ * (in the byte order of the recording computer), which allows them to be
+ * appended to without seeking and to be read directly from a memory map.
+ */
+typedef struct {
+    uint32_t magic;          /**< Set to \c DS_RECORDING_MAGIC */
+    uint16_t version;        /**< Set to \c DS_RECORDING_VERSION */
+    uint16_t record_size;    /**< Size of each record */
+    uint64_t start_time;     /**< Monotonic time of the first record */
+    uint64_t reserved [2];
+} DS_RecordingHeader;
+
+/**
+ * \brief A recorded joystick call
+ *
+ * The \a joystick, \a index and \a value fields hold the arguments of the
+ * call, except for \c DS_RECORD_ADD records, which store the number of axes
+ * in \a joystick, the number of hats in \a index and the number of buttons
+ * in \a value.
+ */
+typedef struct {
+    uint64_t time;           /**< Nanoseconds since the recording started */
+    uint8_t type;            /**< One of the \c DS_RecordType values */
+    uint8_t joystick;        /**< Joystick of the call */
+    uint8_t index;           /**< Axis, hat or button of the call */
+    uint8_t reserved;
+    union {
+        float axis;          /**< Value of \c DS_RECORD_AXIS records */
+        int32_t integer;     /**< Value of the other records */
+    } value;
+} DS_JoystickRecord;
+
+extern void Recorder_Close (void);
+extern void Recorder_Reset (void);
+extern void Recorder_Add (const int axes, const int hats, const int buttons);
+extern void Recorder_Hat (const int joystick, const int hat, const int angle);
+extern void Recorder_Axis (const int joystick, const int axis, const float value);
+extern void Recorder_Button (const int joystick, const int button, const int pressed);
+
+extern int DS_RecordJoysticks (const char* path);
+extern void DS_StopJoystickRecording (void);
+extern long DS_ReplayJoysticks (const char* path, const int realtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_SHM_H
+#define _LIB_DS_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "DS_Link.h"
+#include "DS_Client.h"
+
+/*
+ * Default name of the shared memory segment
+ */
+#define DS_SHM_NAME "/libds"
+
+/*
+ * Segment identification, the version changes with the segment layout
+ */
+#define DS_SHM_MAGIC   0x4c696244
+#define DS_SHM_VERSION 1
+
+/*
+ * Limits of the exported data
+ */
+#define DS_SHM_MAX_JOYSTICKS 6
+#define DS_SHM_MAX_AXES      12
+#define DS_SHM_MAX_HATS      4
+#define DS_SHM_MAX_BUTTONS   32
+#define DS_SHM_CONSOLE_LINES 64
+#define DS_SHM_LINE_LENGTH   256
+
+/**
+ * \brief Exported state of a joystick
+ */
+typedef struct {
+    int num_axes;
+    int num_hats;
+    int num_buttons;
+    uint32_t buttons;                   /**< One bit per button */
+    int hats [DS_SHM_MAX_HATS];
+    float axes [DS_SHM_MAX_AXES];
+} DS_ShmJoystick;
+
+/**
+ * \brief Exported state of the DS, copied as a whole by readers
+ */
+typedef struct {
+    uint32_t generation;                /**< Changes with every update */
+    uint64_t timestamp;                 /**< Monotonic time of the update */
+    DS_RobotState robot;
+    DS_LinkStats link;
+    int joystick_count;
+    DS_ShmJoystick joysticks [DS_SHM_MAX_JOYSTICKS];
+} DS_ShmState;
+
+/**
+ * \brief NetConsole message stored in the segment
+ *
+ * The sequence of the slot is odd while the message is being written, and
+ * set to (2 * number + 2) once message \c number has been written.
+ */
+typedef struct {
+    volatile uint32_t sequence;
+    uint64_t timestamp;                 /**< Monotonic receive time */
+    char text [DS_SHM_LINE_LENGTH];
+} DS_ShmLine;
+
+/**
+ * \brief Layout of the shared memory segment
+ *
+ * The state is protected by a seqlock (the sequence is odd while the state
+ * is being written), NetConsole messages are stored in a ring buffer.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    volatile uint32_t sequence;
+    DS_ShmState state;
+    volatile uint32_t lines;            /**< Number of written messages */
+    DS_ShmLine console [DS_SHM_CONSOLE_LINES];
+} DS_ShmSegment;
+
+/**
+ * \brief Read-only view of a segment, used by other processes
+ */
+typedef struct {
+    int fd;
+    uint32_t next_line;                 /**< Next message to read */
+    const DS_ShmSegment* segment;
+} DS_ShmReader;
+
+/* Init/Close functions */
+extern void Shm_Close (void);
+extern void Shm_PublishState (void);
+
+/* Publisher (DS process) */
+extern int DS_ShmExport (const char* name);
+extern void DS_ShmStopExport (void);
+
+/* Readers (other processes) */
+extern int DS_ShmAttach (DS_ShmReader* reader, const char* name);
+extern void DS_ShmDetach (DS_ShmReader* reader);
+extern uint32_t DS_ShmGeneration (const DS_ShmReader* reader);
+extern void DS_ShmReadState (const DS_ShmReader* reader, DS_ShmState* state);
+extern int DS_ShmReadLine (DS_ShmReader* reader, char* buffer, const size_t length,
+                           uint64_t* timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,11 +28,33 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include <pthread.h>
 
 #include "DS_Types.h"
 #include "DS_String.h"
 
+/*
+ * Maximum size of a received datagram
+ */
+#define DS_DATAGRAM_SIZE 2048
+
+/**
+ * Holds a received datagram, its receive time and the address of its sender
+ */
+typedef struct {
+    int length;                   /**< Number of received bytes */
+    int source_len;               /**< Length of the source address */
+    uint64_t timestamp;           /**< Monotonic receive time (nanoseconds) */
+    uint64_t source [16];         /**< Source address (sockaddr storage) */
+    char data [DS_DATAGRAM_SIZE]; /**< Received data */
+} DS_Datagram;
+
+/*
+ * Receive ring of a socket (defined in socket.c)
+ */
+typedef struct _DS_SocketRing DS_SocketRing;
+
 /**
  * Holds all the private (erm, dirty) variables that the sockets module needs
  * to operate with the data provided by a \c DS_Socket structure
@@ -40,12 +62,21 @@ extern "C" {
 typedef struct {
     int sock_in;           /**< Input socket file descriptor */
     int sock_out;          /**< Output socket file descriptor */
+    int sock_peer;         /**< Accepted TCP connection, -1 if none */
     int client_init;       /**< 1 if client is working, 0 if not */
     int server_init;       /**< 1 if server is working, 0 if not */
-    size_t buffer_size;    /**< Holds the number of received bytes */
-    char buffer [4096];    /**< Holds the received data buffer */
+    DS_SocketRing* ring;   /**< Holds the received datagrams */
     char in_service [12];  /**< Holds the input port number as a string */
     char out_service [12]; /**< Holds the output port number as a string */
+    int resolved;          /**< 1 if the endpoint cache holds an address */
+    int resolving;         /**< 1 while a lookup is queued or running */
+    int connected;         /**< 1 if the output socket is connected */
+    int endpoint_len;      /**< Length of the cached remote address */
+    unsigned generation;   /**< Incremented when the address changes */
+    uint64_t expiry;       /**< Monotonic time when the cache goes stale */
+    uint64_t endpoint[16]; /**< Cached remote address (sockaddr storage) */
+    int open;              /**< 1 between DS_SocketOpen() and DS_SocketClose() */
+    int slot;              /**< Reactor slot, -1 if the socket is unregistered */
 } DS_SocketInfo;
 
 /**
@@ -57,11 +88,22 @@ typedef struct {
     int out_port;          /**< Output port number */
     int disabled;          /**< 1 if socket shall not send or receive data */
     int broadcast;         /**< 1 if socket shall send or receive broadcasts */
+    int connect_udp;       /**< 1 if the UDP output socket shall be connected */
     char address [512];    /**< Address of remote host */
     DS_SocketType type;    /**< Type of socket (UDP/TCP) */
     DS_SocketInfo info;    /**< Ugly data about the socket */
 } DS_Socket;
 
+/**
+ * Describes a datagram sent with \c DS_SocketSendBatch()
+ */
+typedef struct {
+    const char* data;       /**< Datagram contents */
+    int length;             /**< Length of the datagram */
+    int sent;               /**< Number of sent bytes, -1 if not sent */
+    DS_Socket* destination; /**< Receives the datagram (NULL for the sender) */
+} DS_OutDatagram;
+
 /* For socket initialization */
 extern DS_Socket* DS_SocketEmpty (void);
 
@@ -75,7 +117,15 @@ extern void DS_SocketClose (DS_Socket* ptr);
 
 /* I/O functions */
 extern DS_String DS_SocketRead (DS_Socket* ptr);
-extern int DS_SocketSend (const DS_Socket* ptr, const DS_String* data);
+extern int DS_SocketReadDatagram (DS_Socket* ptr, DS_Datagram* datagram);
+extern const DS_Datagram* DS_SocketPeek (DS_Socket* ptr);
+extern void DS_SocketRelease (DS_Socket* ptr);
+extern unsigned DS_SocketOverruns (const DS_Socket* ptr);
+extern unsigned DS_SocketReceiveCalls (const DS_Socket* ptr);
+extern int DS_SocketSend (DS_Socket* ptr, const DS_String* data);
+extern int DS_SocketSendBytes (DS_Socket* ptr, const char* buf, const int len);
+extern int DS_SocketSendBatch (DS_Socket* ptr, DS_OutDatagram* datagrams,
+                               const int count);
 extern void DS_SocketChangeAddress (DS_Socket* ptr, const char* address);
 
 #ifdef __cplusplus
@@ -36,10 +36,15 @@ extern "C" {
 
 /**
  * Represents a string and its length
+ *
+ * \note Strings that point to memory owned by somebody else (views) have
+ *       a capacity of 0. Functions that modify a view copy it to a new
+ *       buffer first, and \c DS_StrRmBuf() does not free its memory
  */
 typedef struct {
     char* buf;  /**< String data buffer */
     size_t len; /**< Length of the string */
+    size_t cap; /**< Size of the allocated buffer */
 } DS_String;
 
 /*
@@ -55,6 +60,9 @@ extern int DS_StrCompare (const DS_String* a, const DS_String* b);
 extern int DS_StrRmBuf (DS_String* string);
 extern int DS_StrResize (DS_String* string, size_t size);
 extern int DS_StrAppend (DS_String* string, const uint8_t byte);
+extern int DS_StrAppendBytes (DS_String* string, const void* bytes, size_t len);
+extern int DS_StrReserve (DS_String* string, size_t size);
+extern int DS_StrShrink (DS_String* string);
 extern int DS_StrJoin (DS_String* first, const DS_String* second);
 extern int DS_StrJoinCStr (DS_String* string, const char* cstring);
 extern int DS_StrSetChar (DS_String* string, const int pos, const char byte);
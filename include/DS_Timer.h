@@ -28,6 +28,7 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include <pthread.h>
 
 /**
@@ -35,20 +36,46 @@ extern "C" {
  */
 typedef struct _timer {
     int time;         /**< The time to wait until the timer expires */
-    int expired;      /**< Set to \c 1 if \a elapsed is greater than \a time */
+    int expired;      /**< Set to \c 1 when the timer expires */
     int enabled;      /**< Enabled state of the timer */
-    int elapsed;      /**< Number of milliseconds elapsed since last reset */
-    int precision;    /**< The update interval (in milliseconds) */
+    int periodic;     /**< If set to \c 1, the timer re-arms itself on expiry */
+    int precision;    /**< Kept for compatibility, timers are not polled */
     int initialized;  /**< Set to \c 1 if the timer has been initialized */
+    int index;        /**< Position in the scheduler queue (-1 if idle) */
+    int pending;      /**< Set to \c 1 until the expiry callback is called */
+    uint64_t deadline; /**< Monotonic time (in nanoseconds) of next expiry */
+    void (*callback) (struct _timer* timer); /**< Called on expiry */
+    void* data;       /**< User data for the \a callback */
 } DS_Timer;
 
+/**
+ * Statistics of the timer scheduler thread
+ */
+typedef struct _timer_stats {
+    uint64_t uptime;      /**< Nanoseconds since the stats were reset */
+    uint64_t wakeups;     /**< Number of times the scheduler woke up */
+    uint64_t expirations; /**< Number of timer expirations */
+    uint64_t avg_drift;   /**< Average expiry lateness (in nanoseconds) */
+    uint64_t max_drift;   /**< Maximum expiry lateness (in nanoseconds) */
+} DS_TimerStats;
+
 extern void Timers_Init (void);
 extern void Timers_Close (void);
 extern void DS_Sleep (const int millisecs);
+extern uint64_t DS_GetMonotonicTime (void);
+extern void DS_SleepUntil (const uint64_t deadline);
+extern void DS_ResetTimerStats (void);
+extern void DS_GetTimerStats (DS_TimerStats* stats);
+extern void DS_CondInit (pthread_cond_t* cond);
+extern int DS_CondWaitUntil (pthread_cond_t* cond, pthread_mutex_t* mutex,
+                             const uint64_t deadline);
 extern void DS_TimerStop (DS_Timer* timer);
 extern void DS_TimerStart (DS_Timer* timer);
 extern void DS_TimerReset (DS_Timer* timer);
 extern void DS_TimerInit (DS_Timer* timer, const int time, const int precision);
+extern void DS_TimerSetCallback (DS_Timer* timer,
+                                 void (*callback) (DS_Timer*),
+                                 void* data);
 
 #ifdef __cplusplus
 }
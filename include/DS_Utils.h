@@ -55,7 +55,12 @@ typedef enum {
  * Misc functions
  */
 extern uint32_t DS_CRC32 (const void* buf, size_t size);
+extern uint32_t DS_CRC32Update (uint32_t crc, const void* buf, size_t size);
+extern uint32_t DS_CRC32CombineGen (size_t length);
+extern uint32_t DS_CRC32CombineOp (uint32_t crc1, uint32_t crc2, uint32_t op);
+extern uint32_t DS_CRC32Combine (uint32_t crc1, uint32_t crc2, size_t length);
 extern uint8_t DS_FloatToByte (const float val, const float max);
+extern void DS_QuantizeAxes (const float* in, int8_t* out, const int n);
 extern DS_String DS_GetStaticIP (const int net, const int team, const int host);
 extern void DS_ShowMessageBox (const DS_String* caption,
                                const DS_String* message,
@@ -28,6 +28,7 @@
 extern "C" {
 #endif
 
+#include "DS_Shm.h"
 #include "DS_Timer.h"
 #include "DS_Types.h"
 #include "DS_Utils.h"
@@ -35,6 +36,7 @@ extern "C" {
 #include "DS_Client.h"
 #include "DS_Socket.h"
 #include "DS_Protocol.h"
+#include "DS_Recorder.h"
 #include "DS_Joysticks.h"
 #include "DS_DefaultProtocols.h"
 
@@ -20,6 +20,13 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#if defined (__linux__) && !defined (__ANDROID__)
+    #ifndef _GNU_SOURCE
+        #define _GNU_SOURCE /* Required for recvmmsg() and sendmmsg() */
+    #endif
+    #define SOCKY_MMSG
+#endif
+
 #include "socky.h"
 
 #include <assert.h>
@@ -613,32 +620,330 @@ int udp_sendto (const int sfd,
  * \param host the remote host from which to receive data
  * \param service the local service/port from which to receive data
  * \param flags any additional flags that you may need to use
+ *
+ * \note The \a host and \a service parameters are kept for compatibility,
+ *       the source address is written into a local structure, so there is
+ *       no need to perform a lookup for every received datagram
  */
 int udp_recvfrom (const int sfd, char* buf, const int buf_len,
                   const char* host, const char* service, const int flags)
 {
+    (void) host;
+    (void) service;
+
     /* Check if socket and buffer length are valid */
     if (!valid_sfd (sfd) || buf_len <= 0)
         return -1;
 
-    /* Get address info */
-    struct addrinfo* info = get_address_info (host, service,
-                                              SOCKY_UDP, SOCKY_ANY);
+    /* Initialize the source address structure */
+    struct sockaddr_storage source;
+    socklen_t source_len = sizeof (source);
 
-    /* Invalid address info */
-    if (info == NULL)
+    /* Receive remote data */
+#if defined _WIN32
+    int bytes = recvfrom (sfd, buf, buf_len, flags,
+                          (struct sockaddr*) &source, (int*) &source_len);
+#else
+    int bytes = recvfrom (sfd, buf, buf_len, flags,
+                          (struct sockaddr*) &source, &source_len);
+#endif
+
+    /* Return the number of bytes received */
+    return bytes;
+}
+
+/**
+ * Receives a datagram and writes the address of its sender into \a addr
+ *
+ * \param sfd the socket descriptor
+ * \param buf the buffer in which to write the received data
+ * \param buf_len the length of the buffer
+ * \param addr the structure in which to write the source address
+ * \param addr_len set to the length of the source address
+ * \param flags any additional flags that you may need to use
+ *
+ * \returns the number of received bytes, -1 on failure
+ */
+int udp_recvfrom_addr (const int sfd, char* buf, const int buf_len,
+                       struct sockaddr_storage* addr, int* addr_len,
+                       const int flags)
+{
+    /* Check if socket, buffer and address are valid */
+    if (!valid_sfd (sfd) || buf_len <= 0 || !addr || !addr_len)
         return -1;
 
     /* Receive remote data */
+    socklen_t source_len = sizeof (struct sockaddr_storage);
 #if defined _WIN32
     int bytes = recvfrom (sfd, buf, buf_len, flags,
-                          info->ai_addr, (int*) &info->ai_addrlen);
+                          (struct sockaddr*) addr, (int*) &source_len);
 #else
     int bytes = recvfrom (sfd, buf, buf_len, flags,
-                          info->ai_addr, &info->ai_addrlen);
+                          (struct sockaddr*) addr, &source_len);
 #endif
 
-    /* Return the number of bytes received */
-    freeaddrinfo (info);
+    /* Update the source address length */
+    *addr_len = (bytes >= 0) ? (int) source_len : 0;
     return bytes;
 }
+
+/**
+ * Receives up to \a count datagrams with a single system call (using
+ * \c recvmmsg() on Linux). On other systems, the datagrams are received
+ * one at a time, only the first receive operation may block.
+ *
+ * \param sfd the socket descriptor
+ * \param msgs the buffers in which to write the received datagrams, the
+ *        \c bytes and \c addr_len fields of each message are updated
+ * \param count the number of messages (at most \c SOCKY_BATCH_MAX)
+ * \param flags any additional flags that you may need to use
+ *
+ * \returns the number of received datagrams, -1 on failure
+ */
+int udp_recv_batch (const int sfd, struct udp_message* msgs,
+                    const int count, const int flags)
+{
+    /* Check arguments */
+    if (!valid_sfd (sfd) || msgs == NULL || count <= 0)
+        return -1;
+
+    /* Limit the number of messages */
+    int i;
+    int num = count > SOCKY_BATCH_MAX ? SOCKY_BATCH_MAX : count;
+
+#if defined SOCKY_MMSG
+    /* Describe the receive buffers */
+    struct iovec iovecs [SOCKY_BATCH_MAX];
+    struct mmsghdr headers [SOCKY_BATCH_MAX];
+    memset (headers, 0, num * sizeof (struct mmsghdr));
+    for (i = 0; i < num; ++i) {
+        iovecs [i].iov_base = msgs [i].buf;
+        iovecs [i].iov_len = msgs [i].buf_len;
+        headers [i].msg_hdr.msg_iov = &iovecs [i];
+        headers [i].msg_hdr.msg_iovlen = 1;
+        headers [i].msg_hdr.msg_name = msgs [i].addr;
+        headers [i].msg_hdr.msg_namelen = msgs [i].addr ?
+                                          sizeof (struct sockaddr_storage) : 0;
+    }
+
+    /* Receive the datagrams */
+    int received = recvmmsg (sfd, headers, num, flags, NULL);
+
+    /* Update message lengths */
+    for (i = 0; i < received; ++i) {
+        msgs [i].bytes = (int) headers [i].msg_len;
+        msgs [i].addr_len = (int) headers [i].msg_hdr.msg_namelen;
+    }
+
+    return received;
+#else
+    /* Receive one datagram at a time */
+    for (i = 0; i < num; ++i) {
+        struct sockaddr_storage addr;
+        struct sockaddr_storage* dest = msgs [i].addr ? msgs [i].addr : &addr;
+
+        /* Only the first operation may block */
+        int flag = flags;
+    #if defined MSG_DONTWAIT
+        if (i > 0)
+            flag |= MSG_DONTWAIT;
+    #else
+        if (i > 0)
+            break;
+    #endif
+
+        msgs [i].bytes = udp_recvfrom_addr (sfd, msgs [i].buf, msgs [i].buf_len,
+                                            dest, &msgs [i].addr_len, flag);
+        if (msgs [i].bytes < 0)
+            break;
+    }
+
+    return (i > 0) ? i : -1;
+#endif
+}
+
+/**
+ * Sends up to \a count datagrams with a single system call (using
+ * \c sendmmsg() on Linux). On other systems, the datagrams are sent
+ * one at a time.
+ *
+ * \param sfd the socket descriptor
+ * \param msgs the datagrams to send, each one with its own destination
+ *        address (use a \c NULL address with connected sockets), the
+ *        \c bytes field of each sent message is updated
+ * \param count the number of messages (at most \c SOCKY_BATCH_MAX)
+ * \param flags any additional flags that you may need to use
+ *
+ * \returns the number of sent datagrams, -1 on failure
+ */
+int udp_send_batch (const int sfd, struct udp_message* msgs,
+                    const int count, const int flags)
+{
+    /* Check arguments */
+    if (!valid_sfd (sfd) || msgs == NULL || count <= 0)
+        return -1;
+
+    /* Limit the number of messages */
+    int i;
+    int num = count > SOCKY_BATCH_MAX ? SOCKY_BATCH_MAX : count;
+
+#if defined SOCKY_MMSG
+    /* Describe the datagrams */
+    struct iovec iovecs [SOCKY_BATCH_MAX];
+    struct mmsghdr headers [SOCKY_BATCH_MAX];
+    memset (headers, 0, num * sizeof (struct mmsghdr));
+    for (i = 0; i < num; ++i) {
+        iovecs [i].iov_base = msgs [i].buf;
+        iovecs [i].iov_len = msgs [i].buf_len;
+        headers [i].msg_hdr.msg_iov = &iovecs [i];
+        headers [i].msg_hdr.msg_iovlen = 1;
+        headers [i].msg_hdr.msg_name = msgs [i].addr;
+        headers [i].msg_hdr.msg_namelen = msgs [i].addr ? msgs [i].addr_len : 0;
+    }
+
+    /* Send the datagrams */
+    int sent = sendmmsg (sfd, headers, num, flags);
+
+    /* Update sent lengths */
+    for (i = 0; i < sent; ++i)
+        msgs [i].bytes = (int) headers [i].msg_len;
+
+    return sent;
+#else
+    /* Send one datagram at a time */
+    for (i = 0; i < num; ++i) {
+        if (msgs [i].addr) {
+            msgs [i].bytes = udp_sendto_addr (sfd, msgs [i].buf, msgs [i].buf_len,
+                                              msgs [i].addr, msgs [i].addr_len,
+                                              flags);
+        }
+
+        else
+            msgs [i].bytes = send (sfd, msgs [i].buf, msgs [i].buf_len, flags);
+
+        if (msgs [i].bytes < 0)
+            break;
+    }
+
+    return (i > 0) ? i : -1;
+#endif
+}
+
+/**
+ * Resolves the given \a host and \a service and copies the first obtained
+ * address into \a addr. Callers are expected to cache the result and use it
+ * with \c udp_sendto_addr() or \c udp_connect(), so that the (potentially
+ * slow) lookup is not performed for every datagram.
+ *
+ * \param host the host name
+ * \param service the service name or port string
+ * \param family the address family (\c SOCKY_IPv4, \c SOCKY_IPv6 or
+ *        \c SOCKY_ANY)
+ * \param addr the structure in which to write the obtained address
+ * \param addr_len set to the length of the obtained address
+ *
+ * \returns 0 on success, -1 on failure
+ */
+int udp_resolve (const char* host, const char* service,
+                 const int family, struct sockaddr_storage* addr,
+                 int* addr_len)
+{
+    /* Check arguments */
+    if (addr == NULL || addr_len == NULL)
+        return -1;
+
+    /* Get address info */
+    struct addrinfo* info = get_address_info (host, service,
+                                              SOCKY_UDP, family);
+
+    /* Invalid address info */
+    if (!info)
+        return -1;
+
+    /* Copy the first address into the given structure */
+    int error = -1;
+    if (info->ai_addrlen <= sizeof (struct sockaddr_storage)) {
+        memset (addr, 0, sizeof (struct sockaddr_storage));
+        memcpy (addr, info->ai_addr, info->ai_addrlen);
+        *addr_len = (int) info->ai_addrlen;
+        error = 0;
+    }
+
+    /* Free address information */
+    freeaddrinfo (info);
+    return error;
+}
+
+/**
+ * Sets the default destination of the given UDP socket, after calling this
+ * function, you can use the \c send() function directly with the socket.
+ *
+ * \param sfd the socket file descriptor
+ * \param addr the remote address (obtained with \c udp_resolve())
+ * \param addr_len the length of the remote address
+ *
+ * \returns 0 on success, -1 on failure
+ */
+int udp_connect (const int sfd, const struct sockaddr_storage* addr,
+                 const int addr_len)
+{
+    /* Check arguments */
+    if (!valid_sfd (sfd) || addr == NULL || addr_len <= 0)
+        return -1;
+
+    /* Connect the socket */
+    int error = connect (sfd, (const struct sockaddr*) addr, addr_len);
+    if (error != 0)
+        print_error (sfd, "cannot connect UDP socket", GET_ERR);
+
+    return error;
+}
+
+/**
+ * Sends the given data to an address that has already been resolved with
+ * the \c udp_resolve() function
+ *
+ * \param sfd the socket descriptor
+ * \param buf the data buffer to send
+ * \param buf_len the length of the data buffer
+ * \param addr the remote address
+ * \param addr_len the length of the remote address
+ * \param flags any additional flags that you may need to use
+ */
+int udp_sendto_addr (const int sfd, const char* buf, const int buf_len,
+                     const struct sockaddr_storage* addr,
+                     const int addr_len, const int flags)
+{
+    /* Check if socket, buffer and address are valid */
+    if (!valid_sfd (sfd) || buf == NULL || buf_len <= 0 || addr == NULL)
+        return -1;
+
+    /* Send datagram */
+    return sendto (sfd, buf, buf_len, flags,
+                   (const struct sockaddr*) addr, addr_len);
+}
+
+/**
+ * Removes the default destination of the given UDP socket (set with
+ * \c udp_connect()), so that it can be used with \c sendto() again.
+ *
+ * \note Some systems (e.g. BSD and macOS) report an error even though the
+ *       socket is disconnected, so the result of this function is only
+ *       informative
+ *
+ * \param sfd the socket file descriptor
+ *
+ * \returns 0 on success, -1 on failure
+ */
+int udp_disconnect (const int sfd)
+{
+    /* Check arguments */
+    if (!valid_sfd (sfd))
+        return -1;
+
+    /* Connect the socket to an unspecified address */
+    struct sockaddr_storage addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.ss_family = AF_UNSPEC;
+    return connect (sfd, (const struct sockaddr*) &addr, sizeof (addr));
+}
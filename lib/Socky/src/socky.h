@@ -59,6 +59,18 @@ extern "C" {
 /* Set listen() backlog value */
 #define SOCKY_BACKLOG 128
 
+/* Maximum number of datagrams per batch I/O operation */
+#define SOCKY_BATCH_MAX 32
+
+/* Describes a datagram used with the batch I/O functions */
+struct udp_message {
+    char* buf;                     /* Data buffer */
+    int buf_len;                   /* Buffer size (recv) or data length (send) */
+    int bytes;                     /* Number of received/sent bytes */
+    struct sockaddr_storage* addr; /* Remote address (may be NULL) */
+    int addr_len;                  /* Length of the remote address */
+};
+
 /* Misc functions */
 extern int sockets_exit (void);
 extern int sockets_init (const int exit_on_fail);
@@ -93,6 +105,28 @@ extern int udp_sendto (const int sfd, const char* buf, const int buf_len,
 extern int udp_recvfrom (const int sfd, char* buf, const int buf_len,
                          const char* host, const char* service, const int flags);
 
+/* recvfrom that reports the source address */
+extern int udp_recvfrom_addr (const int sfd, char* buf, const int buf_len,
+                              struct sockaddr_storage* addr, int* addr_len,
+                              const int flags);
+
+/* Batch I/O functions (recvmmsg/sendmmsg when available) */
+extern int udp_recv_batch (const int sfd, struct udp_message* msgs,
+                           const int count, const int flags);
+extern int udp_send_batch (const int sfd, struct udp_message* msgs,
+                           const int count, const int flags);
+
+/* Endpoint caching functions (resolve once, send many times) */
+extern int udp_resolve (const char* host, const char* service,
+                        const int family, struct sockaddr_storage* addr,
+                        int* addr_len);
+extern int udp_connect (const int sfd, const struct sockaddr_storage* addr,
+                        const int addr_len);
+extern int udp_disconnect (const int sfd);
+extern int udp_sendto_addr (const int sfd, const char* buf, const int buf_len,
+                            const struct sockaddr_storage* addr,
+                            const int addr_len, const int flags);
+
 #ifdef __cplusplus
 }
 #endif
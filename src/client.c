@@ -367,6 +367,28 @@ float DS_GetMaximumBatteryVoltage (void)
     return 0.0;
 }
 
+/**
+ * Returns the generation of the current state snapshot, the generation
+ * changes every time that the state of the robot or the DS changes
+ */
+uint32_t DS_GetStateGeneration (void)
+{
+    return CFG_GetStateGeneration();
+}
+
+/**
+ * Copies a consistent snapshot of the robot and DS state to \a state.
+ *
+ * Unlike calling the individual getters, all the values of the snapshot
+ * were published together (e.g. the voltage, enabled state and control
+ * mode obtained from the same robot packet).
+ */
+void DS_GetStateSnapshot (DS_RobotState* state)
+{
+    assert (state);
+    CFG_GetStateSnapshot (state);
+}
+
 /**
  * Instructs the current protocol to reboot the robot
  */
@@ -408,7 +430,12 @@ void DS_SetTeamNumber (const int team)
  */
 void DS_SetRobotEnabled (const int enabled)
 {
+    int was_enabled = CFG_GetRobotEnabled();
     CFG_SetRobotEnabled (enabled);
+
+    /* Tell the robot to disable itself now */
+    if (was_enabled && !CFG_GetRobotEnabled())
+        DS_SendUrgentRobotPacket();
 }
 
 /**
@@ -416,7 +443,12 @@ void DS_SetRobotEnabled (const int enabled)
  */
 void DS_SetEmergencyStopped (const int stop)
 {
+    int was_stopped = CFG_GetEmergencyStopped();
     CFG_SetEmergencyStopped (stop);
+
+    /* Tell the robot to stop now */
+    if (!was_stopped && CFG_GetEmergencyStopped())
+        DS_SendUrgentRobotPacket();
 }
 
 /**
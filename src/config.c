@@ -21,7 +21,9 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "DS_Shm.h"
 #include "DS_Utils.h"
+#include "DS_Atomic.h"
 #include "DS_Client.h"
 #include "DS_Events.h"
 #include "DS_Config.h"
@@ -30,6 +32,16 @@
 #include <math.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+
+/*
+ * Thread-local storage qualifier
+ */
+#if defined (_MSC_VER)
+    #define THREAD_LOCAL __declspec (thread)
+#else
+    #define THREAD_LOCAL __thread
+#endif
 
 /*
  * These variables hold the state(s) of the LibDS and its modules
@@ -50,6 +62,17 @@ static DS_Position robot_position = DS_POSITION_1;
 static DS_Alliance robot_alliance = DS_ALLIANCE_RED;
 static DS_ControlMode control_mode = DS_CONTROL_TELEOPERATED;
 
+/*
+ * Published copy of the state, protected by a seqlock (the sequence is odd
+ * while the snapshot is being written). Updates made by a thread between
+ * CFG_BeginStateUpdate() and CFG_EndStateUpdate() are published together.
+ */
+static DS_RobotState snapshot;
+static volatile uint32_t snapshot_sequence = 0;
+static THREAD_LOCAL int update_depth = 0;
+static THREAD_LOCAL int update_pending = 0;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Ensures that the given \a input number is either \c 0 or \c 1
  */
@@ -78,27 +101,136 @@ static int respect_range (const int input, const int min, const int max)
 }
 
 /**
- * Creates and fills a robot event with the given \a type header
+ * Copies the current state to the published snapshot
+ */
+static void publish_state (void)
+{
+    pthread_mutex_lock (&snapshot_lock);
+
+    /* Mark the snapshot as being written */
+    uint32_t sequence = snapshot_sequence + 1;
+    DS_AtomicStore (&snapshot_sequence, sequence);
+    DS_AtomicFence();
+
+    /* Copy the state */
+    snapshot.generation = (sequence + 1) / 2;
+    snapshot.team = DS_Max (team, 0);
+    snapshot.code = (robot_code == 1);
+    snapshot.enabled = (robot_enabled == 1);
+    snapshot.estopped = (emergency_stopped == 1);
+    snapshot.can_util = DS_Max (can_utilization, 0);
+    snapshot.cpu_usage = DS_Max (cpu_usage, 0);
+    snapshot.ram_usage = DS_Max (ram_usage, 0);
+    snapshot.disk_usage = DS_Max (disk_usage, 0);
+    snapshot.voltage = DS_Max (robot_voltage, 0);
+    snapshot.fms_connected = (fms_communications == 1);
+    snapshot.radio_connected = (radio_communications == 1);
+    snapshot.robot_connected = (robot_communications == 1);
+    snapshot.mode = control_mode;
+    snapshot.alliance = robot_alliance;
+    snapshot.position = robot_position;
+
+    /* Mark the snapshot as written */
+    DS_AtomicStore (&snapshot_sequence, sequence + 1);
+
+    pthread_mutex_unlock (&snapshot_lock);
+
+    /* Export the new state to other processes */
+    Shm_PublishState();
+}
+
+/**
+ * Publishes the state, or defers it until the current thread ends its
+ * state update
+ */
+static void state_changed (void)
+{
+    if (update_depth > 0)
+        update_pending = 1;
+    else
+        publish_state();
+}
+
+/**
+ * Creates and fills a robot event with the given \a type header.
+ * The event is filled directly from the module state (with the same
+ * normalization as the public getters), since telemetry events are
+ * generated for almost every received robot packet.
  */
 static void create_robot_event (const DS_EventType type)
 {
     DS_Event event;
 
     event.robot.type = type;
-    event.robot.code = CFG_GetRobotCode();
-    event.robot.mode = CFG_GetControlMode();
-    event.robot.enabled = CFG_GetRobotEnabled();
-    event.robot.voltage = CFG_GetRobotVoltage();
-    event.robot.can_util = CFG_GetCANUtilization();
-    event.robot.cpu_usage = CFG_GetRobotCPUUsage();
-    event.robot.ram_usage = CFG_GetRobotRAMUsage();
-    event.robot.disk_usage = CFG_GetRobotDiskUsage();
-    event.robot.estopped = CFG_GetEmergencyStopped();
-    event.robot.connected = CFG_GetRobotCommunications();
+    event.robot.mode = control_mode;
+    event.robot.code = (robot_code == 1);
+    event.robot.enabled = (robot_enabled == 1);
+    event.robot.estopped = (emergency_stopped == 1);
+    event.robot.connected = (robot_communications == 1);
+    event.robot.voltage = DS_Max (robot_voltage, 0);
+    event.robot.can_util = DS_Max (can_utilization, 0);
+    event.robot.cpu_usage = DS_Max (cpu_usage, 0);
+    event.robot.ram_usage = DS_Max (ram_usage, 0);
+    event.robot.disk_usage = DS_Max (disk_usage, 0);
 
     DS_AddEvent (&event);
 }
 
+/**
+ * Starts a state update on the calling thread, the changes made until
+ * \c CFG_EndStateUpdate() is called are published as a single snapshot
+ * (e.g. all the values read from a robot packet)
+ */
+void CFG_BeginStateUpdate (void)
+{
+    ++update_depth;
+}
+
+/**
+ * Ends a state update and publishes the changes made during the update
+ */
+void CFG_EndStateUpdate (void)
+{
+    assert (update_depth > 0);
+
+    if (--update_depth == 0 && update_pending) {
+        update_pending = 0;
+        publish_state();
+    }
+}
+
+/**
+ * Returns the generation of the published state snapshot
+ */
+uint32_t CFG_GetStateGeneration (void)
+{
+    return (DS_AtomicLoad (&snapshot_sequence) + 1) / 2;
+}
+
+/**
+ * Copies the published state snapshot to the given \a state, the copy is
+ * retried if the snapshot was updated while it was being copied
+ */
+void CFG_GetStateSnapshot (DS_RobotState* state)
+{
+    uint32_t before, after;
+
+    assert (state);
+
+    do {
+        before = DS_AtomicLoad (&snapshot_sequence);
+        memcpy (state, &snapshot, sizeof (DS_RobotState));
+        DS_AtomicFence();
+        after = DS_AtomicLoad (&snapshot_sequence);
+    } while ((before & 1) || before != after);
+
+    /* The snapshot has never been published */
+    if (before == 0) {
+        publish_state();
+        CFG_GetStateSnapshot (state);
+    }
+}
+
 /**
  * Notifies the user about something through the NetConsole
  */
@@ -303,6 +435,7 @@ void CFG_SetRobotCode (const int code)
 {
     if (robot_code != to_boolean (code)) {
         robot_code = to_boolean (code);
+        state_changed();
         create_robot_event (DS_ROBOT_CODE_CHANGED);
         create_robot_event (DS_STATUS_STRING_CHANGED);
     }
@@ -315,6 +448,7 @@ void CFG_SetTeamNumber (const int number)
 {
     if (team != number) {
         team = number;
+        state_changed();
         CFG_ReconfigureAddresses (RECONFIGURE_ALL);
     }
 }
@@ -326,6 +460,7 @@ void CFG_SetRobotEnabled (const int enabled)
 {
     if (robot_enabled != to_boolean (enabled)) {
         robot_enabled = to_boolean (enabled) && !CFG_GetEmergencyStopped();
+        state_changed();
         create_robot_event (DS_ROBOT_ENABLED_CHANGED);
         create_robot_event (DS_STATUS_STRING_CHANGED);
     }
@@ -339,6 +474,7 @@ void CFG_SetRobotCPUUsage (const int percent)
 {
     if (cpu_usage != percent) {
         cpu_usage = respect_range (percent, 0, 100);
+        state_changed();
         create_robot_event (DS_ROBOT_CPU_INFO_CHANGED);
     }
 }
@@ -351,6 +487,7 @@ void CFG_SetRobotRAMUsage (const int percent)
 {
     if (ram_usage != percent) {
         ram_usage = respect_range (percent, 0, 100);
+        state_changed();
         create_robot_event (DS_ROBOT_RAM_INFO_CHANGED);
     }
 }
@@ -363,6 +500,7 @@ void CFG_SetRobotDiskUsage (const int percent)
 {
     if (disk_usage != percent) {
         disk_usage = respect_range (percent, 0, 100);
+        state_changed();
         create_robot_event (DS_ROBOT_DISK_INFO_CHANGED);
     }
 }
@@ -374,6 +512,7 @@ void CFG_SetRobotVoltage (const float voltage)
 {
     if (robot_voltage != voltage) {
         robot_voltage = roundf (voltage * 100) / 100;
+        state_changed();
         create_robot_event (DS_ROBOT_VOLTAGE_CHANGED);
     }
 }
@@ -385,6 +524,7 @@ void CFG_SetEmergencyStopped (const int stopped)
 {
     if (emergency_stopped != to_boolean (stopped)) {
         emergency_stopped = to_boolean (stopped);
+        state_changed();
         create_robot_event (DS_ROBOT_ESTOP_CHANGED);
         create_robot_event (DS_STATUS_STRING_CHANGED);
     }
@@ -397,6 +537,7 @@ void CFG_SetAlliance (const DS_Alliance alliance)
 {
     if (robot_alliance != alliance) {
         robot_alliance = alliance;
+        state_changed();
         create_robot_event (DS_ROBOT_STATION_CHANGED);
     }
 }
@@ -408,6 +549,7 @@ void CFG_SetPosition (const DS_Position position)
 {
     if (robot_position != position) {
         robot_position = position;
+        state_changed();
         create_robot_event (DS_ROBOT_STATION_CHANGED);
     }
 }
@@ -419,6 +561,7 @@ void CFG_SetCANUtilization (const int utilization)
 {
     if (can_utilization != utilization) {
         can_utilization = utilization;
+        state_changed();
         create_robot_event (DS_ROBOT_CAN_UTIL_CHANGED);
     }
 }
@@ -430,6 +573,7 @@ void CFG_SetControlMode (const DS_ControlMode mode)
 {
     if (control_mode != mode) {
         control_mode = mode;
+        state_changed();
         create_robot_event (DS_ROBOT_MODE_CHANGED);
         create_robot_event (DS_STATUS_STRING_CHANGED);
     }
@@ -442,6 +586,7 @@ void CFG_SetFMSCommunications (const int communications)
 {
     if (fms_communications != to_boolean (communications)) {
         fms_communications = to_boolean (communications);
+        state_changed();
 
         DS_Event event;
         event.fms.type = DS_FMS_COMMS_CHANGED;
@@ -459,6 +604,7 @@ void CFG_SetRadioCommunications (const int communications)
 {
     if (radio_communications != to_boolean (communications)) {
         radio_communications = to_boolean (communications);
+        state_changed();
 
         DS_Event event;
         event.radio.type = DS_RADIO_COMMS_CHANGED;
@@ -476,6 +622,7 @@ void CFG_SetRobotCommunications (const int communications)
 {
     if (robot_communications != to_boolean (communications)) {
         robot_communications = to_boolean (communications);
+        state_changed();
         create_robot_event (DS_ROBOT_COMMS_CHANGED);
         create_robot_event (DS_STATUS_STRING_CHANGED);
 
@@ -507,6 +654,7 @@ void CFG_RadioWatchdogExpired (void)
 void CFG_RobotWatchdogExpired (void)
 {
     /* Reset everything to safe state */
+    CFG_BeginStateUpdate();
     CFG_SetRobotCode (0);
     CFG_SetRobotVoltage (0);
     CFG_SetRobotEnabled (0);
@@ -515,6 +663,7 @@ void CFG_RobotWatchdogExpired (void)
     CFG_SetRobotDiskUsage (0);
     CFG_SetEmergencyStopped (0);
     CFG_SetRobotCommunications (0);
+    CFG_EndStateUpdate();
 
     /* Force the sockets to perform another lookup */
     CFG_ReconfigureAddresses (RECONFIGURE_ROBOT);
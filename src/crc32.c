@@ -43,6 +43,28 @@
 #include "DS_Utils.h"
 
 #include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * Use carry-less multiplication (PCLMULQDQ) on x86-64 when the CPU has it
+ */
+#if defined (__x86_64__) && (defined (__GNUC__) || defined (__clang__))
+    #define CRC32_PCLMUL
+    #define PCLMUL_TARGET __attribute__ ((target ("pclmul,sse2")))
+    #include <cpuid.h>
+    #include <emmintrin.h>
+    #include <wmmintrin.h>
+#elif defined (_MSC_VER) && defined (_M_X64)
+    #define CRC32_PCLMUL
+    #define PCLMUL_TARGET
+    #include <intrin.h>
+    #include <emmintrin.h>
+    #include <wmmintrin.h>
+#endif
+
+#define PCLMUL_MIN_SIZE 64 /* Smallest buffer handled by the PCLMUL code */
+#define CRC32_POLY 0xEDB88320UL /* Reflected CRC32 polynomial */
 
 static uint32_t crc32_tab[] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
@@ -90,17 +112,337 @@ static uint32_t crc32_tab[] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
-uint32_t DS_CRC32 (const void* buf, size_t size)
+/*
+ * Slice-by-8 tables, the first table is a copy of crc32_tab
+ */
+static uint32_t crc32_slice [8][256];
+
+/*
+ * Powers of x^(2^n) modulo the CRC polynomial, used to combine checksums
+ */
+static uint32_t x2n_table [32];
+
+/*
+ * Implementation flags, selected at runtime
+ */
+static int use_slice8 = 0;
+static int use_pclmul = 0;
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Returns the product of \a a and \a b modulo the CRC polynomial, both
+ * values are stored with reflected bit order (x^0 is the highest bit)
+ */
+static uint32_t multmodp (uint32_t a, uint32_t b)
 {
-    assert (buf);
+    uint32_t m = 1UL << 31;
+    uint32_t p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+    }
+
+    return p;
+}
+
+/**
+ * Returns x^(n * 2^k) modulo the CRC polynomial
+ */
+static uint32_t x2nmodp (size_t n, unsigned k)
+{
+    uint32_t p = 1UL << 31;
+
+    while (n) {
+        if (n & 1)
+            p = multmodp (x2n_table [k & 31], p);
+
+        n >>= 1;
+        ++k;
+    }
+
+    return p;
+}
+
+/**
+ * Generates the slice-by-8 tables and selects the fastest implementation
+ * supported by the CPU
+ */
+static void crc32_init (void)
+{
+    int i, j;
+
+    /* Generate the slice-by-8 tables */
+    for (i = 0; i < 256; ++i)
+        crc32_slice [0][i] = crc32_tab [i];
 
-    const uint8_t* p;
-    uint32_t crc = 0xFFFFFFFFUL;
+    for (j = 1; j < 8; ++j) {
+        for (i = 0; i < 256; ++i) {
+            uint32_t crc = crc32_slice [j - 1][i];
+            crc32_slice [j][i] = (crc >> 8) ^ crc32_tab [crc & 0xFF];
+        }
+    }
 
-    p = buf;
+    /* Generate the x^(2^n) table used by the combine functions */
+    uint32_t p = 1UL << 30;
+    x2n_table [0] = p;
+    for (i = 1; i < 32; ++i)
+        x2n_table [i] = p = multmodp (p, p);
+
+    /* Slice-by-8 code reads little-endian words */
+    const uint16_t endian = 1;
+    use_slice8 = (* (const uint8_t*) &endian == 1);
+
+    /* Check if the CPU supports PCLMULQDQ */
+#if defined (CRC32_PCLMUL) && defined (_MSC_VER)
+    int info [4];
+    __cpuid (info, 1);
+    use_pclmul = (info [2] & (1 << 1)) != 0;
+#elif defined (CRC32_PCLMUL)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+        use_pclmul = (ecx & (1 << 1)) != 0;
+#endif
+}
 
+/**
+ * Classic table-driven implementation, one byte per iteration
+ */
+static uint32_t crc32_bytewise (uint32_t crc, const uint8_t* p, size_t size)
+{
     while (size--)
         crc = crc32_tab [ (crc ^ *p++) & 0xFF] ^ (crc >> 8);
 
+    return crc;
+}
+
+/**
+ * Slice-by-8 implementation, eight bytes per iteration
+ */
+static uint32_t crc32_slice8 (uint32_t crc, const uint8_t* p, size_t size)
+{
+    while (size >= 8) {
+        uint32_t one, two;
+        memcpy (&one, p, 4);
+        memcpy (&two, p + 4, 4);
+        one ^= crc;
+
+        crc = crc32_slice [7][one & 0xFF] ^
+              crc32_slice [6][(one >> 8) & 0xFF] ^
+              crc32_slice [5][(one >> 16) & 0xFF] ^
+              crc32_slice [4][one >> 24] ^
+              crc32_slice [3][two & 0xFF] ^
+              crc32_slice [2][(two >> 8) & 0xFF] ^
+              crc32_slice [1][(two >> 16) & 0xFF] ^
+              crc32_slice [0][two >> 24];
+
+        p += 8;
+        size -= 8;
+    }
+
+    return crc32_bytewise (crc, p, size);
+}
+
+#if defined (CRC32_PCLMUL)
+/**
+ * Folds the buffer 64 bytes at a time with carry-less multiplications and
+ * reduces the result with a Barrett reduction, as described in Intel's
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".
+ *
+ * \note The \a size must be a multiple of 16 and at least 64 bytes
+ */
+PCLMUL_TARGET
+static uint32_t crc32_pclmul (uint32_t crc, const uint8_t* p, size_t size)
+{
+    /* Folding constants for the reflected CRC32 polynomial */
+    static const uint64_t k1k2 [2] = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const uint64_t k3k4 [2] = { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const uint64_t k5k0 [2] = { 0x0163cd6124ULL, 0x0000000000ULL };
+    static const uint64_t poly [2] = { 0x01db710641ULL, 0x01f7011641ULL };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    /* Load the first 64 bytes and add the initial CRC */
+    x1 = _mm_loadu_si128 ((const __m128i*) (p + 0x00));
+    x2 = _mm_loadu_si128 ((const __m128i*) (p + 0x10));
+    x3 = _mm_loadu_si128 ((const __m128i*) (p + 0x20));
+    x4 = _mm_loadu_si128 ((const __m128i*) (p + 0x30));
+    x1 = _mm_xor_si128 (x1, _mm_cvtsi32_si128 ((int) crc));
+    x0 = _mm_loadu_si128 ((const __m128i*) k1k2);
+
+    p += 64;
+    size -= 64;
+
+    /* Fold 64 bytes per iteration */
+    while (size >= 64) {
+        x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128 (x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128 (x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128 (x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128 (x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128 (x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128 ((const __m128i*) (p + 0x00));
+        y6 = _mm_loadu_si128 ((const __m128i*) (p + 0x10));
+        y7 = _mm_loadu_si128 ((const __m128i*) (p + 0x20));
+        y8 = _mm_loadu_si128 ((const __m128i*) (p + 0x30));
+
+        x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x5), y5);
+        x2 = _mm_xor_si128 (_mm_xor_si128 (x2, x6), y6);
+        x3 = _mm_xor_si128 (_mm_xor_si128 (x3, x7), y7);
+        x4 = _mm_xor_si128 (_mm_xor_si128 (x4, x8), y8);
+
+        p += 64;
+        size -= 64;
+    }
+
+    /* Fold the four 128-bit values into one */
+    x0 = _mm_loadu_si128 ((const __m128i*) k3k4);
+
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x4), x5);
+
+    /* Fold the remaining 16-byte blocks */
+    while (size >= 16) {
+        x2 = _mm_loadu_si128 ((const __m128i*) p);
+        x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+        x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+        p += 16;
+        size -= 16;
+    }
+
+    /* Fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128 (x1, x0, 0x10);
+    x3 = _mm_setr_epi32 (~0, 0, ~0, 0);
+    x1 = _mm_srli_si128 (x1, 8);
+    x1 = _mm_xor_si128 (x1, x2);
+
+    x0 = _mm_loadl_epi64 ((const __m128i*) k5k0);
+
+    x2 = _mm_srli_si128 (x1, 4);
+    x1 = _mm_and_si128 (x1, x3);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_xor_si128 (x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_loadu_si128 ((const __m128i*) poly);
+
+    x2 = _mm_and_si128 (x1, x3);
+    x2 = _mm_clmulepi64_si128 (x2, x0, 0x10);
+    x2 = _mm_and_si128 (x2, x3);
+    x2 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+    x1 = _mm_xor_si128 (x1, x2);
+
+    /* The CRC is in the second 32-bit lane */
+    return (uint32_t) _mm_cvtsi128_si32 (_mm_srli_si128 (x1, 4));
+}
+#endif
+
+/**
+ * Continues the calculation of the CRC32 checksum of a data stream.
+ * Use \c 0 as the initial \a crc, and the value returned by this function
+ * (or by \c DS_CRC32()) to process the next block of the stream.
+ *
+ * \param crc the checksum of the previous blocks
+ * \param buf the next block of data
+ * \param size the length of the block
+ */
+uint32_t DS_CRC32Update (uint32_t crc, const void* buf, size_t size)
+{
+    assert (buf || size == 0);
+
+    pthread_once (&crc32_once, &crc32_init);
+
+    const uint8_t* p = (const uint8_t*) buf;
+    crc ^= 0xFFFFFFFFUL;
+
+#if defined (CRC32_PCLMUL)
+    /* Fold the largest multiple of 16 bytes with PCLMULQDQ */
+    if (use_pclmul && size >= PCLMUL_MIN_SIZE) {
+        size_t blocks = size & ~ ((size_t) 15);
+        crc = crc32_pclmul (crc, p, blocks);
+        p += blocks;
+        size -= blocks;
+    }
+#endif
+
+    /* Process the rest of the data */
+    if (use_slice8)
+        crc = crc32_slice8 (crc, p, size);
+    else
+        crc = crc32_bytewise (crc, p, size);
+
     return crc ^ 0xFFFFFFFFUL;
 }
+
+/**
+ * Returns the CRC32 checksum of the given buffer
+ *
+ * \param buf the data buffer
+ * \param size the length of the data buffer
+ */
+uint32_t DS_CRC32 (const void* buf, size_t size)
+{
+    assert (buf);
+    return DS_CRC32Update (0, buf, size);
+}
+
+/**
+ * Returns the operator used by \c DS_CRC32CombineOp() to append a block of
+ * \a length bytes to a checksum. Generate the operator once when the length
+ * of the second block never changes, so that each combination is cheap.
+ *
+ * \param length the length of the second block
+ */
+uint32_t DS_CRC32CombineGen (size_t length)
+{
+    pthread_once (&crc32_once, &crc32_init);
+    return x2nmodp (length, 3);
+}
+
+/**
+ * Returns the checksum of two concatenated blocks, given the checksum of
+ * each block and the operator generated by \c DS_CRC32CombineGen() for the
+ * length of the second block
+ *
+ * \param crc1 the checksum of the first block
+ * \param crc2 the checksum of the second block
+ * \param op the operator for the length of the second block
+ */
+uint32_t DS_CRC32CombineOp (uint32_t crc1, uint32_t crc2, uint32_t op)
+{
+    return multmodp (op, crc1) ^ crc2;
+}
+
+/**
+ * Returns the checksum of two concatenated blocks, given the checksum of
+ * each block and the \a length of the second block
+ *
+ * \param crc1 the checksum of the first block
+ * \param crc2 the checksum of the second block
+ * \param length the length of the second block
+ */
+uint32_t DS_CRC32Combine (uint32_t crc1, uint32_t crc2, size_t length)
+{
+    return DS_CRC32CombineOp (crc1, crc2, DS_CRC32CombineGen (length));
+}
@@ -22,39 +22,601 @@
  */
 
 #include "DS_Queue.h"
+#include "DS_Timer.h"
+#include "DS_Atomic.h"
 #include "DS_Events.h"
 
+#include <errno.h>
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <pthread.h>
+
+#if defined __linux__
+    #include <unistd.h>
+    #include <sys/eventfd.h>
+    #define EVENT_FD_EVENTFD
+#elif !defined _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #define EVENT_FD_PIPE
+#endif
+
+#define MAX_EVENTS 1024   /* Number of events that the queue can hold */
+#define TELEMETRY_TYPES 5 /* Number of event types that can be coalesced */
 
 static DS_Queue events;
 
+/*
+ * Thread-local storage qualifier
+ */
+#if defined (_MSC_VER)
+    #define THREAD_LOCAL __declspec (thread)
+#else
+    #define THREAD_LOCAL __thread
+#endif
+
+/*
+ * Event sequence counter and receive time of the datagram that is being
+ * processed by the current thread (zero if none)
+ */
+static volatile uint32_t sequence = 0;
+static THREAD_LOCAL uint64_t event_origin = 0;
+
+/**
+ * Holds the latest event of a telemetry event type. The sequence number is
+ * odd while the event is being written (seqlock), so that readers can
+ * detect partial copies and retry without taking a lock. The delivered
+ * number is the sequence of the last copy that was returned to a reader,
+ * so that the same event is never returned twice.
+ */
+typedef struct {
+    volatile uint32_t sequence;
+    volatile uint32_t delivered;
+    DS_Event event;
+} TelemetrySlot;
+
+/*
+ * Coalesced telemetry events, a bit of the dirty mask is set when the
+ * corresponding slot holds an event that has not been polled yet
+ */
+static volatile uint32_t coalescing = 0;
+static volatile uint32_t dirty_mask = 0;
+static TelemetrySlot telemetry [TELEMETRY_TYPES];
+static pthread_mutex_t telemetry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Represents a registered event callback
+ */
+typedef struct {
+    uint32_t mask;
+    void* data;
+    DS_EventCallback callback;
+} Subscriber;
+
+/**
+ * Immutable list of subscribers, a new list is published every time that
+ * a subscriber is added or removed (copy-on-write)
+ */
+typedef struct _subscriber_list {
+    int count;
+    struct _subscriber_list* next;
+    Subscriber subscribers [];
+} SubscriberList;
+
+/*
+ * Subscriber lists, the current list is read by the dispatching threads
+ * without locking. Each dispatcher registers itself in the counter of the
+ * current epoch. Replaced lists are retired, and are moved to the expiring
+ * lists when the epoch changes. The expiring lists are released once every
+ * dispatcher of the previous epoch is done, so a dispatcher that is still
+ * running only delays the release of the lists it may be reading.
+ */
+static void* volatile subscribers = NULL;
+static SubscriberList* retired_lists = NULL;
+static SubscriberList* expiring_lists = NULL;
+static volatile uint32_t epoch = 0;
+static volatile uint32_t dispatchers [2] = { 0, 0 };
+static pthread_mutex_t subscribers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Wakeup objects, the condition variable is used by DS_WaitEvent() and the
+ * file descriptor is readable while there are pending events. The number of
+ * threads in DS_WaitEvent() is counted, so that DS_AddEvent() only takes the
+ * lock when there is a thread to wake up.
+ */
+static pthread_cond_t events_cond;
+static pthread_mutex_t events_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint32_t waiters = 0;
+static volatile uint32_t signaled = 0;
+static int notify_fd [2] = { -1, -1 };
+
+/**
+ * Makes the event file descriptor readable (if it is not readable already)
+ */
+static void raise_signal (void)
+{
+    if (DS_AtomicExchange (&signaled, 1) != 0)
+        return;
+
+#if defined EVENT_FD_EVENTFD
+    uint64_t value = 1;
+    if (notify_fd [1] >= 0 && write (notify_fd [1], &value, sizeof (value)) < 0)
+        DS_AtomicStore (&signaled, 0);
+#elif defined EVENT_FD_PIPE
+    char value = 1;
+    if (notify_fd [1] >= 0 && write (notify_fd [1], &value, sizeof (value)) < 0)
+        DS_AtomicStore (&signaled, 0);
+#endif
+}
+
+/**
+ * Drains the event file descriptor, so that it is no longer readable
+ */
+static void clear_signal (void)
+{
+    DS_AtomicExchange (&signaled, 0);
+
+#if defined EVENT_FD_EVENTFD
+    uint64_t value;
+    if (notify_fd [0] >= 0 && read (notify_fd [0], &value, sizeof (value)) < 0)
+        return;
+#elif defined EVENT_FD_PIPE
+    char buffer [64];
+    if (notify_fd [0] >= 0)
+        while (read (notify_fd [0], buffer, sizeof (buffer)) > 0);
+#endif
+}
+
+/**
+ * Returns the telemetry slot used by the given event \a type, or \c -1 if
+ * events of the given type must never be coalesced (e.g. state changes)
+ */
+static int telemetry_index (const DS_EventType type)
+{
+    switch (type) {
+    case DS_ROBOT_VOLTAGE_CHANGED:
+        return 0;
+    case DS_ROBOT_CAN_UTIL_CHANGED:
+        return 1;
+    case DS_ROBOT_CPU_INFO_CHANGED:
+        return 2;
+    case DS_ROBOT_RAM_INFO_CHANGED:
+        return 3;
+    case DS_ROBOT_DISK_INFO_CHANGED:
+        return 4;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Replaces the event stored in the given telemetry slot \a index and marks
+ * the slot as dirty
+ */
+static void store_telemetry (const int index, const DS_Event* event)
+{
+    TelemetrySlot* slot = &telemetry [index];
+
+    /* Write the event (the sequence is odd while writing) */
+    pthread_mutex_lock (&telemetry_lock);
+    DS_AtomicStore (&slot->sequence, slot->sequence + 1);
+    DS_AtomicFence();
+    memcpy (&slot->event, event, sizeof (DS_Event));
+    DS_AtomicStore (&slot->sequence, slot->sequence + 1);
+    pthread_mutex_unlock (&telemetry_lock);
+
+    /* Mark the slot as dirty */
+    DS_AtomicOr (&dirty_mask, 1u << index);
+}
+
+/**
+ * Copies the dirty telemetry event with the lowest slot index (not the
+ * oldest one) to \a event and clears its dirty bit. The slot is read
+ * without locking, the copy is retried if a writer changed the slot while
+ * it was being copied.
+ *
+ * The dirty bit is cleared before copying, so that an event stored during
+ * the copy sets it again and is not lost. The copied event may then be
+ * that newer event, which is only returned if its seqlock sequence is newer
+ * than the last delivered copy of the slot (and is otherwise skipped).
+ *
+ * \returns \c 1 if an event was obtained, \c 0 if there are no dirty slots
+ */
+static int take_telemetry (DS_Event* event)
+{
+    uint32_t mask = DS_AtomicLoad (&dirty_mask);
+
+    while (mask) {
+        /* Get the first dirty slot */
+        int index = 0;
+        while (! (mask & (1u << index)))
+            ++index;
+
+        /* Clear its dirty bit (or retry with the updated mask) */
+        if (!DS_AtomicCompareExchange (&dirty_mask, &mask, mask & ~ (1u << index)))
+            continue;
+
+        /* Copy the event */
+        uint32_t before, after;
+        TelemetrySlot* slot = &telemetry [index];
+        do {
+            before = DS_AtomicLoad (&slot->sequence);
+            memcpy (event, &slot->event, sizeof (DS_Event));
+            DS_AtomicFence();
+            after = DS_AtomicLoad (&slot->sequence);
+        } while ((before & 1) || before != after);
+
+        /* Return the copy if no reader returned it (or a newer copy) */
+        uint32_t delivered = DS_AtomicLoad (&slot->delivered);
+        while ((int32_t) (before - delivered) > 0) {
+            if (DS_AtomicCompareExchange (&slot->delivered, &delivered, before))
+                return 1;
+        }
+
+        /* The event was already returned, check the other slots */
+        mask = DS_AtomicLoad (&dirty_mask);
+    }
+
+    return 0;
+}
+
 /**
- * Initializes the event queue with an initial support for 50 events
+ * Returns the next pending event, edge events in the queue are returned
+ * first (in the order in which they were added), then the latest values of
+ * the coalesced telemetry events
+ */
+static int next_event (DS_Event* event)
+{
+    if (DS_QueuePop (&events, event))
+        return 1;
+
+    return take_telemetry (event);
+}
+
+/**
+ * Calls the subscribers that are interested in the given \a event
+ */
+static void dispatch_event (const DS_Event* event)
+{
+    /* Register this thread as a dispatcher before reading the list */
+    uint32_t current = DS_AtomicLoad (&epoch) & 1;
+    DS_AtomicAdd (&dispatchers [current], 1);
+    DS_AtomicFence();
+
+    /* Call the subscribers */
+    SubscriberList* list = DS_AtomicLoadPtr (&subscribers);
+    if (list) {
+        int i;
+        uint32_t bit = DS_EVENT_MASK (event->type);
+        for (i = 0; i < list->count; ++i) {
+            if (list->subscribers [i].mask & bit)
+                list->subscribers [i].callback (event,
+                                                list->subscribers [i].data);
+        }
+    }
+
+    DS_AtomicAdd (&dispatchers [current], (uint32_t) -1);
+}
+
+/**
+ * Releases the given subscriber \a lists
+ */
+static void free_lists (SubscriberList** lists)
+{
+    while (*lists) {
+        SubscriberList* next = (*lists)->next;
+        free (*lists);
+        *lists = next;
+    }
+}
+
+/**
+ * Releases the expiring lists once no dispatcher of the previous epoch is
+ * running, then starts a new epoch in which the retired lists expire.
+ *
+ * Dispatchers that could read an expiring list registered themselves in
+ * the previous epoch (or in an older one, which has already drained).
+ * This is safe to call from a callback, since a dispatcher never waits
+ * for the release of the lists.
+ *
+ * \note The caller must hold the subscribers lock
+ */
+static void reclaim_lists (void)
+{
+    uint32_t previous = (DS_AtomicLoad (&epoch) & 1) ^ 1;
+    if (DS_AtomicLoad (&dispatchers [previous]) != 0)
+        return;
+
+    free_lists (&expiring_lists);
+    if (retired_lists) {
+        expiring_lists = retired_lists;
+        retired_lists = NULL;
+        DS_AtomicStore (&epoch, previous);
+    }
+}
+
+/**
+ * Publishes the given subscriber \a list, retires the replaced list and
+ * releases the lists that can no longer be read by any dispatching thread.
+ *
+ * \note The caller must hold the subscribers lock
+ */
+static void publish_subscribers (SubscriberList* list)
+{
+    /* Replace the current list */
+    SubscriberList* old = DS_AtomicLoadPtr (&subscribers);
+    DS_AtomicStorePtr (&subscribers, list);
+    DS_AtomicFence();
+
+    /* Keep the old list until no thread can be reading it */
+    if (old) {
+        old->next = retired_lists;
+        retired_lists = old;
+    }
+
+    reclaim_lists();
+}
+
+/**
+ * Creates the event file descriptor (if the platform supports it)
+ */
+static void open_notify_fd (void)
+{
+#if defined EVENT_FD_EVENTFD
+    notify_fd [0] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    notify_fd [1] = notify_fd [0];
+#elif defined EVENT_FD_PIPE
+    if (pipe (notify_fd) == 0) {
+        int i;
+        for (i = 0; i < 2; ++i) {
+            fcntl (notify_fd [i], F_SETFL, fcntl (notify_fd [i], F_GETFL) | O_NONBLOCK);
+            fcntl (notify_fd [i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    else {
+        notify_fd [0] = -1;
+        notify_fd [1] = -1;
+    }
+#endif
+}
+
+/**
+ * Closes the event file descriptor
+ */
+static void close_notify_fd (void)
+{
+#if defined EVENT_FD_EVENTFD || defined EVENT_FD_PIPE
+    if (notify_fd [0] >= 0)
+        close (notify_fd [0]);
+    if (notify_fd [1] >= 0 && notify_fd [1] != notify_fd [0])
+        close (notify_fd [1]);
+#endif
+
+    notify_fd [0] = -1;
+    notify_fd [1] = -1;
+}
+
+/**
+ * Initializes the event queue, if the application does not poll the events
+ * fast enough the oldest events are discarded
  */
 void Events_Init (void)
 {
-    DS_QueueInit (&events, 50, sizeof (DS_Event));
+    DS_QueueInit (&events, MAX_EVENTS, sizeof (DS_Event), DS_QUEUE_DROP_OLDEST);
+    DS_CondInit (&events_cond);
+    DS_AtomicStore (&signaled, 0);
+    DS_AtomicStore (&dirty_mask, 0);
+    open_notify_fd();
 }
 
 /**
- * De-allocates the event queue (that's all)
+ * De-allocates the event queue and closes the event file descriptor
  */
 void Events_Close (void)
 {
+    /* Wake up waiting threads */
+    pthread_mutex_lock (&events_lock);
+    pthread_cond_broadcast (&events_cond);
+    pthread_mutex_unlock (&events_lock);
+
+    /* Remove all subscribers (and release the lists of both epochs) */
+    pthread_mutex_lock (&subscribers_lock);
+    publish_subscribers (NULL);
+    reclaim_lists();
+    pthread_mutex_unlock (&subscribers_lock);
+
+    /* Release resources */
+    close_notify_fd();
     DS_QueueFree (&events);
+    pthread_cond_destroy (&events_cond);
 }
 
 /**
- * Adds the given \a event to the event queue
+ * Adds the given \a event to the event queue, this function can be called
+ * from any thread. Threads waiting in \c DS_WaitEvent() are woken up and
+ * the event file descriptor becomes readable.
  *
  * \param event the event to register in the event queue
  */
 void DS_AddEvent (DS_Event* event)
 {
     assert (event);
-    DS_QueuePush (&events, (void*) event);
+
+    /* Stamp the event */
+    event->header.sequence = DS_AtomicAdd (&sequence, 1);
+    event->header.timestamp = event_origin ? event_origin : DS_GetMonotonicTime();
+
+    /* Call the subscribers directly */
+    dispatch_event (event);
+
+    /* Replace the latest telemetry event or add the event to the queue */
+    int index = telemetry_index (event->type);
+    if (DS_AtomicLoad (&coalescing) && index >= 0)
+        store_telemetry (index, event);
+    else
+        DS_QueuePush (&events, event);
+
+    /* Notify the file descriptor */
+    raise_signal();
+
+    /* Wake up waiting threads (the fence orders the push before the load) */
+    DS_AtomicFence();
+    if (DS_AtomicLoad (&waiters) != 0) {
+        pthread_mutex_lock (&events_lock);
+        pthread_cond_broadcast (&events_cond);
+        pthread_mutex_unlock (&events_lock);
+    }
+}
+
+/**
+ * Sets the monotonic receive time of the datagram that is being processed
+ * by the calling thread. Events added by this thread are stamped with the
+ * given \a timestamp until it is set back to \c 0, after which they are
+ * stamped with the time at which they are added.
+ */
+void DS_SetEventOrigin (const uint64_t timestamp)
+{
+    event_origin = timestamp;
+}
+
+/**
+ * Returns a file descriptor that becomes readable when there are pending
+ * events, so that the application can wait for events with select(),
+ * poll(), epoll or the event loop of its toolkit (e.g. QSocketNotifier).
+ *
+ * Do not read from the descriptor, it is drained by \c DS_PollEvent() once
+ * every pending event has been obtained. The descriptor may be readable
+ * when no events are pending, in which case \c DS_PollEvent() returns 0.
+ *
+ * \returns the file descriptor, or \c -1 if the platform does not support it
+ */
+int DS_GetEventFD (void)
+{
+    return notify_fd [0];
+}
+
+/**
+ * Returns \c 1 if telemetry events are being coalesced
+ */
+int DS_GetEventCoalescing (void)
+{
+    return (int) DS_AtomicLoad (&coalescing);
+}
+
+/**
+ * Enables or disables the coalescing of telemetry events (voltage, CAN,
+ * CPU, RAM and disk usage changes).
+ *
+ * When enabled, only the latest event of each telemetry type is kept until
+ * the application polls it, so that a slow application does not build up a
+ * backlog of stale values. Other events (e.g. enabled, e-stop or comms
+ * changes) are never merged and are always delivered in order.
+ */
+void DS_SetEventCoalescing (const int enabled)
+{
+    DS_AtomicStore (&coalescing, enabled ? 1 : 0);
+}
+
+/**
+ * Registers the given \a callback, which will be called with the given
+ * \a data for every new event whose type is set in the given \a mask
+ * (e.g. \c DS_EVENT_MASK(DS_ROBOT_ESTOP_CHANGED) or \c DS_ALL_EVENTS).
+ *
+ * The callback is called directly from the thread that generates the
+ * event, without waiting for the application to poll the event queue.
+ * Events are still added to the event queue.
+ *
+ * \returns \c 1 on success, \c 0 on failure
+ */
+int DS_Subscribe (const uint32_t mask, DS_EventCallback callback, void* data)
+{
+    /* Check arguments */
+    if (!callback)
+        return 0;
+
+    pthread_mutex_lock (&subscribers_lock);
+
+    /* Copy the current list */
+    SubscriberList* old = DS_AtomicLoadPtr (&subscribers);
+    int count = old ? old->count : 0;
+    SubscriberList* list = malloc (sizeof (SubscriberList) +
+                                   (count + 1) * sizeof (Subscriber));
+    if (!list) {
+        pthread_mutex_unlock (&subscribers_lock);
+        return 0;
+    }
+
+    /* Append the new subscriber */
+    if (count > 0)
+        memcpy (list->subscribers, old->subscribers, count * sizeof (Subscriber));
+
+    list->next = NULL;
+    list->count = count + 1;
+    list->subscribers [count].mask = mask;
+    list->subscribers [count].data = data;
+    list->subscribers [count].callback = callback;
+
+    /* Publish the new list */
+    publish_subscribers (list);
+    pthread_mutex_unlock (&subscribers_lock);
+
+    return 1;
+}
+
+/**
+ * Removes the subscriptions of the given \a callback with the given \a data
+ *
+ * \returns \c 1 if a subscription was removed, \c 0 otherwise
+ */
+int DS_Unsubscribe (DS_EventCallback callback, void* data)
+{
+    int i;
+    int removed = 0;
+
+    pthread_mutex_lock (&subscribers_lock);
+
+    /* Nothing to remove */
+    SubscriberList* old = DS_AtomicLoadPtr (&subscribers);
+    if (!old) {
+        pthread_mutex_unlock (&subscribers_lock);
+        return 0;
+    }
+
+    /* Copy the current list, without the given subscriber */
+    SubscriberList* list = malloc (sizeof (SubscriberList) +
+                                   old->count * sizeof (Subscriber));
+    if (!list) {
+        pthread_mutex_unlock (&subscribers_lock);
+        return 0;
+    }
+
+    list->count = 0;
+    list->next = NULL;
+    for (i = 0; i < old->count; ++i) {
+        if (old->subscribers [i].callback == callback &&
+            old->subscribers [i].data == data)
+            ++removed;
+        else
+            list->subscribers [list->count++] = old->subscribers [i];
+    }
+
+    /* Publish the new list (or discard it if nothing changed) */
+    if (removed) {
+        if (list->count == 0) {
+            free (list);
+            list = NULL;
+        }
+
+        publish_subscribers (list);
+    }
+
+    else
+        free (list);
+
+    pthread_mutex_unlock (&subscribers_lock);
+    return removed > 0;
 }
 
 /**
@@ -67,13 +629,64 @@ void DS_AddEvent (DS_Event* event)
  */
 int DS_PollEvent (DS_Event* event)
 {
-    DS_Event* front = (DS_Event*) DS_QueueGetFirst (&events);
+    assert (event);
 
-    if (front) {
-        DS_QueuePop (&events);
-        memcpy (event, front, sizeof (DS_Event));
+    /* Get the next event */
+    if (next_event (event))
+        return 1;
+
+    /* Queue is empty, clear the file descriptor and check again, in case an
+     * event was added while we were clearing it */
+    clear_signal();
+    if (next_event (event)) {
+        raise_signal();
         return 1;
     }
 
     return 0;
 }
+
+/**
+ * Waits until there is a pending event (or until \a timeout_ms milliseconds
+ * have passed) and copies the first event in the queue to \a event.
+ *
+ * \param event we write the obtained event data here
+ * \param timeout_ms the maximum time to wait, \c 0 returns immediately and
+ *        a negative value waits until an event is available
+ *
+ * \returns 1 if an event was obtained, 0 if the timeout expired
+ */
+int DS_WaitEvent (DS_Event* event, const int timeout_ms)
+{
+    assert (event);
+
+    /* There are pending events */
+    if (DS_PollEvent (event))
+        return 1;
+
+    /* The caller does not want to wait */
+    if (timeout_ms == 0)
+        return 0;
+
+    /* Wait for an event */
+    int result = 0;
+    uint64_t deadline = DS_GetMonotonicTime() + (uint64_t) timeout_ms * 1000000ULL;
+    pthread_mutex_lock (&events_lock);
+
+    /* Register as a waiter before checking the queue again */
+    DS_AtomicAdd (&waiters, 1);
+    DS_AtomicFence();
+    while (! (result = DS_PollEvent (event))) {
+        if (timeout_ms < 0)
+            pthread_cond_wait (&events_cond, &events_lock);
+
+        else if (DS_CondWaitUntil (&events_cond, &events_lock, deadline) == ETIMEDOUT) {
+            result = DS_PollEvent (event);
+            break;
+        }
+    }
+    DS_AtomicAdd (&waiters, (uint32_t) -1);
+    pthread_mutex_unlock (&events_lock);
+
+    return result;
+}
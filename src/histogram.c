@@ -0,0 +1,154 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Histogram.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define SUB_BITS 7 /* log2 (DS_HISTOGRAM_SUB_BUCKETS) */
+
+/**
+ * Returns the index of the most significant bit set in \a value
+ */
+static int highest_bit (uint64_t value)
+{
+    int bit = 0;
+    while (value >>= 1)
+        ++bit;
+
+    return bit;
+}
+
+/**
+ * Returns the bucket in which the given \a value is stored
+ */
+static int bucket_index (const uint64_t value)
+{
+    if (value < DS_HISTOGRAM_SUB_BUCKETS)
+        return (int) value;
+
+    int exponent = highest_bit (value);
+    int sub = (int) (value >> (exponent - SUB_BITS)) & (DS_HISTOGRAM_SUB_BUCKETS - 1);
+    int index = (exponent - SUB_BITS + 1) * DS_HISTOGRAM_SUB_BUCKETS + sub;
+
+    if (index >= DS_HISTOGRAM_BUCKETS)
+        return DS_HISTOGRAM_BUCKETS - 1;
+
+    return index;
+}
+
+/**
+ * Returns the largest value that is stored in the given bucket \a index
+ */
+static uint64_t bucket_limit (const int index)
+{
+    if (index < DS_HISTOGRAM_SUB_BUCKETS)
+        return (uint64_t) index;
+
+    int shift = index / DS_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t) (index % DS_HISTOGRAM_SUB_BUCKETS);
+    return ((DS_HISTOGRAM_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/**
+ * Removes every recorded value from the given \a histogram
+ */
+void DS_HistogramReset (DS_Histogram* histogram)
+{
+    assert (histogram);
+    memset (histogram, 0, sizeof (DS_Histogram));
+}
+
+/**
+ * Records the given \a value in the given \a histogram
+ */
+void DS_HistogramAdd (DS_Histogram* histogram, const uint64_t value)
+{
+    assert (histogram);
+
+    if (histogram->count == 0 || value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+
+    histogram->sum += value;
+    histogram->count += 1;
+    histogram->buckets [bucket_index (value)] += 1;
+}
+
+/**
+ * Returns the smallest value that is greater or equal than the given
+ * \a percentile (from 0 to 100) of the recorded values. The returned value
+ * is the upper limit of its bucket, clamped to the recorded min/max values.
+ */
+uint64_t DS_HistogramPercentile (const DS_Histogram* histogram,
+                                 const double percentile)
+{
+    assert (histogram);
+
+    if (histogram->count == 0)
+        return 0;
+
+    /* Get the rank of the requested value */
+    uint64_t rank = (uint64_t) (percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > histogram->count)
+        rank = histogram->count;
+
+    /* Find the bucket that contains the value */
+    int i;
+    uint64_t seen = 0;
+    for (i = 0; i < DS_HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets [i];
+        if (seen >= rank)
+            break;
+    }
+
+    /* Clamp the value to the recorded range */
+    uint64_t value = bucket_limit (i);
+    if (value < histogram->min)
+        return histogram->min;
+    if (value > histogram->max)
+        return histogram->max;
+
+    return value;
+}
+
+/**
+ * Fills the given \a summary with the count, min, median, 99th percentile
+ * and max values of the given \a histogram
+ */
+void DS_HistogramSummarize (const DS_Histogram* histogram,
+                            DS_HistogramSummary* summary)
+{
+    assert (histogram);
+    assert (summary);
+
+    summary->count = histogram->count;
+    summary->min = histogram->min;
+    summary->max = histogram->max;
+    summary->p50 = DS_HistogramPercentile (histogram, 50);
+    summary->p99 = DS_HistogramPercentile (histogram, 99);
+}
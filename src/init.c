@@ -56,9 +56,11 @@ void DS_Close (void)
     if (DS_Initialized()) {
         init = 0;
 
+        Shm_Close();
+        Recorder_Close();
+        Protocols_Close();
         Timers_Close();
         Sockets_Close();
-        Protocols_Close();
         Joysticks_Close();
 
         Events_Close();
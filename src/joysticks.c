@@ -21,29 +21,59 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-#include "DS_Array.h"
+#include "DS_Utils.h"
+#include "DS_Timer.h"
+#include "DS_Atomic.h"
 #include "DS_Config.h"
 #include "DS_Events.h"
+#include "DS_Recorder.h"
 #include "DS_Joysticks.h"
 
 #include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
 
-/**
- * Represents a joystick and its information
+/*
+ * Triple buffer indexes, the fresh bit is set when the middle buffer holds
+ * a frame that has not been acquired by the reader yet
  */
-typedef struct _joystick {
-    int* hats;       /**< An array with the hat angles */
-    float* axes;    /**< An array with the axis values */
-    int* buttons;    /**< An array with the button states */
-    int num_axes;    /**< The number of axes of the joystick */
-    int num_hats;    /**< The number of hats of the joystick */
-    int num_buttons; /**< The number of buttons of the joystick */
-} DS_Joystick;
+#define FRESH_BIT  0x04
+#define INDEX_MASK 0x03
+
+/*
+ * The joystick values are written to the staging frame (under the joysticks
+ * lock) by the application threads, and every change is published to the
+ * sender through a triple buffer:
+ *     - The writer copies the staging frame to the back buffer and swaps
+ *       it with the middle buffer
+ *     - The reader swaps its front buffer with the middle buffer (only if
+ *       the middle buffer is fresh) and reads the front buffer
+ *
+ * The reader never waits for the writers and always sees a complete frame.
+ */
+static DS_JoystickFrame staging;
+static DS_JoystickFrame buffers [3];
+static uint32_t back = 2;
+static uint32_t front = 0;
+static volatile uint32_t middle = 1;
+static pthread_mutex_t joysticks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Input-to-wire latency of each joystick, the sender thread records the time
+ * between the newest input carried by a robot packet and the sending of the
+ * packet (the latency lock protects the histograms from the stats readers)
+ */
+static int frame_acquired = 0;
+static uint64_t traced_input [DS_MAX_JOYSTICKS];
+static DS_Histogram input_latency [DS_MAX_JOYSTICKS];
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * Holds all the joysticks
+ * Source of joystick generations, shared by all the joysticks so that a
+ * joystick that replaces another one never has the same generation
  */
-static DS_Array array;
+static volatile uint32_t generations = 0;
 
 /**
  * Registers a joystick event to the LibDS event system
@@ -57,51 +87,147 @@ static void register_event()
 }
 
 /**
- * Returns the joystick structure at the given index
- * If the joystick does not exist, this function shall return \c NULL
+ * Returns \c true if the given \a joystick exists and is valid
+ *
+ * \note The caller must hold the joysticks lock
  */
-static DS_Joystick* get_joystick (int joystick)
+static int joystick_exists (int joystick)
 {
-    if ((int) array.used > joystick)
-        return (DS_Joystick*) array.data [joystick];
+    return joystick >= 0 && joystick < staging.count;
+}
 
-    return NULL;
+/**
+ * Assigns a new generation to the given \a joystick after it has been
+ * registered or after one of its values has changed
+ *
+ * \note The caller must hold the joysticks lock
+ */
+static void touch_joystick (int joystick)
+{
+    staging.generation [joystick] = DS_AtomicAdd (&generations, 1);
 }
 
 /**
- * Returns \c true if the given \a joystick exists and is valid
+ * Assigns a new generation to the given \a joystick after an input changed
+ * one of its values, and timestamps the input for the latency statistics.
+ * Registering a joystick is not an input, so it is not timestamped.
+ *
+ * \note The caller must hold the joysticks lock
  */
-static int joystick_exists (int joystick)
+static void input_changed (int joystick)
 {
-    if (DS_GetJoystickCount() > joystick)
-        return get_joystick (joystick) != NULL;
+    touch_joystick (joystick);
+    staging.input_time [joystick] = DS_GetMonotonicTime();
+}
 
-    return 0;
+/**
+ * Copies the staging frame to the back buffer and swaps it with the middle
+ * buffer, so that the reader gets the new frame the next time that it
+ * acquires a frame
+ *
+ * \note The caller must hold the joysticks lock
+ */
+static void publish_frame (void)
+{
+    memcpy (&buffers [back], &staging, sizeof (DS_JoystickFrame));
+    back = DS_AtomicExchange (&middle, back | FRESH_BIT) & INDEX_MASK;
 }
 
 /**
- * Initializes the joystick array, with an initial support for 6 joysticks
+ * Removes all the joysticks from the staging frame and publishes it
+ *
+ * \note The caller must hold the joysticks lock
+ */
+static void clear_joysticks (void)
+{
+    memset (&staging, 0, sizeof (DS_JoystickFrame));
+    publish_frame();
+}
+
+/**
+ * Initializes the joystick frames and the latency statistics
  */
 void Joysticks_Init (void)
 {
-    DS_ArrayInit (&array, 6);
+    pthread_mutex_lock (&joysticks_lock);
+    clear_joysticks();
+    pthread_mutex_unlock (&joysticks_lock);
+
+    DS_ResetJoystickLatencyStats();
 }
 
 /**
- * De-allocates the joystick array data
+ * Removes all the joysticks
  */
 void Joysticks_Close (void)
 {
-    DS_ArrayFree (&array);
+    pthread_mutex_lock (&joysticks_lock);
+    clear_joysticks();
+    pthread_mutex_unlock (&joysticks_lock);
+
     register_event();
 }
 
+/**
+ * Returns the latest published joystick frame. The frame remains valid
+ * (and is not modified) until this function is called again.
+ *
+ * Unlike the other joystick functions, the frame values are not neutralized
+ * when the robot is disabled, this must be done by the caller.
+ *
+ * \note This function must only be called by a single thread (the protocol
+ *       sender thread)
+ */
+const DS_JoystickFrame* DS_JoysticksAcquireFrame (void)
+{
+    if (DS_AtomicLoad (&middle) & FRESH_BIT)
+        front = DS_AtomicExchange (&middle, front) & INDEX_MASK;
+
+    frame_acquired = 1;
+    return &buffers [front];
+}
+
+/**
+ * Registers that a robot packet was sent at the given \a time, and records
+ * the input-to-wire latency of every joystick that has new inputs in the
+ * frame that was acquired for the packet.
+ *
+ * \note This function must only be called by the thread that acquires the
+ *       joystick frames, after the packet is sent
+ */
+void Joysticks_PacketSent (const uint64_t time)
+{
+    int i;
+
+    /* The packet does not contain joystick data */
+    if (!frame_acquired)
+        return;
+
+    /* Record the latency of the new inputs */
+    const DS_JoystickFrame* frame = &buffers [front];
+    pthread_mutex_lock (&latency_lock);
+    for (i = 0; i < frame->count; ++i) {
+        uint64_t input = frame->input_time [i];
+        if (input > traced_input [i] && time >= input) {
+            DS_HistogramAdd (&input_latency [i], time - input);
+            traced_input [i] = input;
+        }
+    }
+    pthread_mutex_unlock (&latency_lock);
+
+    frame_acquired = 0;
+}
+
 /**
  * Returns the number of joysticks registered with the LibDS
  */
 int DS_GetJoystickCount (void)
 {
-    return (int) array.used;
+    pthread_mutex_lock (&joysticks_lock);
+    int count = staging.count;
+    pthread_mutex_unlock (&joysticks_lock);
+
+    return count;
 }
 
 /**
@@ -110,10 +236,14 @@ int DS_GetJoystickCount (void)
  */
 int DS_GetJoystickNumHats (int joystick)
 {
+    int hats = 0;
+
+    pthread_mutex_lock (&joysticks_lock);
     if (joystick_exists (joystick))
-        return get_joystick (joystick)->num_hats;
+        hats = staging.num_hats [joystick];
+    pthread_mutex_unlock (&joysticks_lock);
 
-    return 0;
+    return hats;
 }
 
 /**
@@ -122,10 +252,14 @@ int DS_GetJoystickNumHats (int joystick)
  */
 int DS_GetJoystickNumAxes (int joystick)
 {
+    int axes = 0;
+
+    pthread_mutex_lock (&joysticks_lock);
     if (joystick_exists (joystick))
-        return get_joystick (joystick)->num_axes;
+        axes = staging.num_axes [joystick];
+    pthread_mutex_unlock (&joysticks_lock);
 
-    return 0;
+    return axes;
 }
 
 /**
@@ -134,10 +268,14 @@ int DS_GetJoystickNumAxes (int joystick)
  */
 int DS_GetJoystickNumButtons (int joystick)
 {
+    int buttons = 0;
+
+    pthread_mutex_lock (&joysticks_lock);
     if (joystick_exists (joystick))
-        return get_joystick (joystick)->num_buttons;
+        buttons = staging.num_buttons [joystick];
+    pthread_mutex_unlock (&joysticks_lock);
 
-    return 0;
+    return buttons;
 }
 
 /**
@@ -150,14 +288,17 @@ int DS_GetJoystickNumButtons (int joystick)
  */
 int DS_GetJoystickHat (int joystick, int hat)
 {
-    if (CFG_GetRobotEnabled() && joystick_exists (joystick)) {
-        DS_Joystick* stick = get_joystick (joystick);
-
-        if (stick->num_hats > hat)
-            return stick->hats [hat];
+    int angle = 0;
+
+    if (CFG_GetRobotEnabled()) {
+        pthread_mutex_lock (&joysticks_lock);
+        if (joystick_exists (joystick) && hat >= 0 &&
+            hat < staging.num_hats [joystick])
+            angle = staging.hats [joystick][hat];
+        pthread_mutex_unlock (&joysticks_lock);
     }
 
-    return 0;
+    return angle;
 }
 
 /**
@@ -170,14 +311,17 @@ int DS_GetJoystickHat (int joystick, int hat)
  */
 float DS_GetJoystickAxis (int joystick, int axis)
 {
-    if (CFG_GetRobotEnabled() && joystick_exists (joystick)) {
-        DS_Joystick* stick = get_joystick (joystick);
-
-        if (stick->num_axes > axis)
-            return stick->axes [axis];
+    float value = 0;
+
+    if (CFG_GetRobotEnabled()) {
+        pthread_mutex_lock (&joysticks_lock);
+        if (joystick_exists (joystick) && axis >= 0 &&
+            axis < staging.num_axes [joystick])
+            value = staging.axes [joystick][axis];
+        pthread_mutex_unlock (&joysticks_lock);
     }
 
-    return 0;
+    return value;
 }
 
 /**
@@ -190,14 +334,92 @@ float DS_GetJoystickAxis (int joystick, int axis)
  */
 int DS_GetJoystickButton (int joystick, int button)
 {
-    if (CFG_GetRobotEnabled() && joystick_exists (joystick)) {
-        DS_Joystick* stick = get_joystick (joystick);
+    int pressed = 0;
+
+    if (CFG_GetRobotEnabled()) {
+        pthread_mutex_lock (&joysticks_lock);
+        if (joystick_exists (joystick) && button >= 0 &&
+            button < staging.num_buttons [joystick])
+            pressed = (staging.buttons [joystick] >> button) & 1;
+        pthread_mutex_unlock (&joysticks_lock);
+    }
+
+    return pressed;
+}
+
+/**
+ * Returns the state of the buttons of the given \a joystick as a bitmask
+ * (bit \c n is set if button \c n is pressed). If the joystick does not
+ * exist or the robot is disabled, this function will return \c 0
+ */
+uint32_t DS_GetJoystickButtons (int joystick)
+{
+    uint32_t buttons = 0;
+
+    if (CFG_GetRobotEnabled()) {
+        pthread_mutex_lock (&joysticks_lock);
+        if (joystick_exists (joystick))
+            buttons = staging.buttons [joystick];
+        pthread_mutex_unlock (&joysticks_lock);
+    }
+
+    return buttons;
+}
+
+/**
+ * Returns the generation of the given \a joystick, which changes every time
+ * that one of its values changes (or when the joystick is replaced). This
+ * allows protocols to reuse the encoded data of idle joysticks.
+ *
+ * If the joystick does not exist, this function will return \c 0
+ */
+uint32_t DS_GetJoystickGeneration (int joystick)
+{
+    uint32_t generation = 0;
+
+    pthread_mutex_lock (&joysticks_lock);
+    if (joystick_exists (joystick))
+        generation = staging.generation [joystick];
+    pthread_mutex_unlock (&joysticks_lock);
+
+    return generation;
+}
+
+/**
+ * Clears the input-to-wire latency statistics of every joystick
+ */
+void DS_ResetJoystickLatencyStats (void)
+{
+    int i;
+    pthread_mutex_lock (&latency_lock);
+    for (i = 0; i < DS_MAX_JOYSTICKS; ++i)
+        DS_HistogramReset (&input_latency [i]);
+    pthread_mutex_unlock (&latency_lock);
+}
+
+/**
+ * Obtains the statistics of the time (in nanoseconds) between an input of
+ * the given \a joystick (an axis, button or hat change) and the sending of
+ * the first robot packet that carried it. Only the newest input of each
+ * packet is sampled, inputs that were superseded before a packet was sent
+ * are not recorded.
+ *
+ * This measures the combined delay of the sender schedule, the packet
+ * generation and the socket send call.
+ */
+void DS_GetJoystickLatencyStats (int joystick, DS_HistogramSummary* stats)
+{
+    assert (stats);
 
-        if (stick->num_buttons > button)
-            return stick->buttons [button];
+    /* Joystick is out of range */
+    if (joystick < 0 || joystick >= DS_MAX_JOYSTICKS) {
+        memset (stats, 0, sizeof (DS_HistogramSummary));
+        return;
     }
 
-    return 0;
+    pthread_mutex_lock (&latency_lock);
+    DS_HistogramSummarize (&input_latency [joystick], stats);
+    pthread_mutex_unlock (&latency_lock);
 }
 
 /**
@@ -205,8 +427,10 @@ int DS_GetJoystickButton (int joystick, int button)
  */
 void DS_JoysticksReset (void)
 {
-    DS_ArrayFree (&array);
-    DS_ArrayInit (&array, 6);
+    pthread_mutex_lock (&joysticks_lock);
+    Recorder_Reset();
+    clear_joysticks();
+    pthread_mutex_unlock (&joysticks_lock);
 
     register_event();
 }
@@ -215,6 +439,11 @@ void DS_JoysticksReset (void)
  * Registers a new joystick with the given number of \a axes, \a hats and
  * \a buttons. All joystick values are set to a neutral state to ensure
  * safe operation of the robot.
+ *
+ * Up to \c DS_MAX_JOYSTICKS joysticks can be registered, the number of axes,
+ * hats and buttons is limited to \c DS_MAX_JOYSTICK_AXES,
+ * \c DS_MAX_JOYSTICK_HATS and \c DS_MAX_JOYSTICK_BUTTONS. The protocol may
+ * send fewer inputs than the joystick has.
  */
 void DS_JoysticksAdd (const int axes, const int hats, const int buttons)
 {
@@ -224,21 +453,30 @@ void DS_JoysticksAdd (const int axes, const int hats, const int buttons)
         return;
     }
 
-    /* Allocate memory for a new joystick */
-    DS_Joystick* joystick = (DS_Joystick*) calloc (1, sizeof (DS_Joystick));
+    pthread_mutex_lock (&joysticks_lock);
+    Recorder_Add (axes, hats, buttons);
 
-    /* Set joystick properties */
-    joystick->num_axes = axes;
-    joystick->num_hats = hats;
-    joystick->num_buttons = buttons;
+    /* There is no space for the joystick */
+    if (staging.count >= DS_MAX_JOYSTICKS) {
+        pthread_mutex_unlock (&joysticks_lock);
+        fprintf (stderr, "DS_JoystickAdd: Cannot register more than %d "
+                 "joysticks!\n", DS_MAX_JOYSTICKS);
+        return;
+    }
+
+    /* Set joystick properties (values are already neutral) */
+    int joystick = staging.count;
+    staging.num_axes [joystick] = DS_Max (DS_Min (axes, DS_MAX_JOYSTICK_AXES), 0);
+    staging.num_hats [joystick] = DS_Max (DS_Min (hats, DS_MAX_JOYSTICK_HATS), 0);
+    staging.num_buttons [joystick] = DS_Max (DS_Min (buttons,
+                                                     DS_MAX_JOYSTICK_BUTTONS), 0);
 
-    /* Set joystick value arrays */
-    joystick->hats = calloc (hats, sizeof (int));
-    joystick->axes = calloc (axes, sizeof (float));
-    joystick->buttons = calloc (buttons, sizeof (int));
+    /* Register the joystick and publish the frame */
+    staging.count++;
+    touch_joystick (joystick);
+    publish_frame();
 
-    /* Register the new joystick in the joystick list */
-    DS_ArrayInsert (&array, (void*) joystick);
+    pthread_mutex_unlock (&joysticks_lock);
 
     /* Emit the joystick count changed event */
     register_event();
@@ -249,12 +487,16 @@ void DS_JoysticksAdd (const int axes, const int hats, const int buttons)
  */
 void DS_SetJoystickHat (int joystick, int hat, int angle)
 {
-    if (joystick_exists (joystick)) {
-        DS_Joystick* stick = get_joystick (joystick);
-
-        if (stick->num_hats > hat)
-            stick->hats [hat] = angle;
+    pthread_mutex_lock (&joysticks_lock);
+    Recorder_Hat (joystick, hat, angle);
+    if (joystick_exists (joystick) && hat >= 0 &&
+        hat < staging.num_hats [joystick] &&
+        staging.hats [joystick][hat] != angle) {
+        staging.hats [joystick][hat] = angle;
+        input_changed (joystick);
+        publish_frame();
     }
+    pthread_mutex_unlock (&joysticks_lock);
 }
 
 /**
@@ -262,12 +504,16 @@ void DS_SetJoystickHat (int joystick, int hat, int angle)
  */
 void DS_SetJoystickAxis (int joystick, int axis, float value)
 {
-    if (joystick_exists (joystick)) {
-        DS_Joystick* stick = get_joystick (joystick);
-
-        if (stick->num_axes > axis)
-            stick->axes [axis] = value;
+    pthread_mutex_lock (&joysticks_lock);
+    Recorder_Axis (joystick, axis, value);
+    if (joystick_exists (joystick) && axis >= 0 &&
+        axis < staging.num_axes [joystick] &&
+        staging.axes [joystick][axis] != value) {
+        staging.axes [joystick][axis] = value;
+        input_changed (joystick);
+        publish_frame();
     }
+    pthread_mutex_unlock (&joysticks_lock);
 }
 
 /**
@@ -275,10 +521,21 @@ void DS_SetJoystickAxis (int joystick, int axis, float value)
  */
 void DS_SetJoystickButton (int joystick, int button, int pressed)
 {
-    if (joystick_exists (joystick)) {
-        DS_Joystick* stick = get_joystick (joystick);
-
-        if (stick->num_buttons > button)
-            stick->buttons [button] = (pressed > 0) ? 1 : 0;
+    pthread_mutex_lock (&joysticks_lock);
+    Recorder_Button (joystick, button, pressed);
+    if (joystick_exists (joystick) && button >= 0 &&
+        button < staging.num_buttons [joystick]) {
+        uint32_t mask = staging.buttons [joystick];
+        if (pressed > 0)
+            mask |= (1u << button);
+        else
+            mask &= ~ (1u << button);
+
+        if (mask != staging.buttons [joystick]) {
+            staging.buttons [joystick] = mask;
+            input_changed (joystick);
+            publish_frame();
+        }
     }
+    pthread_mutex_unlock (&joysticks_lock);
 }
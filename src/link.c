@@ -0,0 +1,157 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Link.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * Clears the statistics and the pending packets of the given \a link
+ * (the caller must hold the lock of the link)
+ */
+static void clear_link (DS_Link* link)
+{
+    link->has_reply = 0;
+    link->last_index = 0;
+    link->last_reply = 0;
+    link->sent = 0;
+    link->received = 0;
+    link->lost = 0;
+    link->duplicated = 0;
+    link->reordered = 0;
+
+    DS_HistogramReset (&link->rtt);
+    DS_HistogramReset (&link->gap);
+    memset (link->window, 0, sizeof (link->window));
+}
+
+/**
+ * Initializes the lock and the statistics of the given \a link
+ */
+void DS_LinkInit (DS_Link* link)
+{
+    assert (link);
+
+    pthread_mutex_init (&link->lock, NULL);
+    clear_link (link);
+}
+
+/**
+ * Clears the statistics and the pending packets of the given \a link
+ */
+void DS_LinkReset (DS_Link* link)
+{
+    assert (link);
+
+    pthread_mutex_lock (&link->lock);
+    clear_link (link);
+    pthread_mutex_unlock (&link->lock);
+}
+
+/**
+ * Copies the statistics of the given \a link to the given \a stats
+ */
+void DS_LinkGetStats (DS_Link* link, DS_LinkStats* stats)
+{
+    assert (link);
+    assert (stats);
+
+    pthread_mutex_lock (&link->lock);
+    stats->sent = link->sent;
+    stats->received = link->received;
+    stats->lost = link->lost;
+    stats->duplicated = link->duplicated;
+    stats->reordered = link->reordered;
+    DS_HistogramSummarize (&link->rtt, &stats->rtt);
+    DS_HistogramSummarize (&link->gap, &stats->gap);
+    pthread_mutex_unlock (&link->lock);
+}
+
+/**
+ * Registers that the packet with the given \a index was sent at the given
+ * \a time. If the packet that used the same slot of the window is still
+ * waiting for its reply, then it is counted as lost.
+ */
+void DS_LinkSent (DS_Link* link, const uint16_t index, const uint64_t time)
+{
+    assert (link);
+
+    pthread_mutex_lock (&link->lock);
+    DS_LinkSlot* slot = &link->window [index % DS_LINK_WINDOW];
+    if (slot->pending)
+        ++link->lost;
+
+    slot->index = index;
+    slot->sent = time;
+    slot->pending = 1;
+    slot->echoed = 0;
+    ++link->sent;
+    pthread_mutex_unlock (&link->lock);
+}
+
+/**
+ * Registers that the reply to the packet with the given \a index was
+ * received at the given \a time. Replies to packets that are no longer in
+ * the window are ignored.
+ */
+void DS_LinkReceived (DS_Link* link, const uint16_t index, const uint64_t time)
+{
+    assert (link);
+
+    pthread_mutex_lock (&link->lock);
+    DS_LinkSlot* slot = &link->window [index % DS_LINK_WINDOW];
+
+    /* Packet is unknown (or too old) */
+    if (slot->index != index || (!slot->pending && !slot->echoed)) {
+        pthread_mutex_unlock (&link->lock);
+        return;
+    }
+
+    /* Reply was already received */
+    if (slot->echoed) {
+        ++link->duplicated;
+        pthread_mutex_unlock (&link->lock);
+        return;
+    }
+
+    /* Register the reply and its round-trip time */
+    slot->pending = 0;
+    slot->echoed = 1;
+    ++link->received;
+    DS_HistogramAdd (&link->rtt, time > slot->sent ? time - slot->sent : 0);
+
+    /* Register the time since the previous reply */
+    if (link->has_reply && time > link->last_reply)
+        DS_HistogramAdd (&link->gap, time - link->last_reply);
+
+    /* Check if the reply arrived after a newer reply (with wrap-around) */
+    if (link->has_reply && (int16_t) (index - link->last_index) < 0)
+        ++link->reordered;
+    else
+        link->last_index = index;
+
+    link->has_reply = 1;
+    link->last_reply = time;
+    pthread_mutex_unlock (&link->lock);
+}
@@ -0,0 +1,269 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Packet.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * Returns 1 if \a len more bytes fit in the buffer of the \a writer,
+ * otherwise, the overflow flag of the writer is raised
+ */
+static int writer_fits (DS_PacketWriter* writer, size_t len)
+{
+    if (writer->overflow || len > writer->capacity - writer->length) {
+        writer->overflow = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Returns 1 if \a len more bytes can be read from the packet, otherwise,
+ * the overflow flag of the \a reader is raised
+ */
+static int reader_fits (DS_PacketReader* reader, size_t len)
+{
+    if (reader->overflow || len > reader->length - reader->position) {
+        reader->overflow = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Initializes the given \a writer to write into the given \a buf
+ *
+ * \param writer the writer to initialize
+ * \param buf the buffer in which the packet will be written
+ * \param capacity the size of the buffer
+ */
+void DS_PacketWriterInit (DS_PacketWriter* writer, void* buf, size_t capacity)
+{
+    /* Check arguments */
+    assert (writer);
+    assert (buf || capacity == 0);
+
+    writer->buf = (uint8_t*) buf;
+    writer->capacity = capacity;
+    writer->length = 0;
+    writer->overflow = 0;
+}
+
+/**
+ * Appends the given byte to the packet
+ */
+void DS_PacketPutU8 (DS_PacketWriter* writer, const uint8_t value)
+{
+    assert (writer);
+
+    if (writer_fits (writer, 1))
+        writer->buf [writer->length++] = value;
+}
+
+/**
+ * Appends the given 16-bit \a value to the packet (big-endian)
+ */
+void DS_PacketPutU16BE (DS_PacketWriter* writer, const uint16_t value)
+{
+    assert (writer);
+
+    if (writer_fits (writer, 2)) {
+        writer->buf [writer->length++] = (uint8_t) (value >> 8);
+        writer->buf [writer->length++] = (uint8_t) (value);
+    }
+}
+
+/**
+ * Appends the given 32-bit \a value to the packet (big-endian)
+ */
+void DS_PacketPutU32BE (DS_PacketWriter* writer, const uint32_t value)
+{
+    assert (writer);
+
+    if (writer_fits (writer, 4)) {
+        writer->buf [writer->length++] = (uint8_t) (value >> 24);
+        writer->buf [writer->length++] = (uint8_t) (value >> 16);
+        writer->buf [writer->length++] = (uint8_t) (value >> 8);
+        writer->buf [writer->length++] = (uint8_t) (value);
+    }
+}
+
+/**
+ * Appends \a len bytes from the given buffer to the packet
+ */
+void DS_PacketPutBytes (DS_PacketWriter* writer, const void* bytes, size_t len)
+{
+    assert (writer);
+
+    if (len > 0 && bytes && writer_fits (writer, len)) {
+        memcpy (writer->buf + writer->length, bytes, len);
+        writer->length += len;
+    }
+}
+
+/**
+ * Appends zeros to the packet until it is \a length bytes long
+ */
+void DS_PacketPad (DS_PacketWriter* writer, size_t length)
+{
+    assert (writer);
+
+    if (length > writer->length && writer_fits (writer, length - writer->length)) {
+        memset (writer->buf + writer->length, 0, length - writer->length);
+        writer->length = length;
+    }
+}
+
+/**
+ * Overwrites four bytes that have already been written (at the given
+ * \a offset) with the given 32-bit \a value (big-endian). This is useful
+ * to add checksums once the packet is complete.
+ */
+void DS_PacketSetU32BE (DS_PacketWriter* writer, size_t offset, const uint32_t value)
+{
+    assert (writer);
+
+    if (offset > writer->length || writer->length - offset < 4) {
+        writer->overflow = 1;
+        return;
+    }
+
+    writer->buf [offset + 0] = (uint8_t) (value >> 24);
+    writer->buf [offset + 1] = (uint8_t) (value >> 16);
+    writer->buf [offset + 2] = (uint8_t) (value >> 8);
+    writer->buf [offset + 3] = (uint8_t) (value);
+}
+
+/**
+ * Initializes the given \a reader to read the given packet
+ *
+ * \param reader the reader to initialize
+ * \param buf the packet data
+ * \param len the length of the packet
+ */
+void DS_PacketReaderInit (DS_PacketReader* reader, const void* buf, size_t len)
+{
+    /* Check arguments */
+    assert (reader);
+
+    reader->buf = (const uint8_t*) buf;
+    reader->length = buf ? len : 0;
+    reader->position = 0;
+    reader->overflow = 0;
+}
+
+/**
+ * Reads the next byte of the packet
+ */
+uint8_t DS_PacketGetU8 (DS_PacketReader* reader)
+{
+    assert (reader);
+
+    if (!reader_fits (reader, 1))
+        return 0;
+
+    return reader->buf [reader->position++];
+}
+
+/**
+ * Reads the next 16-bit (big-endian) value of the packet
+ */
+uint16_t DS_PacketGetU16BE (DS_PacketReader* reader)
+{
+    assert (reader);
+
+    if (!reader_fits (reader, 2))
+        return 0;
+
+    const uint8_t* p = reader->buf + reader->position;
+    reader->position += 2;
+    return (uint16_t) ((p [0] << 8) | p [1]);
+}
+
+/**
+ * Reads the next 32-bit (big-endian) value of the packet
+ */
+uint32_t DS_PacketGetU32BE (DS_PacketReader* reader)
+{
+    assert (reader);
+
+    if (!reader_fits (reader, 4))
+        return 0;
+
+    const uint8_t* p = reader->buf + reader->position;
+    reader->position += 4;
+    return ((uint32_t) p [0] << 24) | ((uint32_t) p [1] << 16) |
+           ((uint32_t) p [2] << 8) | (uint32_t) p [3];
+}
+
+/**
+ * Copies the next \a len bytes of the packet into \a bytes
+ */
+void DS_PacketGetBytes (DS_PacketReader* reader, void* bytes, size_t len)
+{
+    assert (reader);
+
+    if (!reader_fits (reader, len)) {
+        if (bytes)
+            memset (bytes, 0, len);
+
+        return;
+    }
+
+    if (bytes)
+        memcpy (bytes, reader->buf + reader->position, len);
+
+    reader->position += len;
+}
+
+/**
+ * Skips the next \a len bytes of the packet
+ */
+void DS_PacketSkip (DS_PacketReader* reader, size_t len)
+{
+    assert (reader);
+
+    if (reader_fits (reader, len))
+        reader->position += len;
+}
+
+/**
+ * Returns the byte at the given \a offset of the packet, without changing
+ * the read position. Returns 0 (and raises the overflow flag) if the
+ * \a offset is outside the packet.
+ */
+uint8_t DS_PacketPeekU8 (DS_PacketReader* reader, size_t offset)
+{
+    assert (reader);
+
+    if (offset >= reader->length) {
+        reader->overflow = 1;
+        return 0;
+    }
+
+    return reader->buf [offset];
+}
@@ -26,6 +26,7 @@
 #include "DS_Client.h"
 #include "DS_Config.h"
 #include "DS_Events.h"
+#include "DS_Joysticks.h"
 #include "DS_Socket.h"
 #include "DS_Protocol.h"
 
@@ -35,8 +36,25 @@
 #include <string.h>
 #include <pthread.h>
 
-#define SEND_PRECISION 1  /* Update the sender timers every millisecond */
 #define RECV_PRECISION 50 /* Update the watchdogs every 50 milliseconds */
+#define POLL_INTERVAL 5   /* Read received data every 5 milliseconds */
+#define MAX_SEND_SLEEP 50 /* Check for protocol changes every 50 milliseconds */
+#define URGENT_INTERVAL 2 /* Minimum time (ms) between out-of-band robot packets */
+
+/*
+ * Timer events, set by the timer callbacks and handled by the event loop
+ */
+#define WATCHDOG_FMS    0x01
+#define WATCHDOG_RADIO  0x02
+#define WATCHDOG_ROBOT  0x04
+
+/*
+ * Sender channels
+ */
+#define FMS_CHANNEL   0
+#define RADIO_CHANNEL 1
+#define ROBOT_CHANNEL 2
+#define NUM_CHANNELS  3
 
 /*
  * Used to re-assing to 'empty' structure
@@ -50,11 +68,36 @@ static DS_Protocol protocol;
 static int enable_operations = 0;
 
 /*
- * Define the sender watchdogs (when one expires, we send a packet)
+ * Represents a periodic packet sender, the sender thread sleeps until the
+ * earliest deadline and sends the packets of every channel that is due
  */
-static DS_Timer fms_send_timer;
-static DS_Timer radio_send_timer;
-static DS_Timer robot_send_timer;
+typedef struct {
+    int interval;          /* Send interval (in milliseconds, 0 disables it) */
+    uint64_t deadline;     /* Monotonic time at which the next packet is due */
+    uint64_t last_send;    /* Monotonic time at which the last packet was sent */
+    DS_Histogram jitter;   /* Intervals between consecutive packets */
+    DS_Socket* socket;     /* Socket that receives the packets */
+    unsigned long* bytes;  /* Sent bytes counter */
+    int* packets;          /* Sent packets counter */
+    void (*create_packet) (DS_PacketWriter*); /* Generates a packet */
+} SendChannel;
+
+/*
+ * Sender channels and thread, the sender lock protects the channels and
+ * prevents the protocol from changing while a packet is being sent
+ */
+static pthread_t sender_thread;
+static pthread_cond_t sender_cond;
+static SendChannel channels [NUM_CHANNELS];
+static pthread_mutex_t sender_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Out-of-band robot packets, requested on safety-critical state changes and
+ * sent outside of the regular schedule of the robot channel
+ */
+static uint64_t urgent_request = 0;
+static uint64_t urgent_last_send = 0;
+static DS_Histogram urgent_latency;
 
 /*
  * Define the receiver watchdogs (when one expires, comms are lost)
@@ -68,6 +111,21 @@ static DS_Timer robot_recv_timer;
  */
 static int running = 0;
 
+/*
+ * Pending timer events, the event loop sleeps until a timer expires
+ */
+static int pending_events = 0;
+static pthread_cond_t events_cond;
+static pthread_mutex_t events_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The receiver lock is held by the event loop while it reads the protocol
+ * sockets and by the functions that close or replace the protocol, so that
+ * a socket is never read while it is being closed (lock order: receiver
+ * lock, then sender lock)
+ */
+static pthread_mutex_t receiver_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Protocol read success booleans (used to feed the watchdogs)
  */
@@ -75,14 +133,6 @@ static int fms_read = 0;
 static int radio_read = 0;
 static int robot_read = 0;
 
-/*
- * Holds the received data
- */
-static DS_String fms_data;
-static DS_String radio_data;
-static DS_String robot_data;
-static DS_String netcs_data;
-
 /*
  * Holds the sent/received packets
  */
@@ -103,91 +153,295 @@ static unsigned long recv_radio_bytes = 0;
 static unsigned long sent_robot_bytes = 0;
 static unsigned long recv_robot_bytes = 0;
 
+/*
+ * Robot link quality (the robot echoes the index of each packet) and the
+ * receive time of the datagram that is being read
+ */
+static DS_Link robot_link;
+static uint64_t datagram_timestamp = 0;
+
 /*
  * The thread ID for the protocol event loop
  */
 static pthread_t event_thread;
 
 /**
- * Sends a new packet to the FMS, the generated data is immediatly deleted
- * once the packet has been sent
+ * Called by the timer scheduler when one of the protocol timers expires,
+ * registers the timer event and wakes up the event loop
  */
-static void send_fms_data()
+static void on_timer_expired (DS_Timer* timer)
 {
-    if (enable_operations) {
-        ++sent_fms_packets;
-        DS_String data = protocol.create_fms_packet();
-        sent_fms_bytes += DS_Max (DS_SocketSend (&protocol.fms_socket, &data), 0);
-        DS_StrRmBuf (&data);
+    pthread_mutex_lock (&events_lock);
+    pending_events |= (int) (intptr_t) timer->data;
+    pthread_cond_signal (&events_cond);
+    pthread_mutex_unlock (&events_lock);
+}
+
+/**
+ * Waits until a timer expires or the poll interval elapses
+ *
+ * \returns the timer events that happened since the last call
+ */
+static int wait_events (void)
+{
+    uint64_t deadline = DS_GetMonotonicTime() + POLL_INTERVAL * 1000000ULL;
+
+    pthread_mutex_lock (&events_lock);
+    while (running && !pending_events) {
+        if (DS_CondWaitUntil (&events_cond, &events_lock, deadline) != 0)
+            break;
     }
+
+    int events = pending_events;
+    pending_events = 0;
+    pthread_mutex_unlock (&events_lock);
+
+    return events;
 }
 
 /**
- * Sends a new packet to the radio, the generated data is immediatly deleted
- * once the packet has been sent
+ * Initializes the given watchdog \a timer and registers the \a event that
+ * is generated when it expires
  */
-static void send_radio_data()
+static void init_timer (DS_Timer* timer, const int precision, const int event)
 {
-    if (enable_operations) {
-        ++sent_radio_packets;
-        DS_String data = protocol.create_radio_packet();
-        sent_radio_bytes += DS_Max (DS_SocketSend (&protocol.radio_socket, &data), 0);
-        DS_StrRmBuf (&data);
+    DS_TimerInit (timer, 0, precision);
+    DS_TimerSetCallback (timer, &on_timer_expired, (void*) (intptr_t) event);
+}
+
+/**
+ * Generates a packet of the given \a channel (directly in the given
+ * \a buffer, without allocating memory) and describes it in \a datagram.
+ *
+ * \returns 1 if the packet can be sent, 0 if it is empty or does not fit
+ *          in the buffer
+ */
+static int create_packet (SendChannel* channel, char* buffer,
+                          DS_OutDatagram* datagram)
+{
+    /* Initialize the packet writer */
+    DS_PacketWriter writer;
+    DS_PacketWriterInit (&writer, buffer, DS_MAX_PACKET_SIZE);
+
+    /* Generate the packet */
+    *channel->packets += 1;
+    channel->create_packet (&writer);
+
+    /* Describe the datagram */
+    datagram->data = buffer;
+    datagram->length = (int) writer.length;
+    datagram->sent = -1;
+    datagram->destination = channel->socket;
+
+    return !writer.overflow && writer.length > 0;
+}
+
+/**
+ * Sends the given \a datagrams (generated by the channels listed in
+ * \a owners) with a single batch, updates the sent bytes counters and
+ * records the input-to-wire latency of the joystick data sent to the robot
+ */
+static void send_packets (DS_OutDatagram* datagrams, const int* owners,
+                          const int count)
+{
+    int i;
+    DS_Socket* sender = NULL;
+
+    /* Use the first UDP socket that can send data for the whole batch */
+    for (i = 0; i < count && !sender; ++i) {
+        DS_Socket* socket = datagrams [i].destination;
+        if (!socket->disabled && socket->info.client_init &&
+            socket->type == DS_SOCKET_UDP)
+            sender = socket;
+    }
+
+    /* Send the datagrams */
+    if (sender)
+        DS_SocketSendBatch (sender, datagrams, count);
+
+    else {
+        for (i = 0; i < count; ++i)
+            datagrams [i].sent = DS_SocketSendBytes (datagrams [i].destination,
+                                                     datagrams [i].data,
+                                                     datagrams [i].length);
+    }
+
+    /* Update the sent bytes counters */
+    uint64_t now = DS_GetMonotonicTime();
+    for (i = 0; i < count; ++i) {
+        if (datagrams [i].sent <= 0)
+            continue;
+
+        *channels [owners [i]].bytes += datagrams [i].sent;
+        if (owners [i] == ROBOT_CHANNEL)
+            Joysticks_PacketSent (now);
     }
 }
 
 /**
- * Sends a new packet to the robot, the generated data is immediatly deleted
- * once the packet has been sent
+ * Sends a new packet to the robot outside of its regular schedule
  */
 static void send_robot_data()
 {
+    int owner = ROBOT_CHANNEL;
+    DS_OutDatagram datagram;
+    char buffer [DS_MAX_PACKET_SIZE];
+
     if (enable_operations) {
-        ++sent_robot_packets;
-        DS_String data = protocol.create_robot_packet();
-        sent_robot_bytes += DS_Max (DS_SocketSend (&protocol.robot_socket, &data), 0);
-        DS_StrRmBuf (&data);
+        if (create_packet (&channels [ROBOT_CHANNEL], buffer, &datagram))
+            send_packets (&datagram, &owner, 1);
     }
 }
 
 /**
- * Sends data over the network using the functions of the current protocol.
- * If there is no protocol running, then this function will do nothing.
+ * Sends the packets of every channel whose deadline has passed (with a
+ * single batch), records the interval between consecutive packets and
+ * schedules the next deadline of each channel (relative to the previous
+ * deadline, so that the send rate does not drift).
+ *
+ * \returns the earliest deadline of the enabled channels
  */
-static void send_data()
+static uint64_t send_data (const uint64_t now)
 {
-    /* Protocol is NULL, abort */
-    if (!enable_operations)
-        return;
-
-    /* Send FMS packet */
-    if (fms_send_timer.expired) {
-        send_fms_data();
-        DS_TimerReset (&fms_send_timer);
+    int i;
+    int count = 0;
+    int owners [NUM_CHANNELS];
+    DS_OutDatagram datagrams [NUM_CHANNELS];
+    char buffers [NUM_CHANNELS][DS_MAX_PACKET_SIZE];
+    uint64_t next = now + MAX_SEND_SLEEP * 1000000ULL;
+
+    for (i = 0; i < NUM_CHANNELS; ++i) {
+        SendChannel* channel = &channels [i];
+        if (channel->interval <= 0)
+            continue;
+
+        /* Generate the packet and record the interval */
+        if (channel->deadline <= now) {
+            uint64_t period = (uint64_t) channel->interval * 1000000ULL;
+            uint64_t sent = DS_GetMonotonicTime();
+
+            if (create_packet (channel, buffers [count], &datagrams [count]))
+                owners [count++] = i;
+
+            if (channel->last_send > 0)
+                DS_HistogramAdd (&channel->jitter, sent - channel->last_send);
+
+            /* Schedule next packet (skip missed deadlines) */
+            channel->last_send = sent;
+            channel->deadline += period;
+            if (channel->deadline <= now)
+                channel->deadline = now + period;
+        }
+
+        if (channel->deadline < next)
+            next = channel->deadline;
     }
 
-    /* Send radio packet */
-    if (radio_send_timer.expired) {
-        send_radio_data();
-        DS_TimerReset (&radio_send_timer);
-    }
+    /* Send the due packets together */
+    send_packets (datagrams, owners, count);
+
+    return next;
+}
 
-    /* Send robot packet */
-    if (robot_send_timer.expired) {
-        send_robot_data();
-        DS_TimerReset (&robot_send_timer);
+/**
+ * Sends the requested out-of-band robot packet, unless another out-of-band
+ * packet was sent less than \c URGENT_INTERVAL milliseconds ago. The regular
+ * schedule of the robot channel is not modified.
+ *
+ * \returns the time at which the deferred packet can be sent, or the given
+ *          \a next deadline if there is no pending packet
+ */
+static uint64_t send_urgent_data (const uint64_t now, const uint64_t next)
+{
+    /* No packet requested */
+    if (urgent_request == 0)
+        return next;
+
+    /* Rate-limit the out-of-band packets */
+    uint64_t allowed = urgent_last_send + URGENT_INTERVAL * 1000000ULL;
+    if (urgent_last_send > 0 && allowed > now)
+        return DS_Min (allowed, next);
+
+    /* Send the packet and record the request-to-send latency */
+    send_robot_data();
+    urgent_last_send = DS_GetMonotonicTime();
+    DS_HistogramAdd (&urgent_latency, urgent_last_send - urgent_request);
+    urgent_request = 0;
+
+    return next;
+}
+
+/**
+ * Sends the FMS, radio and robot packets as soon as their deadlines pass.
+ * The thread waits with absolute monotonic deadlines, so the time spent
+ * generating and sending packets does not delay the next packets. The wait
+ * is interrupted when an out-of-band robot packet is requested.
+ */
+static void* run_sender (void* ptr)
+{
+    (void) ptr;
+
+    pthread_mutex_lock (&sender_lock);
+    while (running) {
+        /* Wait for a protocol to be loaded */
+        if (!enable_operations) {
+            pthread_cond_wait (&sender_cond, &sender_lock);
+            continue;
+        }
+
+        /* Send out-of-band and due packets */
+        uint64_t now = DS_GetMonotonicTime();
+        uint64_t next = send_urgent_data (now, send_data (now));
+
+        /* Wait until the next deadline (or an out-of-band request) */
+        DS_CondWaitUntil (&sender_cond, &sender_lock, next);
     }
+    pthread_mutex_unlock (&sender_lock);
+
+    return NULL;
 }
 
 /**
- * Clears the strings that hold the incoming data packets
+ * Reads every datagram received by the given \a socket (in the order in
+ * which they arrived) with the given \a read_packet function and updates
+ * the communication status and the received bytes/packets counters.
+ *
+ * The datagrams are lent to \a read_packet directly from the receive ring
+ * of the socket, without copying them.
+ *
+ * \returns 1 if at least one datagram was read successfully, 0 otherwise
  */
-static void clear_recv_data()
+static int drain_socket (DS_Socket* socket,
+                         int (*read_packet) (const DS_String*),
+                         void (*set_communications) (const int),
+                         unsigned long* bytes, int* packets)
 {
-    DS_StrRmBuf (&fms_data);
-    DS_StrRmBuf (&radio_data);
-    DS_StrRmBuf (&robot_data);
-    DS_StrRmBuf (&netcs_data);
+    int read = 0;
+    int success = 0;
+
+    const DS_Datagram* datagram;
+    while ((datagram = DS_SocketPeek (socket)) != NULL) {
+        DS_String data;
+        data.buf = (char*) datagram->data;
+        data.len = datagram->length;
+        data.cap = 0;
+
+        *bytes += datagram->length;
+        *packets += 1;
+
+        datagram_timestamp = datagram->timestamp;
+        DS_SetEventOrigin (datagram->timestamp);
+        CFG_BeginStateUpdate();
+        read = read_packet (&data);
+        DS_SocketRelease (socket);
+
+        set_communications (read);
+        CFG_EndStateUpdate();
+        DS_SetEventOrigin (0);
+        success |= read;
+    }
+
+    return success;
 }
 
 /**
@@ -200,86 +454,75 @@ static void recv_data()
     if (!enable_operations)
         return;
 
-    /* Clear buffers (just to be sure) */
-    clear_recv_data();
-
-    /* Read data from sockets */
-    fms_data = DS_SocketRead (&protocol.fms_socket);
-    radio_data = DS_SocketRead (&protocol.radio_socket);
-    robot_data = DS_SocketRead (&protocol.robot_socket);
-    netcs_data = DS_SocketRead (&protocol.netconsole_socket);
-
-    /* Update received data indicators */
-    recv_fms_bytes += DS_StrLen (&fms_data);
-    recv_radio_bytes += DS_StrLen (&radio_data);
-    recv_robot_bytes += DS_StrLen (&robot_data);
-
-    /* Read FMS packet */
-    if (DS_StrLen (&fms_data) > 0) {
-        ++received_fms_packets;
-        fms_read = protocol.read_fms_packet (&fms_data);
-        CFG_SetFMSCommunications (fms_read);
-    }
-
-    /* Read radio packet */
-    if (DS_StrLen (&radio_data) > 0) {
-        ++received_radio_packets;
-        radio_read = protocol.read_radio_packet (&radio_data);
-        CFG_SetRadioCommunications (radio_read);
-    }
-
-    /* Read robot packet */
-    if (DS_StrLen (&robot_data) > 0) {
-        ++received_robot_packets;
-        robot_read = protocol.read_robot_packet (&robot_data);
-        CFG_SetRobotCommunications (robot_read);
+    /* Read FMS packets */
+    fms_read = drain_socket (&protocol.fms_socket,
+                             protocol.read_fms_packet,
+                             &CFG_SetFMSCommunications,
+                             &recv_fms_bytes, &received_fms_packets);
+
+    /* Read radio packets */
+    radio_read = drain_socket (&protocol.radio_socket,
+                               protocol.read_radio_packet,
+                               &CFG_SetRadioCommunications,
+                               &recv_radio_bytes, &received_radio_packets);
+
+    /* Read robot packets */
+    robot_read = drain_socket (&protocol.robot_socket,
+                               protocol.read_robot_packet,
+                               &CFG_SetRobotCommunications,
+                               &recv_robot_bytes, &received_robot_packets);
+
+    /* Add NetConsole messages to event system */
+    const DS_Datagram* datagram;
+    while ((datagram = DS_SocketPeek (&protocol.netconsole_socket)) != NULL) {
+        DS_String message;
+        message.buf = (char*) datagram->data;
+        message.len = datagram->length;
+        message.cap = 0;
+        DS_SetEventOrigin (datagram->timestamp);
+        CFG_AddNetConsoleMessage (&message);
+        DS_SetEventOrigin (0);
+        DS_SocketRelease (&protocol.netconsole_socket);
     }
-
-    /* Add NetConsole message to event system */
-    if (netcs_data.len > 0)
-        CFG_AddNetConsoleMessage (&netcs_data);
-
-    /* Reset the data pointers */
-    clear_recv_data();
 }
 
 /**
  * Feeds the watchdogs, updates them and checks if any of them has expired
  */
-static void update_watchdogs()
+static void update_watchdogs (const int events)
 {
     /* Feed the watchdogs if packets are read */
     if (fms_read)   DS_TimerReset (&fms_recv_timer);
     if (radio_read) DS_TimerReset (&radio_recv_timer);
     if (robot_read) DS_TimerReset (&robot_recv_timer);
 
-    /* Clear the read success values */
-    fms_read = 0;
-    radio_read = 0;
-    robot_read = 0;
-
-    /* Reset the FMS if the watchdog expires */
-    if (fms_recv_timer.expired) {
+    /* Reset the FMS if the watchdog expires (and was not fed) */
+    if ((events & WATCHDOG_FMS) && !fms_read && enable_operations) {
         CFG_FMSWatchdogExpired();
         DS_TimerReset (&fms_recv_timer);
     }
 
-    /* Reset the radio if the watchdog expires */
-    if (radio_recv_timer.expired) {
+    /* Reset the radio if the watchdog expires (and was not fed) */
+    if ((events & WATCHDOG_RADIO) && !radio_read && enable_operations) {
         CFG_RadioWatchdogExpired();
         DS_TimerReset (&radio_recv_timer);
     }
 
-    /* Reset the robot if the watchdog expires */
-    if (robot_recv_timer.expired) {
+    /* Reset the robot if the watchdog expires (and was not fed) */
+    if ((events & WATCHDOG_ROBOT) && !robot_read && enable_operations) {
         CFG_RobotWatchdogExpired();
         DS_TimerReset (&robot_recv_timer);
     }
+
+    /* Clear the read success values */
+    fms_read = 0;
+    radio_read = 0;
+    robot_read = 0;
 }
 
 /**
- * This function is executed periodically, the function does the following:
- *    - Send data to the FMS, robot and radio
+ * This function is executed when a watchdog expires (or when the poll
+ * interval elapses), the function does the following:
  *    - Read received data from the FMS, robot and radio
  *    - Feed/reset the watchdogs
  *    - Check if any of the watchdogs has expired
@@ -287,10 +530,12 @@ static void update_watchdogs()
 static void* run_event_loop()
 {
     while (running) {
-        send_data();
+        int events = wait_events();
+
+        pthread_mutex_lock (&receiver_lock);
         recv_data();
-        update_watchdogs();
-        DS_Sleep (5);
+        update_watchdogs (events);
+        pthread_mutex_unlock (&receiver_lock);
     }
 
     return NULL;
@@ -312,23 +557,41 @@ DS_Protocol* DS_CurrentProtocol()
  */
 void Protocols_Init()
 {
-    /* Initialize sender timers */
-    DS_TimerInit (&fms_send_timer,   0, SEND_PRECISION);
-    DS_TimerInit (&radio_send_timer, 0, SEND_PRECISION);
-    DS_TimerInit (&robot_send_timer, 0, SEND_PRECISION);
+    /* Initialize link statistics */
+    DS_LinkInit (&robot_link);
+
+    /* Initialize sender channels */
+    memset (channels, 0, sizeof (channels));
+    channels [FMS_CHANNEL].socket = &protocol.fms_socket;
+    channels [FMS_CHANNEL].bytes = &sent_fms_bytes;
+    channels [FMS_CHANNEL].packets = &sent_fms_packets;
+    channels [RADIO_CHANNEL].socket = &protocol.radio_socket;
+    channels [RADIO_CHANNEL].bytes = &sent_radio_bytes;
+    channels [RADIO_CHANNEL].packets = &sent_radio_packets;
+    channels [ROBOT_CHANNEL].socket = &protocol.robot_socket;
+    channels [ROBOT_CHANNEL].bytes = &sent_robot_bytes;
+    channels [ROBOT_CHANNEL].packets = &sent_robot_packets;
 
     /* Initialize watchdog timers */
-    DS_TimerInit (&fms_recv_timer,   0, RECV_PRECISION);
-    DS_TimerInit (&radio_recv_timer, 0, RECV_PRECISION);
-    DS_TimerInit (&robot_recv_timer, 0, RECV_PRECISION);
+    init_timer (&fms_recv_timer,   RECV_PRECISION, WATCHDOG_FMS);
+    init_timer (&radio_recv_timer, RECV_PRECISION, WATCHDOG_RADIO);
+    init_timer (&robot_recv_timer, RECV_PRECISION, WATCHDOG_ROBOT);
 
     /* Allow the event loop to run */
+    DS_CondInit (&events_cond);
+    DS_CondInit (&sender_cond);
+    DS_HistogramReset (&urgent_latency);
+    urgent_request = 0;
+    urgent_last_send = 0;
+    pending_events = 0;
     running = 1;
     enable_operations = 0;
 
-    /* Configure the event thread */
+    /* Configure the event and sender threads */
     int error = pthread_create (&event_thread, NULL,
                                 &run_event_loop, NULL);
+    if (!error)
+        error = pthread_create (&sender_thread, NULL, &run_sender, NULL);
 
     /* Display error message if we cannot star the event loop */
     if (error) {
@@ -344,7 +607,8 @@ void Protocols_Init()
 }
 
 /**
- * De-allocates the current protocol and closes its sockets
+ * De-allocates the current protocol and closes its sockets, the receiver
+ * lock must be held by the caller
  */
 static void close_protocol()
 {
@@ -352,13 +616,10 @@ static void close_protocol()
     if (!enable_operations)
         return;
 
-    /* Disable protocol operations */
+    /* Disable protocol operations (and wait for the sender) */
+    pthread_mutex_lock (&sender_lock);
     enable_operations = 0;
-
-    /* Stop sender timers */
-    DS_TimerStop (&fms_send_timer);
-    DS_TimerStop (&radio_send_timer);
-    DS_TimerStop (&robot_send_timer);
+    pthread_mutex_unlock (&sender_lock);
 
     /* Stop receiver timers */
     DS_TimerStop (&fms_recv_timer);
@@ -397,9 +658,38 @@ static void close_protocol()
  */
 void Protocols_Close()
 {
+    /* Stop the event loop */
+    pthread_mutex_lock (&events_lock);
     running = 0;
+    pthread_cond_signal (&events_cond);
+    pthread_mutex_unlock (&events_lock);
+
+    /* Stop the sender */
+    pthread_mutex_lock (&sender_lock);
+    pthread_cond_signal (&sender_cond);
+    pthread_mutex_unlock (&sender_lock);
+
+    /* Wait for both threads before the sockets are closed */
+    pthread_join (sender_thread, NULL);
+    pthread_join (event_thread, NULL);
+
+    pthread_mutex_lock (&receiver_lock);
     close_protocol();
-    clear_recv_data();
+    pthread_mutex_unlock (&receiver_lock);
+}
+
+/**
+ * Sets the send \a interval and the \a create_packet function of the given
+ * \a channel, clears its statistics and schedules its first packet
+ */
+static void configure_channel (SendChannel* channel, const int interval,
+                               void (*create_packet) (DS_PacketWriter*))
+{
+    channel->last_send = 0;
+    channel->create_packet = create_packet;
+    channel->interval = interval;
+    channel->deadline = DS_GetMonotonicTime() + (uint64_t) interval * 1000000ULL;
+    DS_HistogramReset (&channel->jitter);
 }
 
 /**
@@ -408,6 +698,10 @@ void Protocols_Close()
  * Note the given \a ptr is not used directly, you should free it
  * after using it...
  *
+ * This function must not be called from an event subscriber, since the
+ * subscribers are called by the event loop while it reads the sockets of
+ * the current protocol.
+ *
  * \param ptr pointer to the new protocol implementation to load
  */
 void DS_ConfigureProtocol (const DS_Protocol* ptr)
@@ -415,6 +709,9 @@ void DS_ConfigureProtocol (const DS_Protocol* ptr)
     /* Pointer is NULL, abort */
     assert (ptr != NULL);
 
+    /* Wait for the event loop to stop reading the current sockets */
+    pthread_mutex_lock (&receiver_lock);
+
     /* Close previous protocol */
     close_protocol();
 
@@ -427,22 +724,14 @@ void DS_ConfigureProtocol (const DS_Protocol* ptr)
     DS_SocketOpen (&protocol.robot_socket);
     DS_SocketOpen (&protocol.netconsole_socket);
 
-    /* Update sender timers */
-    fms_send_timer.time = protocol.fms_interval;
-    radio_send_timer.time = protocol.radio_interval;
-    robot_send_timer.time = protocol.robot_interval;
-
     /* Update watchdogs */
     fms_recv_timer.time = DS_Min (protocol.fms_interval * 50, 1000);
     radio_recv_timer.time = DS_Min (protocol.radio_interval * 50, 1000);
     robot_recv_timer.time = DS_Min (protocol.robot_interval * 50, 1000);
 
-    /* Start the timers */
-    DS_TimerStart (&fms_send_timer);
+    /* Start the watchdogs */
     DS_TimerStart (&fms_recv_timer);
-    DS_TimerStart (&radio_send_timer);
     DS_TimerStart (&radio_recv_timer);
-    DS_TimerStart (&robot_send_timer);
     DS_TimerStart (&robot_recv_timer);
 
     /* Create notification string */
@@ -452,8 +741,118 @@ void DS_ConfigureProtocol (const DS_Protocol* ptr)
     DS_StrRmBuf (&str);
     DS_FREE (name);
 
-    /* Restore protocol operations */
+    /* Clear link statistics */
+    DS_LinkReset (&robot_link);
+
+    /* Schedule the first packets and restore protocol operations */
+    pthread_mutex_lock (&sender_lock);
+    configure_channel (&channels [FMS_CHANNEL], protocol.fms_interval,
+                       protocol.create_fms_packet);
+    configure_channel (&channels [RADIO_CHANNEL], protocol.radio_interval,
+                       protocol.create_radio_packet);
+    configure_channel (&channels [ROBOT_CHANNEL], protocol.robot_interval,
+                       protocol.create_robot_packet);
     enable_operations = 1;
+    pthread_cond_signal (&sender_cond);
+    pthread_mutex_unlock (&sender_lock);
+
+    /* Let the event loop read the new sockets */
+    pthread_mutex_unlock (&receiver_lock);
+}
+
+/**
+ * Obtains the statistics of the intervals (in nanoseconds) between the
+ * consecutive FMS, radio and robot packets sent since the current protocol
+ * was loaded (or since the statistics were reset).
+ */
+void DS_GetSendJitterStats (DS_SendJitterStats* stats)
+{
+    assert (stats);
+
+    pthread_mutex_lock (&sender_lock);
+    DS_HistogramSummarize (&channels [FMS_CHANNEL].jitter, &stats->fms);
+    DS_HistogramSummarize (&channels [RADIO_CHANNEL].jitter, &stats->radio);
+    DS_HistogramSummarize (&channels [ROBOT_CHANNEL].jitter, &stats->robot);
+    DS_HistogramSummarize (&urgent_latency, &stats->urgent);
+    pthread_mutex_unlock (&sender_lock);
+}
+
+/**
+ * Registers that a robot packet with the given \a index was generated, the
+ * protocol implementation should call this when creating a robot packet
+ * that the robot will echo back.
+ */
+void DS_RobotPacketSent (const uint16_t index)
+{
+    DS_LinkSent (&robot_link, index, DS_GetMonotonicTime());
+}
+
+/**
+ * Registers that the robot echoed the given packet \a index, the protocol
+ * implementation should call this when reading a robot packet. The reply is
+ * timestamped with the time at which its datagram was received.
+ */
+void DS_RobotPacketEchoed (const uint16_t index)
+{
+    DS_LinkReceived (&robot_link, index, datagram_timestamp);
+}
+
+/**
+ * Obtains the quality statistics of the link with the robot since the
+ * current protocol was loaded (or since the statistics were reset): the
+ * round-trip times, the time between replies and the number of lost,
+ * duplicated and reordered replies.
+ */
+void DS_GetRobotLinkStats (DS_LinkStats* stats)
+{
+    assert (stats);
+    DS_LinkGetStats (&robot_link, stats);
+}
+
+/**
+ * Clears the robot link statistics
+ */
+void DS_ResetRobotLinkStats()
+{
+    DS_LinkReset (&robot_link);
+}
+
+/**
+ * Wakes up the sender thread to send a robot packet immediately, without
+ * waiting for the next regular packet. This is used when the robot must be
+ * disabled as soon as possible (e.g. emergency stop or disable commands).
+ *
+ * Out-of-band packets are sent at most once every \c URGENT_INTERVAL
+ * milliseconds, requests made during that time are merged. Requests are
+ * ignored while there are no communications with the robot.
+ */
+void DS_SendUrgentRobotPacket()
+{
+    /* Nobody would receive the packet */
+    if (!CFG_GetRobotCommunications())
+        return;
+
+    pthread_mutex_lock (&sender_lock);
+    if (urgent_request == 0)
+        urgent_request = DS_GetMonotonicTime();
+
+    pthread_cond_signal (&sender_cond);
+    pthread_mutex_unlock (&sender_lock);
+}
+
+/**
+ * Clears the send interval statistics of every channel
+ */
+void DS_ResetSendJitterStats()
+{
+    int i;
+    pthread_mutex_lock (&sender_lock);
+    for (i = 0; i < NUM_CHANNELS; ++i) {
+        channels [i].last_send = 0;
+        DS_HistogramReset (&channels [i].jitter);
+    }
+    DS_HistogramReset (&urgent_latency);
+    pthread_mutex_unlock (&sender_lock);
 }
 
 /**
@@ -22,6 +22,7 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include "DS_Utils.h"
 #include "DS_Config.h"
@@ -49,6 +50,29 @@ static const uint8_t cAllianceBlue     = 0x42;
 static const uint8_t cFMSAutonomous    = 0x53;
 static const uint8_t cFMSTeleoperated  = 0x43;
 
+/*
+ * FRC Driver Station version (same as FRC DS 17.01)
+ */
+static const uint8_t cVersion [8] = {0x31, 0x34, 0x30, 0x32,
+                                     0x31, 0x37, 0x30, 0x30
+                                    };
+
+/*
+ * Robot packet layout, everything after the version offset is constant
+ */
+#define ROBOT_VERSION_OFFSET 72
+#define ROBOT_CHECKSUM_OFFSET 1020
+#define ROBOT_PACKET_LENGTH 1024
+#define ROBOT_TRAILER_LENGTH (ROBOT_PACKET_LENGTH - ROBOT_VERSION_OFFSET)
+
+/*
+ * Checksum of the constant trailer of the robot packet (the DS version,
+ * the padding and the zeroed checksum) and the operator used to append
+ * it to the checksum of the header
+ */
+static uint32_t trailer_crc = 0;
+static uint32_t trailer_shift = 0;
+
 /*
  * Sent robot packet counters, they are used as packet IDs
  */
@@ -194,8 +218,7 @@ static uint8_t get_digital_inputs (void)
 }
 
 /**
- * Adds joystick information to a DS-to-robot packet, beginning at the given
- * \a offset in the data packet.
+ * Adds joystick information to a DS-to-robot packet
  *
  * The 2014 communication protocol records the data for all four joysticks,
  * if a joystick or joystick member is not present, we will send a neutral
@@ -207,30 +230,35 @@ static uint8_t get_digital_inputs (void)
  * Button states are stored in a similar way as enumerated flags in a C/C++
  * program.
  */
-static DS_String get_joystick_data (void)
+static void add_joystick_data (DS_PacketWriter* writer)
 {
     /* Initialize variables */
     int i = 0;
     int j = 0;
-    DS_String buf = DS_StrNewLen (0);
+    int enabled = CFG_GetRobotEnabled();
+    const DS_JoystickFrame* frame = DS_JoysticksAcquireFrame();
 
     /* Add data for every joystick */
     for (i = 0; i < max_joysticks; ++i) {
-        /* Add axis data */
-        for (j = 0; j < max_axes; ++j)
-            DS_StrAppend (&buf, DS_FloatToByte (DS_GetJoystickAxis (i, j), 1));
+        int exists = enabled && i < frame->count;
+        int num_axes = exists ? frame->num_axes [i] : 0;
+        int num_buttons = exists ? frame->num_buttons [i] : 0;
+
+        /* Add axis data (unused axes are neutral) */
+        int8_t axes [DS_MAX_JOYSTICK_AXES] = {0};
+        DS_QuantizeAxes (frame->axes [i], axes, DS_Min (num_axes, max_axes));
+        DS_PacketPutBytes (writer, axes, max_axes);
 
         /* Generate button data */
         uint16_t button_flags = 0;
-        for (j = 0; j < max_buttons; ++j)
-            button_flags += (uint16_t) DS_GetJoystickButton (i, j) ? j * j : 0;
+        for (j = 0; j < max_buttons; ++j) {
+            int pressed = (j < num_buttons) ? (frame->buttons [i] >> j) & 1 : 0;
+            button_flags += (uint16_t) pressed ? j * j : 0;
+        }
 
         /* Add button data */
-        DS_StrAppend (&buf, (button_flags & 0xff00) >> 8);
-        DS_StrAppend (&buf, (button_flags & 0xff));
+        DS_PacketPutU16BE (writer, button_flags);
     }
-
-    return buf;
 }
 
 /**
@@ -261,17 +289,17 @@ static DS_String robot_address (void)
 /**
  * Generates an empty (ignored) FMS packet.
  */
-static DS_String create_fms_packet (void)
+static void create_fms_packet (DS_PacketWriter* writer)
 {
-    return  DS_StrNewLen (0);
+    (void) writer;
 }
 
 /**
  * Generates an empty (ignored) radio packet.
  */
-static DS_String create_radio_packet (void)
+static void create_radio_packet (DS_PacketWriter* writer)
 {
-    return  DS_StrNewLen (0);
+    (void) writer;
 }
 
 /**
@@ -286,56 +314,64 @@ static DS_String create_radio_packet (void)
  *     - The version of the FRC Driver Station
  *     - The CRC32 checksum of the packet
  */
-static DS_String create_robot_packet (void)
+static void create_robot_packet (DS_PacketWriter* writer)
 {
-    /* Create initial packet */
-    DS_String data = DS_StrNewLen (8);
-
     /* Add packet index */
-    DS_StrSetChar (&data, 0, (sent_robot_packets & 0xff00) >> 8);
-    DS_StrSetChar (&data, 1, (sent_robot_packets & 0xff));
+    DS_PacketPutU16BE (writer, (uint16_t) sent_robot_packets);
+    DS_RobotPacketSent ((uint16_t) sent_robot_packets);
 
     /* Add control code and digital inputs */
-    DS_StrSetChar (&data, 2, get_control_code());
-    DS_StrSetChar (&data, 3,  get_digital_inputs());
+    DS_PacketPutU8 (writer, get_control_code());
+    DS_PacketPutU8 (writer, get_digital_inputs());
 
     /* Add team number */
-    DS_StrSetChar (&data, 4, (CFG_GetTeamNumber() & 0xff00) >> 8);
-    DS_StrSetChar (&data, 5, (CFG_GetTeamNumber() & 0xff));
+    DS_PacketPutU16BE (writer, (uint16_t) CFG_GetTeamNumber());
 
     /* Add alliance and position */
-    DS_StrSetChar (&data, 6, get_alliance_code());
-    DS_StrSetChar (&data, 7, get_position_code());
+    DS_PacketPutU8 (writer, get_alliance_code());
+    DS_PacketPutU8 (writer, get_position_code());
 
     /* Add joystick data */
-    DS_String jsData = get_joystick_data();
-    DS_StrJoin (&data, &jsData);
-
-    /* Now resize the datagram to 1024 bytes */
-    DS_StrResize (&data, 1024);
-
-    /* Add FRC Driver Station version (same as FRC DS 17.01) */
-    DS_StrSetChar (&data, 72, (uint8_t) 0x31);
-    DS_StrSetChar (&data, 73, (uint8_t) 0x34);
-    DS_StrSetChar (&data, 74, (uint8_t) 0x30);
-    DS_StrSetChar (&data, 75, (uint8_t) 0x32);
-    DS_StrSetChar (&data, 76, (uint8_t) 0x31);
-    DS_StrSetChar (&data, 77, (uint8_t) 0x37);
-    DS_StrSetChar (&data, 78, (uint8_t) 0x30);
-    DS_StrSetChar (&data, 79, (uint8_t) 0x30);
-
-    /* Add CRC32 checksum */
-    uint32_t checksum = DS_CRC32 (data.buf, DS_StrLen (&data));
-    DS_StrSetChar (&data, 1020, (checksum & 0xff000000) >> 24);
-    DS_StrSetChar (&data, 1021, (checksum & 0xff0000) >> 16);
-    DS_StrSetChar (&data, 1022, (checksum & 0xff00) >> 8);
-    DS_StrSetChar (&data, 1023, (checksum & 0xff));
+    add_joystick_data (writer);
+
+    /* Add FRC Driver Station version */
+    int header_fits = writer->length <= ROBOT_VERSION_OFFSET;
+    DS_PacketPad (writer, ROBOT_VERSION_OFFSET);
+    DS_PacketPutBytes (writer, cVersion, sizeof (cVersion));
+
+    /* Resize the datagram to 1024 bytes (checksum bytes are set to 0) */
+    DS_PacketPad (writer, ROBOT_PACKET_LENGTH);
+
+    /* Add CRC32 checksum (only hash the header if the trailer is constant) */
+    if (!writer->overflow) {
+        uint32_t checksum;
+        if (header_fits && writer->length == ROBOT_PACKET_LENGTH) {
+            checksum = DS_CRC32 (writer->buf, ROBOT_VERSION_OFFSET);
+            checksum = DS_CRC32CombineOp (checksum, trailer_crc, trailer_shift);
+        }
+
+        else
+            checksum = DS_CRC32 (writer->buf, writer->length);
+
+        DS_PacketSetU32BE (writer, ROBOT_CHECKSUM_OFFSET, checksum);
+    }
 
     /* Increase sent robot packets */
     ++sent_robot_packets;
+}
+
+/**
+ * Calculates the checksum of the constant trailer of the robot packet,
+ * so that only the header needs to be hashed when sending a packet
+ */
+static void init_trailer_checksum (void)
+{
+    uint8_t trailer [ROBOT_TRAILER_LENGTH];
+    memset (trailer, 0, sizeof (trailer));
+    memcpy (trailer, cVersion, sizeof (cVersion));
 
-    /* Return address of data */
-    return data;
+    trailer_crc = DS_CRC32 (trailer, sizeof (trailer));
+    trailer_shift = DS_CRC32CombineGen (sizeof (trailer));
 }
 
 /**
@@ -347,15 +383,18 @@ static int read_fms_packet (const DS_String* data)
     if (!data)
         return 0;
 
+    /* Read FMS packet */
+    DS_PacketReader reader;
+    DS_PacketReaderInit (&reader, data->buf, data->len);
+    DS_PacketSkip (&reader, 2);
+    uint8_t robotmod = DS_PacketGetU8 (&reader);
+    uint8_t alliance = DS_PacketGetU8 (&reader);
+    uint8_t position = DS_PacketGetU8 (&reader);
+
     /* Packet is too small */
-    if (DS_StrLen (data) < 5)
+    if (reader.overflow)
         return 0;
 
-    /* Read FMS packet */
-    uint8_t robotmod = (uint8_t) DS_StrCharAt (data, 2);
-    uint8_t alliance = (uint8_t) DS_StrCharAt (data, 3);
-    uint8_t position = (uint8_t) DS_StrCharAt (data, 4);
-
     /* Switch to autonomous */
     if (robotmod & cFMSAutonomous)
         CFG_SetControlMode (DS_CONTROL_AUTONOMOUS);
@@ -398,16 +437,25 @@ int read_robot_packet (const DS_String* data)
     if (DS_StrLen (data) < 1024)
         return 0;
 
+    /* Read robot packet */
+    DS_PacketReader reader;
+    DS_PacketReaderInit (&reader, data->buf, data->len);
+    uint8_t control = DS_PacketGetU8 (&reader);
+
     /* Calculate voltage using the rule of three */
-    uint8_t upper = ((uint8_t) DS_StrCharAt (data, 1) * 12) / 0x12;
-    uint8_t lower = ((uint8_t) DS_StrCharAt (data, 2) * 12) / 0x12;
+    uint8_t upper = (DS_PacketGetU8 (&reader) * 12) / 0x12;
+    uint8_t lower = (DS_PacketGetU8 (&reader) * 12) / 0x12;
 
     /* Construct the voltage float */
     float voltage = ((float) upper) + ((float) lower / 0xff);
     CFG_SetRobotVoltage (voltage);
 
+    /* Match the echoed packet index (bytes 30-31) with the sent packet */
+    DS_PacketSkip (&reader, 30 - reader.position);
+    DS_RobotPacketEchoed (DS_PacketGetU16BE (&reader));
+
     /* Check if robot is e-stopped */
-    CFG_SetEmergencyStopped ((uint8_t) DS_StrCharAt (data, 0) == cEmergencyStopOn);
+    CFG_SetEmergencyStopped (control == cEmergencyStopOn);
 
     /* Assume that robot code is present (issue #31 in QDriverStation) */
     CFG_SetRobotCode (1);
@@ -469,6 +517,9 @@ DS_Protocol DS_GetProtocolFRC_2014 (void)
     /* Initialize pointers */
     DS_Protocol protocol;
 
+    /* Pre-calculate the checksum of the constant packet data */
+    init_trailer_checksum();
+
     /* Set protocol name */
     protocol.name = DS_StrNew ("FRC 2014");
 
@@ -524,6 +575,7 @@ DS_Protocol DS_GetProtocolFRC_2014 (void)
     protocol.robot_socket.disabled = 0;
     protocol.robot_socket.in_port = 1150;
     protocol.robot_socket.out_port = 1110;
+    protocol.robot_socket.connect_udp = 1;
     protocol.robot_socket.type = DS_SOCKET_UDP;
 
     /* Define netconsole socket properties */
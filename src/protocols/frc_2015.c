@@ -28,7 +28,6 @@
 #include "DS_DefaultProtocols.h"
 
 #include <time.h>
-#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -83,6 +82,28 @@ static unsigned int sent_robot_packets = 0;
 static int reboot = 0;
 static int restart_code = 0;
 
+/*
+ * Joystick properties, the buttons are sent as a 16-bit mask
+ */
+static int max_axes = 6;
+static int max_hats = 1;
+static int max_buttons = 10;
+static int max_joysticks = 6;
+
+/**
+ * Encoded data of a joystick, which is generated again only when the
+ * joystick generation or the enabled state of the robot changes
+ */
+typedef struct {
+    int valid;
+    int enabled;
+    size_t length;
+    uint32_t generation;
+    uint8_t data [32];
+} JoystickBlock;
+
+static JoystickBlock joystick_blocks [DS_MAX_JOYSTICKS];
+
 /**
  * Obtains the voltage float from the given \a upper and \a lower bytes
  */
@@ -257,27 +278,25 @@ static uint8_t get_station_code (void)
  * joystick data (which is sent to the robot) and to resize the client->robot
  * datagram automatically.
  */
-static uint8_t get_joystick_size (const int joystick)
+static uint8_t get_joystick_size (const int num_axes, const int num_hats)
 {
     int header_size = 2;
     int button_data = 3;
-    int axis_data = DS_GetJoystickNumAxes (joystick) + 1;
-    int hat_data = (DS_GetJoystickNumHats (joystick) * 2) + 1;
+    int axis_data = num_axes + 1;
+    int hat_data = (num_hats * 2) + 1;
 
     return header_size + button_data + axis_data + hat_data;
 }
 
 /**
- * Returns information regarding the current date and time and the timezone
- * of the client computer.
+ * Adds information regarding the current date and time and the timezone
+ * of the client computer to the packet.
  *
  * The robot may ask for this information in some cases (e.g. when initializing
  * the robot code).
  */
-static DS_String get_timezone_data (void)
+static void add_timezone_data (DS_PacketWriter* writer)
 {
-    DS_String data = DS_StrNewLen (14);
-
     /* Get current time */
     time_t rt = 0;
     uint32_t ms = 0;
@@ -295,118 +314,155 @@ static DS_String get_timezone_data (void)
     GetTimeZoneInformation (&info);
 
     /* Convert the wchar to a standard string */
-    size_t len = wcslen (info.StandardName) + 1;
-    char* str = calloc (len, sizeof (char));
-    wcstombs_s (NULL, str, len, info.StandardName, wcslen (info.StandardName));
-
-    /* Convert the obtained cstring to a bstring */
-    DS_String tz = DS_StrNew (str);
-    free (str);
+    char tz [64] = {0};
+    wcstombs_s (NULL, tz, sizeof (tz), info.StandardName, _TRUNCATE);
 
     /* Get milliseconds */
     GetSystemTime (&info.StandardDate);
     ms = (uint32_t) info.StandardDate.wMilliseconds;
 #else
     /* Timezone is stored directly in time_t structure */
-    DS_String tz = DS_StrNew (timeinfo.tm_zone);
+    const char* tz = timeinfo.tm_zone ? timeinfo.tm_zone : "";
 #endif
 
     /* Encode date/time in datagram */
-    DS_StrSetChar (&data, 0,  (uint8_t) 0x0b);
-    DS_StrSetChar (&data, 1,  (uint8_t) cTagDate);
-    DS_StrSetChar (&data, 2,  (uint8_t) (ms >> 24));
-    DS_StrSetChar (&data, 3,  (uint8_t) (ms >> 16));
-    DS_StrSetChar (&data, 4,  (uint8_t) (ms >> 8));
-    DS_StrSetChar (&data, 5,  (uint8_t) (ms));
-    DS_StrSetChar (&data, 6,  (uint8_t) timeinfo.tm_sec);
-    DS_StrSetChar (&data, 7,  (uint8_t) timeinfo.tm_min);
-    DS_StrSetChar (&data, 8,  (uint8_t) timeinfo.tm_hour);
-    DS_StrSetChar (&data, 9,  (uint8_t) timeinfo.tm_yday);
-    DS_StrSetChar (&data, 10, (uint8_t) timeinfo.tm_mon);
-    DS_StrSetChar (&data, 11, (uint8_t) timeinfo.tm_year);
+    DS_PacketPutU8 (writer, 0x0b);
+    DS_PacketPutU8 (writer, cTagDate);
+    DS_PacketPutU32BE (writer, ms);
+    DS_PacketPutU8 (writer, (uint8_t) timeinfo.tm_sec);
+    DS_PacketPutU8 (writer, (uint8_t) timeinfo.tm_min);
+    DS_PacketPutU8 (writer, (uint8_t) timeinfo.tm_hour);
+    DS_PacketPutU8 (writer, (uint8_t) timeinfo.tm_yday);
+    DS_PacketPutU8 (writer, (uint8_t) timeinfo.tm_mon);
+    DS_PacketPutU8 (writer, (uint8_t) timeinfo.tm_year);
 
     /* Add timezone length and tag */
-    DS_StrSetChar (&data, 12, DS_StrLen (&tz));
-    DS_StrSetChar (&data, 13, cTagTimezone);
+    size_t tz_len = strlen (tz);
+    DS_PacketPutU8 (writer, (uint8_t) tz_len);
+    DS_PacketPutU8 (writer, cTagTimezone);
 
     /* Add timezone string */
-    DS_StrJoin (&data, &tz);
+    DS_PacketPutBytes (writer, tz, tz_len);
+}
 
-    /* Return the obtained data */
-    return data;
+/**
+ * Writes the information structure of the given \a joystick of the \a frame,
+ * the joystick values are neutralized if the robot is not \a enabled.
+ *
+ * Joysticks with more inputs than the protocol supports are sent with
+ * their first \c max_axes axes, \c max_hats hats and \c max_buttons buttons.
+ */
+static void encode_joystick (DS_PacketWriter* writer,
+                             const DS_JoystickFrame* frame,
+                             const int joystick, const int enabled)
+{
+    int j;
+    int num_axes = DS_Min (frame->num_axes [joystick], max_axes);
+    int num_hats = DS_Min (frame->num_hats [joystick], max_hats);
+    int num_buttons = DS_Min (frame->num_buttons [joystick], max_buttons);
+    uint32_t buttons = frame->buttons [joystick] & ((1u << num_buttons) - 1);
+
+    /* Add joystick header */
+    DS_PacketPutU8 (writer, get_joystick_size (num_axes, num_hats));
+    DS_PacketPutU8 (writer, cTagJoystick);
+
+    /* Add axis data (all axes are quantized at once) */
+    int8_t axes [DS_MAX_JOYSTICK_AXES] = {0};
+    if (enabled)
+        DS_QuantizeAxes (frame->axes [joystick], axes, num_axes);
+
+    DS_PacketPutU8 (writer, (uint8_t) num_axes);
+    DS_PacketPutBytes (writer, axes, num_axes);
+
+    /* Add button data */
+    DS_PacketPutU8 (writer, (uint8_t) num_buttons);
+    DS_PacketPutU16BE (writer, enabled ? (uint16_t) buttons : 0);
+
+    /* Add hat data */
+    DS_PacketPutU8 (writer, (uint8_t) num_hats);
+    for (j = 0; j < num_hats; ++j) {
+        int hat = enabled ? frame->hats [joystick][j] : 0;
+        DS_PacketPutU16BE (writer, (uint16_t) hat);
+    }
+}
+
+/**
+ * Updates the cached data of the given \a joystick if the joystick or the
+ * enabled state of the robot changed since the data was generated
+ */
+static JoystickBlock* get_joystick_block (const DS_JoystickFrame* frame,
+                                          const int joystick, const int enabled)
+{
+    JoystickBlock* block = &joystick_blocks [joystick];
+
+    /* Joystick did not change */
+    if (block->valid && block->enabled == enabled &&
+        block->generation == frame->generation [joystick])
+        return block;
+
+    /* Encode the joystick */
+    DS_PacketWriter writer;
+    DS_PacketWriterInit (&writer, block->data, sizeof (block->data));
+    encode_joystick (&writer, frame, joystick, enabled);
+
+    /* Update the cache */
+    block->length = writer.length;
+    block->enabled = enabled;
+    block->generation = frame->generation [joystick];
+    block->valid = !writer.overflow;
+
+    return block;
 }
 
 /**
  * Constructs a joystick information structure for every attached joystick.
  * Unlike the 2014 protocol, the 2015 protocol only generates joystick data
  * for the attached joysticks.
+ *
+ * The joystick values are read from the latest joystick frame, and the data
+ * of each joystick is cached and only generated again when the joystick
+ * changes, so idle joysticks are copied directly to the packet.
  */
-static DS_String get_joystick_data (void)
+static void add_joystick_data (DS_PacketWriter* writer)
 {
-    /* Initialize the variables */
-    int i = 0;
-    int j = 0;
-    DS_String data = DS_StrNewLen (0);
-
-    /* Generate data for each joystick */
-    for (i = 0; i < DS_GetJoystickCount(); ++i) {
-        DS_StrAppend (&data, get_joystick_size (i));
-        DS_StrAppend (&data, cTagJoystick);
-
-        /* Add axis data */
-        DS_StrAppend (&data, DS_GetJoystickNumAxes (i));
-        for (j = 0; j < DS_GetJoystickNumAxes (i); ++j)
-            DS_StrAppend (&data, DS_FloatToByte (DS_GetJoystickAxis (i, j), 1));
-
-        /* Generate button data */
-        uint16_t button_flags = 0;
-        for (j = 0; j < DS_GetJoystickNumButtons (i); ++j)
-            button_flags += DS_GetJoystickButton (i, j) ? (int) pow (2, j) : 0;
-
-        /* Add button data */
-        DS_StrAppend (&data, DS_GetJoystickNumButtons (i));
-        DS_StrAppend (&data, (uint8_t) (button_flags >> 8));
-        DS_StrAppend (&data, (uint8_t) (button_flags));
-
-        /* Add hat data */
-        DS_StrAppend (&data, DS_GetJoystickNumHats (i));
-        for (j = 0; j < DS_GetJoystickNumHats (i); ++j) {
-            DS_StrAppend (&data, (uint8_t) (DS_GetJoystickHat (i, j) >> 8));
-            DS_StrAppend (&data, (uint8_t) (DS_GetJoystickHat (i, j)));
-        }
-    }
+    int i;
+    int enabled = CFG_GetRobotEnabled();
+    const DS_JoystickFrame* frame = DS_JoysticksAcquireFrame();
+    int count = DS_Min (frame->count, max_joysticks);
 
-    /* Return obtained data */
-    return data;
+    for (i = 0; i < count; ++i) {
+        JoystickBlock* block = get_joystick_block (frame, i, enabled);
+
+        if (block->valid)
+            DS_PacketPutBytes (writer, block->data, block->length);
+        else
+            encode_joystick (writer, frame, i, enabled);
+    }
 }
 
 /**
  * Obtains the CPU, RAM, Disk and CAN information from the robot packet
  */
-static void read_extended (const DS_String* data, const int offset)
+static void read_extended (DS_PacketReader* reader, const int offset)
 {
-    /* Check if data pointer is valid */
-    if (!data)
-        return;
-
     /* Get header tag */
-    uint8_t tag = (uint8_t) DS_StrCharAt (data, offset + 1);
+    uint8_t tag = DS_PacketPeekU8 (reader, offset + 1);
 
     /* Get CAN information */
     if (tag == cRTagCANInfo)
-        CFG_SetCANUtilization ((uint8_t) DS_StrCharAt (data, 10));
+        CFG_SetCANUtilization (DS_PacketPeekU8 (reader, 10));
 
     /* Get CPU usage */
     else if (tag == cRTagCPUInfo)
-        CFG_SetRobotCPUUsage ((uint8_t) DS_StrCharAt (data, 3));
+        CFG_SetRobotCPUUsage (DS_PacketPeekU8 (reader, 3));
 
     /* Get RAM usage */
     else if (tag == cRTagRAMInfo)
-        CFG_SetRobotRAMUsage ((uint8_t) DS_StrCharAt (data, 4));
+        CFG_SetRobotRAMUsage (DS_PacketPeekU8 (reader, 4));
 
     /* Get disk usage */
     else if (tag == cRTagDiskInfo)
-        CFG_SetRobotDiskUsage ((uint8_t)  DS_StrCharAt (data, 4));
+        CFG_SetRobotDiskUsage (DS_PacketPeekU8 (reader, 4));
 }
 
 /**
@@ -475,36 +531,29 @@ static DS_String robot_address (void)
  *    - Radio and robot ping flags
  *    - The team number
  */
-static DS_String create_fms_packet (void)
+static void create_fms_packet (DS_PacketWriter* writer)
 {
-    /* Create an 8-byte long packet */
-    DS_String data = DS_StrNewLen (8);
-
     /* Get voltage bytes */
     uint8_t integer = 0;
     uint8_t decimal = 0;
     encode_voltage (CFG_GetRobotVoltage(), &integer, &decimal);
 
     /* Add FMS packet count */
-    DS_StrSetChar (&data, 0, (sent_fms_packets >> 8));
-    DS_StrSetChar (&data, 1, (sent_fms_packets));
+    DS_PacketPutU16BE (writer, (uint16_t) sent_fms_packets);
 
     /* Add DS version and FMS control code */
-    DS_StrSetChar (&data, 2, cFMS_DS_Version);
-    DS_StrSetChar (&data, 3, fms_control_code());
+    DS_PacketPutU8 (writer, cFMS_DS_Version);
+    DS_PacketPutU8 (writer, fms_control_code());
 
     /* Add team number */
-    DS_StrSetChar (&data, 4, (CFG_GetTeamNumber() >> 8));
-    DS_StrSetChar (&data, 5, (CFG_GetTeamNumber()));
+    DS_PacketPutU16BE (writer, (uint16_t) CFG_GetTeamNumber());
 
     /* Add robot voltage */
-    DS_StrSetChar (&data, 6, integer);
-    DS_StrSetChar (&data, 7, decimal);
+    DS_PacketPutU8 (writer, integer);
+    DS_PacketPutU8 (writer, decimal);
 
     /* Increase FMS packet counter */
     ++sent_fms_packets;
-
-    return data;
 }
 
 /**
@@ -512,9 +561,9 @@ static DS_String create_fms_packet (void)
  * to the DS Radio / Bridge. For that reason, the 2015 communication protocol
  * generates empty radio packets.
  */
-static DS_String create_radio_packet (void)
+static void create_radio_packet (DS_PacketWriter* writer)
 {
-    return  DS_StrNewLen (0);
+    (void) writer;
 }
 
 /**
@@ -527,38 +576,30 @@ static DS_String create_radio_packet (void)
  *    - Date and time data (if robot requests it)
  *    - Joystick information (if the robot does not want date/time)
  */
-static DS_String create_robot_packet (void)
+static void create_robot_packet (DS_PacketWriter* writer)
 {
-    DS_String data = DS_StrNewLen (6);
-
     /* Add packet index */
-    DS_StrSetChar (&data, 0, (sent_robot_packets >> 8));
-    DS_StrSetChar (&data, 1, (sent_robot_packets));
+    DS_PacketPutU16BE (writer, (uint16_t) sent_robot_packets);
+    DS_RobotPacketSent ((uint16_t) sent_robot_packets);
 
     /* Add packet header */
-    DS_StrSetChar (&data, 2, cTagGeneral);
+    DS_PacketPutU8 (writer, cTagGeneral);
 
     /* Add control code, request flags and team station */
-    DS_StrSetChar (&data, 3, get_control_code());
-    DS_StrSetChar (&data, 4, get_request_code());
-    DS_StrSetChar (&data, 5, get_station_code());
+    DS_PacketPutU8 (writer, get_control_code());
+    DS_PacketPutU8 (writer, get_request_code());
+    DS_PacketPutU8 (writer, get_station_code());
 
     /* Add timezone data (if robot wants it) */
-    if (send_time_data) {
-        DS_String tz = get_timezone_data();
-        DS_StrJoin (&data, &tz);
-    }
+    if (send_time_data)
+        add_timezone_data (writer);
 
     /* Add joystick data */
-    else if (sent_robot_packets > 5) {
-        DS_String js = get_joystick_data();
-        DS_StrJoin (&data, &js);
-    }
+    else if (sent_robot_packets > 5)
+        add_joystick_data (writer);
 
     /* Increase robot packet counter */
     ++sent_robot_packets;
-
-    return data;
 }
 
 /**
@@ -580,8 +621,12 @@ static int read_fms_packet (const DS_String* data)
         return 0;
 
     /* Read FMS packet */
-    uint8_t control = (uint8_t) DS_StrCharAt (data, 3);
-    uint8_t station = (uint8_t) DS_StrCharAt (data, 5);
+    DS_PacketReader reader;
+    DS_PacketReaderInit (&reader, data->buf, data->len);
+    DS_PacketSkip (&reader, 3);
+    uint8_t control = DS_PacketGetU8 (&reader);
+    DS_PacketSkip (&reader, 1);
+    uint8_t station = DS_PacketGetU8 (&reader);
 
     /* Change robot enabled state based on what FMS tells us to do*/
     CFG_SetRobotEnabled (control & cEnabled);
@@ -629,14 +674,25 @@ static int read_robot_packet (const DS_String* data)
     if (!data)
         return 0;
 
+    /* Read robot packet */
+    DS_PacketReader reader;
+    DS_PacketReaderInit (&reader, data->buf, data->len);
+    uint16_t index = DS_PacketGetU16BE (&reader);
+    DS_PacketSkip (&reader, 1);
+    uint8_t control = DS_PacketGetU8 (&reader);
+    uint8_t rstatus = DS_PacketGetU8 (&reader);
+    uint8_t upper = DS_PacketGetU8 (&reader);
+    uint8_t lower = DS_PacketGetU8 (&reader);
+
     /* Packet is too small */
-    if (DS_StrLen (data) < 7)
+    if (reader.overflow)
         return 0;
 
-    /* Read robot packet */
-    uint8_t control = (uint8_t) DS_StrCharAt (data, 3);
-    uint8_t rstatus = (uint8_t) DS_StrCharAt (data, 4);
-    uint8_t request = (uint8_t) DS_StrCharAt (data, 7);
+    /* Match the echoed packet index with the sent packet */
+    DS_RobotPacketEchoed (index);
+
+    /* Get the date/time request (0 if not present) */
+    uint8_t request = DS_PacketGetU8 (&reader);
 
     /* Update client information */
     CFG_SetRobotCode (rstatus & cRobotHasCode);
@@ -646,13 +702,11 @@ static int read_robot_packet (const DS_String* data)
     send_time_data = (request == cRequestTime);
 
     /* Calculate the voltage */
-    uint8_t upper = (uint8_t) DS_StrCharAt (data, 5);
-    uint8_t lower = (uint8_t) DS_StrCharAt (data, 6);
     CFG_SetRobotVoltage (decode_voltage (upper, lower));
 
     /* This is an extended packet, read its extra data */
     if (DS_StrLen (data) > 9)
-        read_extended (data, 8);
+        read_extended (&reader, 8);
 
     /* Packet read, feed the watchdog some meat */
     return 1;
@@ -743,10 +797,10 @@ DS_Protocol DS_GetProtocolFRC_2015 (void)
     protocol.robot_interval = 20;
 
     /* Set joystick properties */
-    protocol.max_joysticks = 6;
-    protocol.max_hat_count = 1;
-    protocol.max_axis_count = 6;
-    protocol.max_button_count = 10;
+    protocol.max_hat_count = max_hats;
+    protocol.max_axis_count = max_axes;
+    protocol.max_joysticks = max_joysticks;
+    protocol.max_button_count = max_buttons;
 
     /* Define FMS socket properties */
     protocol.fms_socket = *DS_SocketEmpty();
@@ -764,6 +818,7 @@ DS_Protocol DS_GetProtocolFRC_2015 (void)
     protocol.robot_socket.disabled = 0;
     protocol.robot_socket.in_port = 1150;
     protocol.robot_socket.out_port = 1110;
+    protocol.robot_socket.connect_udp = 1;
     protocol.robot_socket.type = DS_SOCKET_UDP;
 
     /* Define netconsole socket properties */
@@ -0,0 +1,251 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Utils.h"
+
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Use SSE2 on x86 and NEON on ARM, both are always available on the 64-bit
+ * targets (and on 32-bit targets that are built with them enabled)
+ */
+#if defined (__SSE2__) || defined (_M_X64) || \
+    (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define QUANTIZE_SSE2
+    #include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+    #define QUANTIZE_NEON
+    #include <arm_neon.h>
+#endif
+
+/*
+ * Axis values are scaled by 127 (the value of a fully deflected axis), the
+ * product is computed as (value * 128 - value) so that the rounding error
+ * of the subtraction can be recovered exactly, which allows the halfway
+ * cases to be rounded correctly
+ */
+#define AXIS_SHIFT 128.0f
+
+/**
+ * Returns the quantized value of the given axis \a value:
+ *     - The value is clamped to the -1 to 1 range (NaN is treated as 0)
+ *     - The value is scaled to the -127 to 127 range
+ *     - The exact scaled value is rounded to the nearest integer, halfway
+ *       values are rounded away from zero (so that the result is symmetric)
+ *
+ * The vectorized implementations below must produce exactly the same
+ * results as this function.
+ */
+static int8_t quantize_axis (float value)
+{
+    /* Treat NaN as a neutral value */
+    if (value != value)
+        return 0;
+
+    /* Clamp the value */
+    if (value > 1)
+        value = 1;
+    else if (value < -1)
+        value = -1;
+
+    /* Scale the magnitude, the exact product is (high + low) */
+    float magnitude = value < 0 ? -value : value;
+    float shifted = magnitude * AXIS_SHIFT;
+    float high = shifted - magnitude;
+    float low = (shifted - high) - magnitude;
+
+    /* Round the product */
+    int result = (int) high;
+    float fraction = high - (float) result;
+    if (fraction > 0.5f || (fraction == 0.5f && low >= 0))
+        ++result;
+
+    return (int8_t) (value < 0 ? -result : result);
+}
+
+#if defined (QUANTIZE_SSE2)
+
+/**
+ * Quantizes four axis values, the results are returned as 32-bit integers
+ */
+static __m128i quantize_sse2 (__m128 value)
+{
+    const __m128 one = _mm_set1_ps (1);
+    const __m128 half = _mm_set1_ps (0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 shift = _mm_set1_ps (AXIS_SHIFT);
+    const __m128 sign_bit = _mm_set1_ps (-0.0f);
+
+    /* Replace NaN with 0 and clamp the value */
+    value = _mm_and_ps (value, _mm_cmpord_ps (value, value));
+    value = _mm_min_ps (_mm_max_ps (value, _mm_sub_ps (zero, one)), one);
+
+    /* Separate the sign and magnitude of the value */
+    __m128 magnitude = _mm_andnot_ps (sign_bit, value);
+    __m128i sign = _mm_srai_epi32 (_mm_castps_si128 (value), 31);
+
+    /* Scale the magnitude, the exact product is (high + low) */
+    __m128 shifted = _mm_mul_ps (magnitude, shift);
+    __m128 high = _mm_sub_ps (shifted, magnitude);
+    __m128 low = _mm_sub_ps (_mm_sub_ps (shifted, high), magnitude);
+
+    /* Round the product (the comparison mask is -1 when rounding up) */
+    __m128i result = _mm_cvttps_epi32 (high);
+    __m128 fraction = _mm_sub_ps (high, _mm_cvtepi32_ps (result));
+    __m128 round_up = _mm_or_ps (_mm_cmpgt_ps (fraction, half),
+                                 _mm_and_ps (_mm_cmpeq_ps (fraction, half),
+                                             _mm_cmpge_ps (low, zero)));
+    result = _mm_sub_epi32 (result, _mm_castps_si128 (round_up));
+
+    /* Restore the sign */
+    return _mm_sub_epi32 (_mm_xor_si128 (result, sign), sign);
+}
+
+/**
+ * Quantizes the axis values in blocks of 16 values and then in blocks of
+ * 4 values, returns the number of values that were quantized
+ */
+static int quantize_block (const float* in, int8_t* out, const int n)
+{
+    int i;
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a = quantize_sse2 (_mm_loadu_ps (in + i));
+        __m128i b = quantize_sse2 (_mm_loadu_ps (in + i + 4));
+        __m128i c = quantize_sse2 (_mm_loadu_ps (in + i + 8));
+        __m128i d = quantize_sse2 (_mm_loadu_ps (in + i + 12));
+
+        /* Results are within the -127 to 127 range, so packing is exact */
+        __m128i bytes = _mm_packs_epi16 (_mm_packs_epi32 (a, b),
+                                         _mm_packs_epi32 (c, d));
+        _mm_storeu_si128 ((__m128i*) (out + i), bytes);
+    }
+
+    /* Quantize the remaining blocks of 4 values (most joysticks have 6 axes,
+     * so this is the common case) */
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = quantize_sse2 (_mm_loadu_ps (in + i));
+        __m128i words = _mm_packs_epi32 (a, a);
+        int32_t bytes = _mm_cvtsi128_si32 (_mm_packs_epi16 (words, words));
+        memcpy (out + i, &bytes, 4);
+    }
+
+    return i;
+}
+
+#elif defined (QUANTIZE_NEON)
+
+/**
+ * Quantizes four axis values, the results are returned as 32-bit integers
+ */
+static int32x4_t quantize_neon (float32x4_t value)
+{
+    const float32x4_t one = vdupq_n_f32 (1);
+    const float32x4_t half = vdupq_n_f32 (0.5f);
+    const float32x4_t zero = vdupq_n_f32 (0);
+
+    /* Replace NaN with 0 and clamp the value */
+    value = vbslq_f32 (vceqq_f32 (value, value), value, zero);
+    value = vminq_f32 (vmaxq_f32 (value, vnegq_f32 (one)), one);
+
+    /* Scale the magnitude, the exact product is (high + low) */
+    float32x4_t magnitude = vabsq_f32 (value);
+    float32x4_t shifted = vmulq_n_f32 (magnitude, AXIS_SHIFT);
+    float32x4_t high = vsubq_f32 (shifted, magnitude);
+    float32x4_t low = vsubq_f32 (vsubq_f32 (shifted, high), magnitude);
+
+    /* Round the product (the comparison mask is -1 when rounding up) */
+    int32x4_t result = vcvtq_s32_f32 (high);
+    float32x4_t fraction = vsubq_f32 (high, vcvtq_f32_s32 (result));
+    uint32x4_t round_up = vorrq_u32 (vcgtq_f32 (fraction, half),
+                                     vandq_u32 (vceqq_f32 (fraction, half),
+                                                vcgeq_f32 (low, zero)));
+    result = vsubq_s32 (result, vreinterpretq_s32_u32 (round_up));
+
+    /* Restore the sign */
+    return vbslq_s32 (vcltq_f32 (value, zero), vnegq_s32 (result), result);
+}
+
+/**
+ * Quantizes the axis values in blocks of 8 values and then in blocks of
+ * 4 values, returns the number of values that were quantized
+ */
+static int quantize_block (const float* in, int8_t* out, const int n)
+{
+    int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        int32x4_t a = quantize_neon (vld1q_f32 (in + i));
+        int32x4_t b = quantize_neon (vld1q_f32 (in + i + 4));
+
+        /* Results are within the -127 to 127 range, so narrowing is exact */
+        int16x8_t words = vcombine_s16 (vmovn_s32 (a), vmovn_s32 (b));
+        vst1_s8 (out + i, vmovn_s16 (words));
+    }
+
+    /* Quantize the remaining blocks of 4 values (most joysticks have 6 axes,
+     * so this is the common case) */
+    for (; i + 4 <= n; i += 4) {
+        int16x4_t words = vmovn_s32 (quantize_neon (vld1q_f32 (in + i)));
+        int8x8_t narrow = vmovn_s16 (vcombine_s16 (words, words));
+        int32_t bytes = vget_lane_s32 (vreinterpret_s32_s8 (narrow), 0);
+        memcpy (out + i, &bytes, 4);
+    }
+
+    return i;
+}
+
+#else
+
+/**
+ * There is no vectorized implementation for this platform
+ */
+static int quantize_block (const float* in, int8_t* out, const int n)
+{
+    (void) in;
+    (void) out;
+    (void) n;
+
+    return 0;
+}
+
+#endif
+
+/**
+ * Quantizes \a n joystick axis values from \a in (in the -1 to 1 range)
+ * to signed bytes (in the -127 to 127 range) and writes them to \a out.
+ *
+ * Values are clamped and rounded to the nearest integer (halfway values are
+ * rounded away from zero), NaN values are quantized to \c 0. The SIMD and
+ * scalar implementations give identical results.
+ */
+void DS_QuantizeAxes (const float* in, int8_t* out, const int n)
+{
+    /* Check arguments */
+    assert (in);
+    assert (out);
+
+    /* Quantize the values in blocks and then the remaining values */
+    int i;
+    for (i = quantize_block (in, out, n); i < n; ++i)
+        out [i] = quantize_axis (in [i]);
+}
@@ -23,145 +23,285 @@
 
 #include "DS_Utils.h"
 #include "DS_Queue.h"
+#include "DS_Timer.h"
+#include "DS_Atomic.h"
 
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define DATA_OFFSET 16   /* Offset of the item data inside each cell */
+#define BLOCK_WAIT  10   /* Re-check a full queue every 10 milliseconds */
+#define SPIN_COUNT  128  /* Push attempts before waiting for a consumer */
+
 /**
- * Removes the first item in the given \a queue
+ * Returns a pointer to the cell that corresponds to the given \a position
+ */
+static char* get_cell (DS_Queue* queue, const uint32_t position)
+{
+    return queue->cells + (size_t) (position & queue->mask) * queue->stride;
+}
+
+/**
+ * Returns a pointer to the sequence number of the given \a cell
+ */
+static volatile uint32_t* get_sequence (char* cell)
+{
+    return (volatile uint32_t*) cell;
+}
+
+/**
+ * Copies \a item to the next free cell of the \a queue
  *
- * \param queue the queue in which to operate
- * \returns \c 1 on success, \c 0 on failure
+ * \returns \c 1 on success, \c 0 if the queue is full
  */
-extern int DS_QueuePop (DS_Queue* queue)
+static int try_push (DS_Queue* queue, const void* item)
 {
-    /* Check arguments */
-    assert (queue);
+    char* cell;
+    uint32_t pos = DS_AtomicLoad (&queue->enqueue_pos);
 
-    /* There are no items on the queue */
-    if (queue->count <= 0)
-        return 0;
+    /* Reserve a cell */
+    for (;;) {
+        cell = get_cell (queue, pos);
+        int32_t diff = (int32_t) (DS_AtomicLoad (get_sequence (cell)) - pos);
 
-    /* Update queue properties */
-    --queue->count;
-    ++queue->front;
+        if (diff == 0) {
+            if (DS_AtomicCompareExchange (&queue->enqueue_pos, &pos, pos + 1))
+                break;
+        }
 
-    /* This is a circular queue, go back to the beginning */
-    if (queue->front >= queue->capacity)
-        queue->front = 0;
+        else if (diff < 0)
+            return 0;
+
+        else
+            pos = DS_AtomicLoad (&queue->enqueue_pos);
+    }
 
+    /* Copy the item and publish the cell */
+    memcpy (cell + DATA_OFFSET, item, queue->item_size);
+    DS_AtomicStore (get_sequence (cell), pos + 1);
     return 1;
 }
 
 /**
- * Resets the properties of the given \a queue and de-allocates the memory
- * used by the queue's elements
+ * Copies the oldest item of the \a queue to \a item (if \a item is not
+ * \c NULL) and releases its cell
  *
- * \param queue the queue to destroy
+ * \returns \c 1 on success, \c 0 if the queue is empty
  */
-extern void DS_QueueFree (DS_Queue* queue)
+static int try_pop (DS_Queue* queue, void* item)
+{
+    char* cell;
+    uint32_t pos = DS_AtomicLoad (&queue->dequeue_pos);
+
+    /* Reserve a cell */
+    for (;;) {
+        cell = get_cell (queue, pos);
+        int32_t diff = (int32_t) (DS_AtomicLoad (get_sequence (cell)) - (pos + 1));
+
+        if (diff == 0) {
+            if (DS_AtomicCompareExchange (&queue->dequeue_pos, &pos, pos + 1))
+                break;
+        }
+
+        else if (diff < 0)
+            return 0;
+
+        else
+            pos = DS_AtomicLoad (&queue->dequeue_pos);
+    }
+
+    /* Copy the item and release the cell for the next lap */
+    if (item)
+        memcpy (item, cell + DATA_OFFSET, queue->item_size);
+
+    DS_AtomicStore (get_sequence (cell), pos + queue->mask + 1);
+    return 1;
+}
+
+/**
+ * Copies \a item to the \a queue, waiting until a consumer pops an item if
+ * the queue is full. The producer registers itself as a waiter before
+ * retrying under the lock, so that the consumers cannot miss it.
+ */
+static void push_blocking (DS_Queue* queue, const void* item)
+{
+    /* Retry for a while before sleeping */
+    int i;
+    for (i = 0; i < SPIN_COUNT; ++i) {
+        if (try_push (queue, item))
+            return;
+    }
+
+    /* Sleep until a consumer pops an item */
+    DS_AtomicAdd (&queue->waiters, 1);
+    pthread_mutex_lock (&queue->lock);
+    while (!try_push (queue, item)) {
+        DS_CondWaitUntil (&queue->not_full, &queue->lock,
+                          DS_GetMonotonicTime() + BLOCK_WAIT * 1000000ULL);
+    }
+    pthread_mutex_unlock (&queue->lock);
+    DS_AtomicAdd (&queue->waiters, (uint32_t) -1);
+}
+
+/**
+ * Copies the oldest item of the given \a queue to \a item and removes it
+ * from the queue. This function is safe to call from several threads.
+ *
+ * \param queue the queue in which to operate
+ * \param item the buffer in which to copy the item
+ * \returns \c 1 on success, \c 0 if the queue is empty
+ */
+int DS_QueuePop (DS_Queue* queue, void* item)
 {
     /* Check arguments */
     assert (queue);
+    assert (item);
 
-    /* Free all the items in the queue */
-    int element;
-    for (element = 0; element < queue->capacity; ++element)
-        DS_FREE (queue->buffer [element]);
+    /* Queue is empty */
+    if (!try_pop (queue, item))
+        return 0;
 
-    /* Delete the buffer */
-    DS_FREE (queue->buffer);
+    /* Wake up blocked producers once half of the queue is free */
+    if (DS_AtomicLoad (&queue->waiters) > 0) {
+        uint32_t used = DS_AtomicLoad (&queue->enqueue_pos) -
+                        DS_AtomicLoad (&queue->dequeue_pos);
 
-    /* Reset queue properties */
-    queue->rear = -1;
-    queue->count = 0;
-    queue->front = 0;
-    queue->capacity = 0;
-    queue->item_size = 0;
+        if (used <= (queue->mask + 1) / 2) {
+            pthread_mutex_lock (&queue->lock);
+            pthread_cond_broadcast (&queue->not_full);
+            pthread_mutex_unlock (&queue->lock);
+        }
+    }
+
+    return 1;
 }
 
 /**
- * Returns the first elemenent of the given \a queue
+ * Resets the properties of the given \a queue and de-allocates the memory
+ * used by the queue's cells
  *
- * \param queue the queue from which to get the first item_size
- * \returns the first element of the given \a queue, on failure, this
- *          function shall return a \c NULL pointer
+ * \param queue the queue to destroy
  */
-void* DS_QueueGetFirst (DS_Queue* queue)
+void DS_QueueFree (DS_Queue* queue)
 {
     /* Check arguments */
     assert (queue);
 
-    /* There are no items on the queue */
-    if (queue->count <= 0)
-        return NULL;
+    /* Delete the cells */
+    DS_FREE (queue->memory);
+
+    /* Delete the synchronization objects */
+    pthread_cond_destroy (&queue->not_full);
+    pthread_mutex_destroy (&queue->lock);
 
-    /* Get the first item in the list */
-    assert (queue->buffer);
-    return (void*) queue->buffer [queue->front];
+    /* Reset queue properties */
+    queue->mask = 0;
+    queue->stride = 0;
+    queue->cells = NULL;
+    queue->item_size = 0;
+    queue->enqueue_pos = 0;
+    queue->dequeue_pos = 0;
 }
 
 /**
- * Adds the given \a item to the \a queue in a circular fashion
+ * Copies the given \a item to the end of the \a queue. This function is safe
+ * to call from several threads. If the queue is full, the item is added
+ * after discarding the oldest item or after waiting for a consumer,
+ * depending on the policy of the queue.
  *
  * \param queue the queue in which to operate
- * \param item the item to add, to avoid potential errors, the pointer data
- *        is duplicated by this function
+ * \param item the item to add, the data is copied by this function
+ * \returns \c 1 if the item was added, \c 0 otherwise
  */
-void DS_QueuePush (DS_Queue* queue, void* item)
+int DS_QueuePush (DS_Queue* queue, const void* item)
 {
     /* Check arguments */
     assert (queue);
+    assert (item);
+
+    /* Queue is not initialized */
+    if (!queue->cells)
+        return 0;
 
-    /* Queue is full, expand it */
-    if (queue->count >= queue->capacity) {
-        queue->capacity *= 2;
-        queue->buffer = (void**) realloc (queue->buffer,
-                                          queue->capacity * queue->item_size);
+    /* Fast path, there is room for the item */
+    if (try_push (queue, item))
+        return 1;
 
-        int i;
-        for (i = queue->count; i < queue->capacity; ++i)
-            queue->buffer [i] = (void**) malloc (queue->item_size);
+    /* Wait for a consumer */
+    if (queue->policy == DS_QUEUE_BLOCK) {
+        push_blocking (queue, item);
+        return 1;
     }
 
-    /* Update queue properties */
-    ++queue->rear;
-    ++queue->count;
+    /* Discard the oldest items until there is room for the item */
+    while (!try_push (queue, item)) {
+        if (try_pop (queue, NULL))
+            DS_AtomicAdd (&queue->dropped, 1);
+    }
 
-    /* Front item should be somewhere in the middle by now */
-    if (queue->rear >= queue->capacity)
-        queue->rear = 0;
+    return 1;
+}
 
-    /* Since we don't want to depend on potential idiots, copy the data */
-    assert (queue->buffer);
-    memcpy (queue->buffer [queue->rear], item, queue->item_size);
+/**
+ * Returns the number of items that were discarded because the given
+ * \a queue was full
+ */
+unsigned int DS_QueueDropped (DS_Queue* queue)
+{
+    assert (queue);
+    return DS_AtomicLoad (&queue->dropped);
 }
 
 /**
  * Initializes the given queue and allocates memory for its elements
  *
  * \param queue the queue to initialize
- * \param initial_count the initial number of elements of the queue
+ * \param capacity the number of elements of the queue (rounded up to the
+ *        next power of two)
  * \param item_size the size to use for each inidividual element of the queue
+ * \param policy the behavior of the queue when an item is pushed and the
+ *        queue is full
  */
-void DS_QueueInit (DS_Queue* queue, int initial_count, int item_size)
+void DS_QueueInit (DS_Queue* queue, int capacity, int item_size,
+                   DS_QueuePolicy policy)
 {
-    /* Set initial navitation values */
-    queue->rear = -1;
-    queue->count = 0;
-    queue->front = 0;
+    /* Check arguments */
+    assert (queue);
+    assert (capacity > 0);
+    assert (item_size > 0);
+
+    /* Round the capacity to a power of two */
+    uint32_t cells = 2;
+    while (cells < (uint32_t) capacity)
+        cells *= 2;
 
     /* Set queue properties */
-    queue->item_size = item_size;
-    queue->capacity = initial_count;
+    queue->dropped = 0;
+    queue->waiters = 0;
+    queue->policy = policy;
+    queue->mask = cells - 1;
+    queue->enqueue_pos = 0;
+    queue->dequeue_pos = 0;
+    queue->item_size = (size_t) item_size;
+
+    /* Each cell starts in a cache line boundary */
+    queue->stride = DATA_OFFSET + queue->item_size;
+    queue->stride = (queue->stride + DS_CACHE_LINE - 1) & ~ ((size_t) DS_CACHE_LINE - 1);
+
+    /* Allocate the cells and align them */
+    queue->memory = malloc (cells * queue->stride + DS_CACHE_LINE);
+    assert (queue->memory);
+    queue->cells = (char*) (((uintptr_t) queue->memory + DS_CACHE_LINE - 1) &
+                            ~ ((uintptr_t) DS_CACHE_LINE - 1));
 
-    /* Initialize the pointer list */
-    queue->buffer = (void**) calloc (initial_count, initial_count * item_size);
+    /* Initialize the sequence number of each cell */
+    uint32_t i;
+    for (i = 0; i < cells; ++i)
+        *get_sequence (get_cell (queue, i)) = i;
 
-    /* Initialize each item in the list */
-    int item;
-    for (item = 0; item < initial_count; ++item)
-        queue->buffer [item] = malloc (item_size);
+    /* Initialize the synchronization objects */
+    DS_CondInit (&queue->not_full);
+    pthread_mutex_init (&queue->lock, NULL);
 }
@@ -0,0 +1,414 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Utils.h"
+#include "DS_Queue.h"
+#include "DS_Timer.h"
+#include "DS_Atomic.h"
+#include "DS_Recorder.h"
+#include "DS_Joysticks.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * Size of the stdio buffer of the recording file, number of records that
+ * the queue can hold, number of records that are written or read at once
+ * and time (in milliseconds) that the writer waits when the queue is empty
+ * (unless it is woken up by a joystick function that found the queue half
+ * full)
+ */
+#define WRITE_BUFFER_SIZE 65536
+#define QUEUE_SIZE        4096
+#define BATCH_SIZE        256
+#define WRITE_INTERVAL    10
+
+/*
+ * The joystick functions push their records to a lock-free queue (while
+ * they hold the joysticks lock, so that the records keep the order of the
+ * calls), and the writer thread appends them to the recording file. No
+ * file I/O is done by the joystick functions.
+ *
+ * The recording flag allows the joystick functions to skip the queue when
+ * nothing is being recorded, the producer counter allows the recording to
+ * be stopped once no joystick function is pushing a record. The record
+ * lock serializes the start and stop of the recordings, and the writer
+ * lock is only used to wait for (or to wake up) the writer thread.
+ */
+static FILE* file = NULL;
+static DS_Queue records;
+static pthread_t writer_thread;
+static uint64_t start_time = 0;
+static volatile uint32_t producers = 0;
+static volatile uint32_t recording = 0;
+static volatile uint32_t writer_running = 0;
+static char write_buffer [WRITE_BUFFER_SIZE];
+static pthread_cond_t writer_cond;
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Converts the given joystick, axis, hat or button \a number to a record
+ * field, numbers that do not fit are replaced with a number that is always
+ * invalid (so that the replayed call is ignored, like the original call)
+ */
+static uint8_t to_field (const int number)
+{
+    return (number < 0 || number > 0xFF) ? 0xFF : (uint8_t) number;
+}
+
+/**
+ * Converts the given joystick input \a count to a record field, the count
+ * is clamped in the same way as \c DS_JoysticksAdd() does it
+ */
+static uint8_t to_count (const int count)
+{
+    return (uint8_t) DS_Min (DS_Max (count, 0), 0xFF);
+}
+
+/**
+ * Wakes up the writer thread, so that it empties the queue now
+ */
+static void wake_writer (void)
+{
+    pthread_mutex_lock (&writer_lock);
+    pthread_cond_signal (&writer_cond);
+    pthread_mutex_unlock (&writer_lock);
+}
+
+/**
+ * Timestamps the given \a record and pushes it to the record queue, the
+ * caller waits only if the writer thread has fallen behind by a full queue
+ */
+static void queue_record (DS_JoystickRecord* record)
+{
+    DS_AtomicAdd (&producers, 1);
+    DS_AtomicFence();
+
+    if (DS_AtomicLoad (&recording)) {
+        record->time = DS_GetMonotonicTime() - start_time;
+        record->reserved = 0;
+        DS_QueuePush (&records, record);
+
+        /* Do not wait for the writer to wake up by itself */
+        uint32_t queued = DS_AtomicLoad (&records.enqueue_pos) -
+                          DS_AtomicLoad (&records.dequeue_pos);
+        if (queued >= QUEUE_SIZE / 2)
+            wake_writer();
+    }
+
+    DS_AtomicAdd (&producers, (uint32_t) -1);
+}
+
+/**
+ * Appends the queued records to the recording file in batches, until the
+ * recording is stopped and the queue is empty
+ */
+static void* run_writer (void* ptr)
+{
+    (void) ptr;
+    DS_JoystickRecord batch [BATCH_SIZE];
+
+    while (1) {
+        /* Read the flag first, so that the last records are not missed */
+        int stopping = !DS_AtomicLoad (&writer_running);
+
+        size_t count = 0;
+        while (count < BATCH_SIZE && DS_QueuePop (&records, &batch [count]))
+            ++count;
+
+        if (count > 0)
+            fwrite (batch, sizeof (DS_JoystickRecord), count, file);
+        else if (stopping)
+            break;
+        else {
+            uint64_t deadline = DS_GetMonotonicTime() +
+                                (uint64_t) WRITE_INTERVAL * 1000000;
+            pthread_mutex_lock (&writer_lock);
+            DS_CondWaitUntil (&writer_cond, &writer_lock, deadline);
+            pthread_mutex_unlock (&writer_lock);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Applies the given \a record to the joysticks
+ */
+static void replay_record (const DS_JoystickRecord* record)
+{
+    switch (record->type) {
+    case DS_RECORD_ADD:
+        DS_JoysticksAdd (record->joystick, record->index, record->value.integer);
+        break;
+    case DS_RECORD_RESET:
+        DS_JoysticksReset();
+        break;
+    case DS_RECORD_AXIS:
+        DS_SetJoystickAxis (record->joystick, record->index, record->value.axis);
+        break;
+    case DS_RECORD_HAT:
+        DS_SetJoystickHat (record->joystick, record->index, record->value.integer);
+        break;
+    case DS_RECORD_BUTTON:
+        DS_SetJoystickButton (record->joystick, record->index,
+                              record->value.integer);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Stops recording the joystick calls
+ */
+void Recorder_Close (void)
+{
+    DS_StopJoystickRecording();
+}
+
+/**
+ * Records a \c DS_JoysticksReset() call
+ */
+void Recorder_Reset (void)
+{
+    if (DS_AtomicLoad (&recording)) {
+        DS_JoystickRecord record;
+        memset (&record, 0, sizeof (record));
+        record.type = DS_RECORD_RESET;
+        queue_record (&record);
+    }
+}
+
+/**
+ * Records a \c DS_JoysticksAdd() call
+ */
+void Recorder_Add (const int axes, const int hats, const int buttons)
+{
+    if (DS_AtomicLoad (&recording)) {
+        DS_JoystickRecord record;
+        record.type = DS_RECORD_ADD;
+        record.joystick = to_count (axes);
+        record.index = to_count (hats);
+        record.value.integer = to_count (buttons);
+        queue_record (&record);
+    }
+}
+
+/**
+ * Records a \c DS_SetJoystickHat() call
+ */
+void Recorder_Hat (const int joystick, const int hat, const int angle)
+{
+    if (DS_AtomicLoad (&recording)) {
+        DS_JoystickRecord record;
+        record.type = DS_RECORD_HAT;
+        record.joystick = to_field (joystick);
+        record.index = to_field (hat);
+        record.value.integer = angle;
+        queue_record (&record);
+    }
+}
+
+/**
+ * Records a \c DS_SetJoystickAxis() call
+ */
+void Recorder_Axis (const int joystick, const int axis, const float value)
+{
+    if (DS_AtomicLoad (&recording)) {
+        DS_JoystickRecord record;
+        record.type = DS_RECORD_AXIS;
+        record.joystick = to_field (joystick);
+        record.index = to_field (axis);
+        record.value.axis = value;
+        queue_record (&record);
+    }
+}
+
+/**
+ * Records a \c DS_SetJoystickButton() call
+ */
+void Recorder_Button (const int joystick, const int button, const int pressed)
+{
+    if (DS_AtomicLoad (&recording)) {
+        DS_JoystickRecord record;
+        record.type = DS_RECORD_BUTTON;
+        record.joystick = to_field (joystick);
+        record.index = to_field (button);
+        record.value.integer = pressed;
+        queue_record (&record);
+    }
+}
+
+/**
+ * Starts recording every joystick registration, reset and value update
+ * (including the updates that do not change any value) to the file at
+ * the given \a path, which is replaced if it already exists.
+ *
+ * Each call is queued as a fixed-size record with its monotonic timestamp,
+ * and a background thread writes the records to the file in large blocks,
+ * so recording long sessions has a negligible overhead.
+ *
+ * \returns \c 1 on success, \c 0 if the file cannot be created
+ */
+int DS_RecordJoysticks (const char* path)
+{
+    /* Check arguments */
+    assert (path);
+
+    /* Stop the previous recording */
+    DS_StopJoystickRecording();
+
+    /* Create the file */
+    FILE* output = fopen (path, "wb");
+    if (!output)
+        return 0;
+
+    /* Write the file header */
+    DS_RecordingHeader header;
+    memset (&header, 0, sizeof (header));
+    header.magic = DS_RECORDING_MAGIC;
+    header.version = DS_RECORDING_VERSION;
+    header.record_size = sizeof (DS_JoystickRecord);
+    header.start_time = DS_GetMonotonicTime();
+    setvbuf (output, write_buffer, _IOFBF, sizeof (write_buffer));
+    if (fwrite (&header, sizeof (header), 1, output) != 1) {
+        fclose (output);
+        return 0;
+    }
+
+    /* Start the writer thread */
+    pthread_mutex_lock (&record_lock);
+    file = output;
+    start_time = header.start_time;
+    DS_CondInit (&writer_cond);
+    DS_QueueInit (&records, QUEUE_SIZE, sizeof (DS_JoystickRecord),
+                  DS_QUEUE_BLOCK);
+    DS_AtomicStore (&writer_running, 1);
+    if (pthread_create (&writer_thread, NULL, &run_writer, NULL) != 0) {
+        DS_AtomicStore (&writer_running, 0);
+        DS_QueueFree (&records);
+        pthread_cond_destroy (&writer_cond);
+        fclose (file);
+        file = NULL;
+        pthread_mutex_unlock (&record_lock);
+        return 0;
+    }
+
+    /* Start recording */
+    DS_AtomicStore (&recording, 1);
+    pthread_mutex_unlock (&record_lock);
+
+    return 1;
+}
+
+/**
+ * Stops recording the joystick calls, writes the queued records and closes
+ * the recording file
+ */
+void DS_StopJoystickRecording (void)
+{
+    pthread_mutex_lock (&record_lock);
+
+    /* Nothing is being recorded */
+    if (!file) {
+        pthread_mutex_unlock (&record_lock);
+        return;
+    }
+
+    /* Wait for the joystick functions that are pushing a record */
+    DS_AtomicExchange (&recording, 0);
+    DS_AtomicFence();
+    while (DS_AtomicLoad (&producers) > 0)
+        DS_Sleep (1);
+
+    /* Let the writer thread write the remaining records */
+    DS_AtomicStore (&writer_running, 0);
+    wake_writer();
+    pthread_join (writer_thread, NULL);
+
+    /* Close the file */
+    DS_QueueFree (&records);
+    pthread_cond_destroy (&writer_cond);
+    fclose (file);
+    file = NULL;
+
+    pthread_mutex_unlock (&record_lock);
+}
+
+/**
+ * Replays the joystick calls recorded in the file at the given \a path,
+ * if \a realtime is set to \c 1, the calls are made with their original
+ * timing (relative to the start of the replay), otherwise they are made
+ * as fast as possible. The replay runs in the calling thread.
+ *
+ * A truncated record at the end of the file (e.g. if the recording process
+ * crashed) is ignored, as are records of unknown types.
+ *
+ * \returns the number of replayed records, or \c -1 if the file cannot be
+ *          opened or is not a valid recording
+ */
+long DS_ReplayJoysticks (const char* path, const int realtime)
+{
+    /* Check arguments */
+    assert (path);
+
+    /* Open the file */
+    FILE* input = fopen (path, "rb");
+    if (!input)
+        return -1;
+
+    /* Validate the file header */
+    DS_RecordingHeader header;
+    if (fread (&header, sizeof (header), 1, input) != 1 ||
+        header.magic != DS_RECORDING_MAGIC ||
+        header.version != DS_RECORDING_VERSION ||
+        header.record_size != sizeof (DS_JoystickRecord)) {
+        fclose (input);
+        return -1;
+    }
+
+    /* Replay the records in batches */
+    long count = 0;
+    size_t read = 0;
+    uint64_t start = DS_GetMonotonicTime();
+    DS_JoystickRecord batch [BATCH_SIZE];
+    while ((read = fread (batch, sizeof (DS_JoystickRecord),
+                          BATCH_SIZE, input)) > 0) {
+        size_t i;
+        for (i = 0; i < read; ++i) {
+            if (realtime)
+                DS_SleepUntil (start + batch [i].time);
+
+            replay_record (&batch [i]);
+        }
+
+        count += (long) read;
+    }
+
+    fclose (input);
+    return count;
+}
@@ -0,0 +1,477 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Shm.h"
+#include "DS_Utils.h"
+#include "DS_Timer.h"
+#include "DS_Atomic.h"
+#include "DS_Events.h"
+#include "DS_Protocol.h"
+#include "DS_Joysticks.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #define SHM_SUPPORTED
+#endif
+
+/*
+ * Interval (in milliseconds) at which the link statistics and the joystick
+ * values are exported, the robot state is exported as soon as it changes
+ */
+#define PUBLISH_INTERVAL 20
+
+/*
+ * Exported segment (NULL if the segment is not being exported)
+ */
+static char segment_name [64];
+static DS_Timer publish_timer;
+static DS_ShmSegment* segment = NULL;
+static volatile uint32_t exporting = 0;
+static pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Returns the value of the given \a counter of a (possibly read-only)
+ * segment
+ */
+static uint32_t load_counter (const volatile uint32_t* counter)
+{
+    return DS_AtomicLoad ((volatile uint32_t*) counter);
+}
+
+/**
+ * Copies the values of the registered joysticks to the given \a state
+ */
+static void get_joysticks (DS_ShmState* state)
+{
+    int i, j;
+
+    int count = DS_GetJoystickCount();
+    state->joystick_count = DS_Min (count, DS_SHM_MAX_JOYSTICKS);
+    for (i = 0; i < state->joystick_count; ++i) {
+        int axes = DS_GetJoystickNumAxes (i);
+        int hats = DS_GetJoystickNumHats (i);
+        int buttons = DS_GetJoystickNumButtons (i);
+
+        DS_ShmJoystick* stick = &state->joysticks [i];
+        stick->num_axes = DS_Min (axes, DS_SHM_MAX_AXES);
+        stick->num_hats = DS_Min (hats, DS_SHM_MAX_HATS);
+        stick->num_buttons = DS_Min (buttons, DS_SHM_MAX_BUTTONS);
+
+        for (j = 0; j < stick->num_axes; ++j)
+            stick->axes [j] = DS_GetJoystickAxis (i, j);
+
+        for (j = 0; j < stick->num_hats; ++j)
+            stick->hats [j] = DS_GetJoystickHat (i, j);
+
+        stick->buttons = 0;
+        for (j = 0; j < stick->num_buttons; ++j) {
+            if (DS_GetJoystickButton (i, j))
+                stick->buttons |= (1u << j);
+        }
+    }
+}
+
+/**
+ * Returns \c 1 if the given \a state differs from the exported state
+ * (ignoring its generation and timestamp)
+ *
+ * \note The caller must hold the publish lock
+ */
+static int changed (const DS_ShmState* state)
+{
+    size_t offset = offsetof (DS_ShmState, robot);
+    return memcmp ((const char*) state + offset,
+                   (const char*) &segment->state + offset,
+                   sizeof (DS_ShmState) - offset) != 0;
+}
+
+/**
+ * Copies the current DS state to the segment. The state is gathered before
+ * locking the seqlock, so that readers retry as little as possible.
+ */
+static void publish_state (void)
+{
+    DS_ShmState state;
+    memset (&state, 0, sizeof (state));
+
+    /* Gather the state */
+    state.timestamp = DS_GetMonotonicTime();
+    DS_GetStateSnapshot (&state.robot);
+    DS_GetRobotLinkStats (&state.link);
+    get_joysticks (&state);
+
+    pthread_mutex_lock (&publish_lock);
+    if (segment && changed (&state)) {
+        /* Mark the state as being written */
+        uint32_t sequence = segment->sequence + 1;
+        DS_AtomicStore (&segment->sequence, sequence);
+        DS_AtomicFence();
+
+        /* Copy the state */
+        state.generation = (sequence + 1) / 2;
+        memcpy (&segment->state, &state, sizeof (DS_ShmState));
+
+        /* Mark the state as written */
+        DS_AtomicStore (&segment->sequence, sequence + 1);
+    }
+    pthread_mutex_unlock (&publish_lock);
+}
+
+/**
+ * Appends the given NetConsole message to the ring of the segment
+ */
+static void publish_line (const char* text, const uint64_t timestamp)
+{
+    pthread_mutex_lock (&publish_lock);
+    if (segment) {
+        uint32_t number = segment->lines;
+        DS_ShmLine* line = &segment->console [number % DS_SHM_CONSOLE_LINES];
+
+        /* Mark the slot as being written */
+        DS_AtomicStore (&line->sequence, 2 * number + 1);
+        DS_AtomicFence();
+
+        /* Copy the message */
+        line->timestamp = timestamp;
+        snprintf (line->text, sizeof (line->text), "%s", text ? text : "");
+
+        /* Mark the slot as written and publish the message */
+        DS_AtomicStore (&line->sequence, 2 * number + 2);
+        DS_AtomicStore (&segment->lines, number + 1);
+    }
+    pthread_mutex_unlock (&publish_lock);
+}
+
+/**
+ * Exports new NetConsole messages
+ */
+static void on_event (const DS_Event* event, void* data)
+{
+    (void) data;
+
+    if (event->type == DS_NETCONSOLE_NEW_MESSAGE)
+        publish_line (event->netconsole.message, event->header.timestamp);
+}
+
+/**
+ * Periodically exports the link statistics and the joystick values
+ */
+static void on_timer_expired (DS_Timer* timer)
+{
+    (void) timer;
+    publish_state();
+}
+
+/**
+ * Stops exporting the segment
+ */
+void Shm_Close (void)
+{
+    DS_ShmStopExport();
+}
+
+/**
+ * Exports the current robot state, which is called by the config module
+ * every time that the state snapshot changes
+ */
+void Shm_PublishState (void)
+{
+    if (DS_AtomicLoad (&exporting))
+        publish_state();
+}
+
+/**
+ * Creates (or replaces) a POSIX shared memory segment with the given
+ * \a name (\c DS_SHM_NAME if \c NULL) and starts exporting the robot state,
+ * the robot link statistics, the joystick values and the NetConsole
+ * messages to it. Other local processes can read the segment with the
+ * \c DS_ShmAttach() and \c DS_ShmRead*() functions, without any system
+ * calls per read.
+ *
+ * This function must be called after \c DS_Init(), the segment is removed
+ * when \c DS_ShmStopExport() or \c DS_Close() are called.
+ *
+ * \returns \c 1 on success, \c 0 on failure (or if the platform does not
+ *          support POSIX shared memory)
+ */
+int DS_ShmExport (const char* name)
+{
+#ifdef SHM_SUPPORTED
+    /* Stop exporting the previous segment */
+    DS_ShmStopExport();
+
+    /* Get the segment name */
+    if (!name)
+        name = DS_SHM_NAME;
+
+    /* Create the segment */
+    int fd = shm_open (name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        return 0;
+
+    /* Resize the segment */
+    if (ftruncate (fd, sizeof (DS_ShmSegment)) != 0) {
+        close (fd);
+        shm_unlink (name);
+        return 0;
+    }
+
+    /* Map the segment (the descriptor is no longer needed) */
+    void* ptr = mmap (NULL, sizeof (DS_ShmSegment), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close (fd);
+    if (ptr == MAP_FAILED) {
+        shm_unlink (name);
+        return 0;
+    }
+
+    /* Initialize the segment, the magic number is written last */
+    DS_ShmSegment* shm = (DS_ShmSegment*) ptr;
+    memset (shm, 0, sizeof (DS_ShmSegment));
+    shm->version = DS_SHM_VERSION;
+    shm->size = sizeof (DS_ShmSegment);
+    DS_AtomicFence();
+    shm->magic = DS_SHM_MAGIC;
+
+    /* Register the segment */
+    pthread_mutex_lock (&publish_lock);
+    segment = shm;
+    snprintf (segment_name, sizeof (segment_name), "%s", name);
+    pthread_mutex_unlock (&publish_lock);
+
+    /* Export the current state and start exporting changes */
+    DS_AtomicStore (&exporting, 1);
+    publish_state();
+    DS_Subscribe (DS_EVENT_MASK (DS_NETCONSOLE_NEW_MESSAGE), &on_event, NULL);
+
+    /* Start the periodic export */
+    DS_TimerInit (&publish_timer, PUBLISH_INTERVAL, 0);
+    DS_TimerSetCallback (&publish_timer, &on_timer_expired, NULL);
+    publish_timer.periodic = 1;
+    DS_TimerStart (&publish_timer);
+
+    return 1;
+#else
+    (void) name;
+    return 0;
+#endif
+}
+
+/**
+ * Stops exporting and removes the shared memory segment
+ */
+void DS_ShmStopExport (void)
+{
+#ifdef SHM_SUPPORTED
+    /* Stop the exporters */
+    DS_AtomicStore (&exporting, 0);
+    DS_Unsubscribe (&on_event, NULL);
+    if (publish_timer.initialized)
+        DS_TimerStop (&publish_timer);
+
+    /* Unregister the segment */
+    pthread_mutex_lock (&publish_lock);
+    DS_ShmSegment* shm = segment;
+    segment = NULL;
+    pthread_mutex_unlock (&publish_lock);
+
+    /* Remove the segment */
+    if (shm) {
+        munmap (shm, sizeof (DS_ShmSegment));
+        shm_unlink (segment_name);
+    }
+#endif
+}
+
+/**
+ * Opens the shared memory segment with the given \a name (\c DS_SHM_NAME if
+ * \c NULL), which is exported by another process with \c DS_ShmExport().
+ * The library does not need to be initialized to read a segment.
+ *
+ * \returns \c 1 on success, \c 0 if the segment does not exist or if its
+ *          layout does not match the layout of this version of LibDS
+ */
+int DS_ShmAttach (DS_ShmReader* reader, const char* name)
+{
+    assert (reader);
+
+    reader->fd = -1;
+    reader->next_line = 0;
+    reader->segment = NULL;
+
+#ifdef SHM_SUPPORTED
+    /* Get the segment name */
+    if (!name)
+        name = DS_SHM_NAME;
+
+    /* Open the segment */
+    int fd = shm_open (name, O_RDONLY, 0);
+    if (fd < 0)
+        return 0;
+
+    /* Check the segment size */
+    struct stat info;
+    if (fstat (fd, &info) != 0 || info.st_size < (off_t) sizeof (DS_ShmSegment)) {
+        close (fd);
+        return 0;
+    }
+
+    /* Map the segment */
+    void* ptr = mmap (NULL, sizeof (DS_ShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        close (fd);
+        return 0;
+    }
+
+    /* Check the segment layout */
+    const DS_ShmSegment* shm = (const DS_ShmSegment*) ptr;
+    if (shm->magic != DS_SHM_MAGIC || shm->version != DS_SHM_VERSION ||
+        shm->size != sizeof (DS_ShmSegment)) {
+        munmap (ptr, sizeof (DS_ShmSegment));
+        close (fd);
+        return 0;
+    }
+
+    /* Start with the oldest message that is still stored */
+    uint32_t lines = load_counter (&shm->lines);
+    if (lines > DS_SHM_CONSOLE_LINES)
+        reader->next_line = lines - DS_SHM_CONSOLE_LINES;
+
+    reader->fd = fd;
+    reader->segment = shm;
+    return 1;
+#else
+    (void) name;
+    return 0;
+#endif
+}
+
+/**
+ * Closes the segment opened by the given \a reader
+ */
+void DS_ShmDetach (DS_ShmReader* reader)
+{
+    assert (reader);
+
+#ifdef SHM_SUPPORTED
+    if (reader->segment)
+        munmap ((void*) reader->segment, sizeof (DS_ShmSegment));
+
+    if (reader->fd >= 0)
+        close (reader->fd);
+#endif
+
+    reader->fd = -1;
+    reader->segment = NULL;
+}
+
+/**
+ * Returns the generation of the exported state, readers can compare it with
+ * the generation of their last copy to skip unchanged states
+ */
+uint32_t DS_ShmGeneration (const DS_ShmReader* reader)
+{
+    assert (reader);
+    assert (reader->segment);
+
+    return (load_counter (&reader->segment->sequence) + 1) / 2;
+}
+
+/**
+ * Copies a consistent snapshot of the exported state to the given \a state,
+ * the copy is retried if the state was updated while it was being copied
+ */
+void DS_ShmReadState (const DS_ShmReader* reader, DS_ShmState* state)
+{
+    uint32_t before, after;
+
+    assert (state);
+    assert (reader);
+    assert (reader->segment);
+
+    do {
+        before = load_counter (&reader->segment->sequence);
+        memcpy (state, &reader->segment->state, sizeof (DS_ShmState));
+        DS_AtomicFence();
+        after = load_counter (&reader->segment->sequence);
+    } while ((before & 1) || before != after);
+}
+
+/**
+ * Copies the next unread NetConsole message to the given \a buffer, and its
+ * receive time to \a timestamp (if not \c NULL). Messages that were
+ * overwritten before being read are skipped.
+ *
+ * \returns \c 1 if a message was read, \c 0 if there are no new messages
+ */
+int DS_ShmReadLine (DS_ShmReader* reader, char* buffer, const size_t length,
+                    uint64_t* timestamp)
+{
+    assert (reader);
+    assert (buffer);
+    assert (length > 0);
+    assert (reader->segment);
+
+    DS_ShmLine copy;
+    const DS_ShmSegment* shm = reader->segment;
+    uint32_t lines = load_counter (&shm->lines);
+
+    while (reader->next_line != lines) {
+        /* Skip the messages that have been overwritten */
+        if (lines - reader->next_line > DS_SHM_CONSOLE_LINES)
+            reader->next_line = lines - DS_SHM_CONSOLE_LINES;
+
+        /* Copy the message */
+        uint32_t number = reader->next_line++;
+        uint32_t expected = 2 * number + 2;
+        const DS_ShmLine* line = &shm->console [number % DS_SHM_CONSOLE_LINES];
+        if (load_counter (&line->sequence) != expected)
+            continue;
+
+        memcpy (&copy, line, sizeof (DS_ShmLine));
+        DS_AtomicFence();
+
+        /* The message was overwritten while we were copying it */
+        if (load_counter (&line->sequence) != expected)
+            continue;
+
+        /* Return the message */
+        copy.text [DS_SHM_LINE_LENGTH - 1] = '\0';
+        snprintf (buffer, length, "%s", copy.text);
+        if (timestamp)
+            *timestamp = copy.timestamp;
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -22,11 +22,21 @@
  */
 
 #include "DS_Utils.h"
+#include "DS_Timer.h"
+#include "DS_Atomic.h"
 #include "DS_Socket.h"
 
 #include <socky.h>
 #include <assert.h>
 
+#include <errno.h>
+
+#if defined (__linux__)
+    #define USE_EPOLL
+    #include <unistd.h>
+    #include <sys/epoll.h>
+#endif
+
 #define SPRINTF_S snprintf
 #ifdef _WIN32
     #ifndef __MINGW32__
@@ -35,125 +45,770 @@
     #endif
 #endif
 
+#define ENDPOINT_TTL   10000 /* Refresh cached addresses every 10 seconds */
+#define ENDPOINT_RETRY 1000  /* Wait one second before retrying a lookup */
+#define MAX_LOOKUPS    32    /* Maximum number of queued address lookups */
+#define MSECS_TO_NSECS(ms) ((uint64_t) (ms) * 1000000ULL)
+
+#define MAX_SOCKETS    64    /* Maximum number of sockets in the reactor */
+#define SELECT_TIMEOUT 50    /* Poll timeout used when epoll is not available */
+#define RING_SLOTS     16    /* Datagrams queued per socket (power of two) */
+#define SEND_DEFERRED  -2    /* Marks batched datagrams sent by their own socket */
+
 /**
- * Copies the received data from the socket in its data buffer
+ * Single-producer/single-consumer ring of received datagrams. The reactor
+ * thread is the only writer of \c head and the thread that reads the
+ * socket (usually the protocol event loop) is the only writer of \c tail.
+ */
+struct _DS_SocketRing {
+    volatile uint32_t head;         /**< Index of the next slot to write */
+    char head_padding [60];         /**< Keeps head and tail in own cache lines */
+    volatile uint32_t tail;         /**< Index of the next slot to read */
+    char tail_padding [60];         /**< Keeps head and tail in own cache lines */
+    volatile uint32_t overruns;     /**< Datagrams dropped due to a full ring */
+    volatile uint32_t receives;     /**< Receive calls made by the reactor */
+    DS_SocketRing* next;            /**< Next ring in the pool */
+    DS_Datagram slots [RING_SLOTS]; /**< Received datagrams */
+};
+
+/*
+ * The reactor thread waits for incoming data on all the open sockets and
+ * dispatches the data to the socket that received it. Sockets are
+ * registered/unregistered while holding the \c reactor_lock, which is also
+ * held while dispatching, so that a closed socket is never read.
+ */
+static pthread_t reactor_thread;
+static int reactor_running = 0;
+static pthread_mutex_t reactor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined (USE_EPOLL)
+static int epoll_fd = -1;
+static int wakeup_pipe [2] = {-1, -1};
+#else
+static int socket_count = 0;
+static DS_Socket* registry [MAX_SOCKETS];
+#endif
+
+/*
+ * Rings of closed sockets are kept here and re-used by the next opened
+ * socket, to avoid allocating a new ring each time a socket is re-opened.
+ * This does not make it safe to read a socket while it is being closed,
+ * the caller must ensure that no other thread reads from it.
+ */
+static DS_SocketRing* ring_pool = NULL;
+
+/*
+ * Datagrams that do not fit in a full ring are received here and dropped
+ */
+static char discard_buffer [DS_DATAGRAM_SIZE];
+
+/*
+ * The resolver thread performs all the (potentially slow) address lookups,
+ * so that sending a datagram never waits for getaddrinfo() or mDNS
+ */
+static pthread_t resolver_thread;
+static int resolver_running = 0;
+static pthread_cond_t resolver_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Protects the endpoint cache of every socket and the lookup queue
+ */
+static pthread_mutex_t endpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Sockets waiting for an address lookup
+ */
+static int lookup_count = 0;
+static DS_Socket* lookups [MAX_LOOKUPS];
+
+/*
+ * Socket whose lookup is being performed by the resolver (without holding
+ * the lock), if the socket is closed in the meantime, the lookup is
+ * cancelled and the resolver does not touch the socket anymore
  */
-static void read_socket (DS_Socket* ptr)
+static DS_Socket* current_lookup = NULL;
+static int lookup_cancelled = 0;
+
+/**
+ * Queues an address lookup for the given socket, the lookup is performed
+ * asynchronously by the resolver thread.
+ *
+ * \note The \c endpoint_lock must be held when calling this function
+ */
+static void request_lookup (DS_Socket* ptr)
 {
-    /* Check arguments */
     assert (ptr);
 
-    /* Initialize temporary buffer */
-    int read = -1;
-    char data [4096] = {0};
+    /* Lookup already queued or resolver not running */
+    if (ptr->info.resolving || !resolver_running)
+        return;
 
-    /* Read TCP socket */
-    if (ptr->type == DS_SOCKET_TCP)
-        read = recv (ptr->info.sock_in, data, sizeof (data), 0);
+    /* Queue is full, the lookup will be requested again later */
+    if (lookup_count >= MAX_LOOKUPS)
+        return;
 
-    /* Read UDP socket */
-    if (ptr->type == DS_SOCKET_UDP) {
-        read = udp_recvfrom (ptr->info.sock_in, data, sizeof (data),
-                             ptr->address, ptr->info.in_service, 0);
+    /* Register the lookup and wake the resolver */
+    ptr->info.resolving = 1;
+    lookups [lookup_count++] = ptr;
+    pthread_cond_signal (&resolver_cond);
+}
+
+/**
+ * Removes the given socket from the lookup queue and cancels its lookup if
+ * the resolver is performing it
+ *
+ * \note The \c endpoint_lock must be held when calling this function
+ */
+static void cancel_lookup (DS_Socket* ptr)
+{
+    int i;
+    int count = 0;
+
+    assert (ptr);
+
+    /* Remove the socket from the queue */
+    for (i = 0; i < lookup_count; ++i) {
+        if (lookups [i] != ptr)
+            lookups [count++] = lookups [i];
     }
 
-    /* We received some data, copy it to socket's buffer */
-    if (read > 0) {
-        ptr->info.buffer_size = read;
-        memset (ptr->info.buffer, 0, ptr->info.buffer_size);
+    /* Cancel the current lookup */
+    if (current_lookup == ptr)
+        lookup_cancelled = 1;
+
+    lookup_count = count;
+    ptr->info.resolving = 0;
+}
+
+/**
+ * Invalidates the endpoint cache of the given socket, the next send
+ * operation will be performed once the address has been resolved again.
+ * If the UDP output socket was connected, it is disconnected so that the
+ * datagrams can be sent with an explicit address in the meantime.
+ *
+ * \note The \c endpoint_lock must be held when calling this function
+ */
+static void invalidate_endpoint (DS_Socket* ptr)
+{
+    assert (ptr);
+
+    if (ptr->info.connected && ptr->info.sock_out > 0)
+        udp_disconnect (ptr->info.sock_out);
 
-        int i;
-        for (i = 0; i < read; ++i)
-            ptr->info.buffer [i] = data [i];
+    ptr->info.expiry = 0;
+    ptr->info.resolved = 0;
+    ptr->info.connected = 0;
+    ptr->info.endpoint_len = 0;
+    ptr->info.generation++;
+}
+
+/**
+ * Updates the endpoint cache of the given socket with the obtained \a addr.
+ * If \a addr is \c NULL (the lookup failed), then the previous address is
+ * kept (if any) and the lookup is retried after \c ENDPOINT_RETRY msecs.
+ *
+ * \note The \c endpoint_lock must be held when calling this function
+ */
+static void store_endpoint (DS_Socket* ptr,
+                            const struct sockaddr_storage* addr,
+                            const int addr_len)
+{
+    assert (ptr);
+
+    /* Lookup failed, try again later */
+    uint64_t now = DS_GetMonotonicTime();
+    if (!addr || addr_len <= 0 || addr_len > (int) sizeof (ptr->info.endpoint)) {
+        ptr->info.expiry = now + MSECS_TO_NSECS (ENDPOINT_RETRY);
+        return;
+    }
+
+    /* Update the cache */
+    memcpy (ptr->info.endpoint, addr, addr_len);
+    ptr->info.resolved = 1;
+    ptr->info.endpoint_len = addr_len;
+    ptr->info.expiry = now + MSECS_TO_NSECS (ENDPOINT_TTL);
+
+    /* Connect the UDP socket, so that we can use send() directly */
+    if (ptr->type == DS_SOCKET_UDP && ptr->connect_udp) {
+        int error = udp_connect (ptr->info.sock_out, addr, addr_len);
+        ptr->info.connected = (error == 0);
     }
 }
 
 /**
- * Runs the server socket loop, which uses the \c select() function
- * to copy received data into the socket's buffer only when the
- * operating system detects that the socket received some data.
+ * Resolves the addresses of the queued sockets, one at a time. The lock is
+ * released while the lookup is performed, if the address of the socket
+ * changes in the meantime, the lookup is queued again.
  *
- * \param ptr a pointer to a \c DS_Socket structure
+ * TCP sockets are connected by this thread too, since connect() may block
+ * for a long time when the remote host is not available.
  */
-static void server_loop (DS_Socket* ptr)
+static void* run_resolver (void* data)
+{
+    (void) data;
+
+    pthread_mutex_lock (&endpoint_lock);
+
+    while (resolver_running) {
+        /* Wait for lookup requests */
+        if (lookup_count <= 0) {
+            pthread_cond_wait (&resolver_cond, &endpoint_lock);
+            continue;
+        }
+
+        /* Take the first socket in the queue */
+        DS_Socket* ptr = lookups [0];
+        --lookup_count;
+        memmove (lookups, lookups + 1, lookup_count * sizeof (DS_Socket*));
+        current_lookup = ptr;
+        lookup_cancelled = 0;
+
+        /* Copy the lookup parameters */
+        char address [sizeof (ptr->address)];
+        char service [sizeof (ptr->info.out_service)];
+        DS_SocketType type = ptr->type;
+        unsigned generation = ptr->info.generation;
+        memcpy (address, ptr->address, sizeof (address));
+        memcpy (service, ptr->info.out_service, sizeof (service));
+        address [sizeof (address) - 1] = '\0';
+        service [sizeof (service) - 1] = '\0';
+
+        /* Resolve the address (or connect) without holding the lock */
+        pthread_mutex_unlock (&endpoint_lock);
+        int sfd = -1;
+        int error = 0;
+        int addr_len = 0;
+        struct sockaddr_storage addr;
+        if (type == DS_SOCKET_TCP)
+            sfd = create_client_tcp (address, service, SOCKY_IPv4, 0);
+        else
+            error = udp_resolve (address, service, SOCKY_IPv4, &addr, &addr_len);
+        pthread_mutex_lock (&endpoint_lock);
+        current_lookup = NULL;
+
+        /* Socket was closed while we were busy (it may have been freed) */
+        if (lookup_cancelled) {
+            if (sfd > 0)
+                socket_close (sfd);
+
+            continue;
+        }
+
+        /* Socket was changed while we were busy */
+        ptr->info.resolving = 0;
+        if (!ptr->info.open || ptr->info.generation != generation ||
+                strncmp (ptr->address, address, sizeof (address)) != 0) {
+            if (sfd > 0)
+                socket_close (sfd);
+
+            if (ptr->info.open)
+                request_lookup (ptr);
+
+            continue;
+        }
+
+        /* Update the TCP client socket */
+        if (type == DS_SOCKET_TCP) {
+            ptr->info.sock_out = sfd;
+            ptr->info.client_init = (sfd > 0);
+        }
+
+        /* Update the endpoint cache */
+        else
+            store_endpoint (ptr, error ? NULL : &addr, addr_len);
+    }
+
+    pthread_mutex_unlock (&endpoint_lock);
+    return NULL;
+}
+
+/**
+ * Sends the given \a buf using the cached endpoint of the given UDP socket.
+ * If the cache is stale, we send the datagram to the last known address and
+ * ask the resolver to refresh the cache in the background.
+ *
+ * \returns number of bytes written on success, -1 on failure
+ */
+static int send_udp (DS_Socket* ptr, const char* buf, const int len)
 {
-    /* Check arguments */
     assert (ptr);
+    assert (buf);
 
-    /* Initialize variables for select */
-    int rc, fd;
-    fd_set set;
-    struct timeval tv;
+    int addr_len = 0;
+    int connected = 0;
+    struct sockaddr_storage addr;
 
-    /* Disable socket blocking */
+    /* Get a copy of the cached endpoint */
+    pthread_mutex_lock (&endpoint_lock);
+    {
+        connected = ptr->info.connected;
+        if (ptr->info.resolved && !connected) {
+            addr_len = ptr->info.endpoint_len;
+            memcpy (&addr, ptr->info.endpoint, addr_len);
+        }
+
+        if (DS_GetMonotonicTime() >= ptr->info.expiry)
+            request_lookup (ptr);
+    }
+    pthread_mutex_unlock (&endpoint_lock);
+
+    /* Socket is connected, we do not need to specify the address */
+    if (connected)
+        return send (ptr->info.sock_out, buf, len, 0);
+
+    /* Send the datagram to the cached address */
+    if (addr_len > 0)
+        return udp_sendto_addr (ptr->info.sock_out, buf, len, &addr, addr_len, 0);
+
+    /* Address is still being resolved, drop the datagram */
+    return -1;
+}
+
+/**
+ * Returns an empty ring, taken from the pool if possible
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+static DS_SocketRing* acquire_ring (void)
+{
+    DS_SocketRing* ring = ring_pool;
+
+    /* Take the first ring from the pool or allocate a new one */
+    if (ring)
+        ring_pool = ring->next;
+    else
+        ring = (DS_SocketRing*) calloc (1, sizeof (DS_SocketRing));
+
+    /* Reset the ring */
+    assert (ring);
+    ring->next = NULL;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->overruns = 0;
+    ring->receives = 0;
+
+    return ring;
+}
+
+/**
+ * Returns the given \a ring to the pool (or frees it if the module is
+ * not running anymore)
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+static void release_ring (DS_SocketRing* ring)
+{
+    if (!ring)
+        return;
+
+    if (reactor_running) {
+        ring->next = ring_pool;
+        ring_pool = ring;
+    }
+
+    else
+        free (ring);
+}
+
+/**
+ * Returns \c 1 if the last socket operation was interrupted by a signal
+ */
+static int interrupted (void)
+{
+#if defined (_WIN32)
+    return WSAGetLastError() == WSAEINTR;
+#else
+    return errno == EINTR;
+#endif
+}
+
+/**
+ * Returns \c 1 if the last socket operation failed only because there was
+ * no data to read (or it was interrupted), \c 0 for other errors
+ */
+static int would_block (void)
+{
+#if defined (_WIN32)
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINTR;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+/**
+ * Adds the given file descriptor to the epoll set of the reactor, events
+ * are reported with the given socket
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+#if defined (USE_EPOLL)
+static int watch_fd (DS_Socket* ptr, const int fd)
+{
+    struct epoll_event event;
+    memset (&event, 0, sizeof (event));
+    event.events = EPOLLIN;
+    event.data.ptr = ptr;
+
+    return epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+#endif
+
+/**
+ * Closes the accepted TCP connection of the given socket (if any) and
+ * removes it from the reactor
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+static void close_peer (DS_Socket* ptr)
+{
+    assert (ptr);
+
+    if (ptr->info.sock_peer <= 0)
+        return;
+
+#if defined (USE_EPOLL)
+    epoll_ctl (epoll_fd, EPOLL_CTL_DEL, ptr->info.sock_peer, NULL);
+#endif
+
+    socket_close (ptr->info.sock_peer);
+    ptr->info.sock_peer = -1;
+}
+
+/**
+ * Accepts the pending connection of the given TCP server socket (if any),
+ * the new connection replaces the previous one, since the DS only talks
+ * to a single host through each socket
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+static void accept_peer (DS_Socket* ptr)
+{
+    assert (ptr);
+
+    /* No pending connection */
+    int fd = (int) accept (ptr->info.sock_in, NULL, NULL);
+    if (fd <= 0)
+        return;
+
+    /* Replace the previous connection */
+    close_peer (ptr);
 #ifndef _WIN32
-    set_socket_block (ptr->info.sock_in, 0);
+    set_socket_block (fd, 0);
 #endif
+    ptr->info.sock_peer = fd;
 
-    /* Run the server while the socket is valid */
-    while (ptr->info.server_init && ptr->info.sock_in > 0) {
-        tv.tv_sec = 0;
-        tv.tv_usec = 5000 * 100;
+#if defined (USE_EPOLL)
+    if (watch_fd (ptr, fd) != 0)
+        close_peer (ptr);
+#endif
+}
 
-        FD_ZERO (&set);
-        FD_SET (ptr->info.sock_in, &set);
+/**
+ * Receives the pending datagrams (or a TCP data chunk) directly into the
+ * free slots of the receive ring of the socket. UDP datagrams are received
+ * in batches with a single system call when the platform supports it.
+ *
+ * If the ring is full, one datagram is received and dropped and the
+ * overrun counter of the ring is incremented.
+ *
+ * \returns the number of received datagrams, 0 or -1 if there was no data
+ */
+static int read_socket (DS_Socket* ptr)
+{
+    /* Check arguments */
+    assert (ptr);
+    assert (ptr->info.ring);
 
-#if defined _WIN32
-        fd = 0;
+    /* TCP data is read from the accepted connection */
+    int fd = ptr->info.sock_in;
+    if (ptr->type == DS_SOCKET_TCP)
+        fd = ptr->info.sock_peer;
+
+    /* Nothing to read */
+    if (fd <= 0)
+        return 0;
+
+    /* Get the number of free slots */
+    DS_SocketRing* ring = ptr->info.ring;
+    uint32_t head = ring->head;
+    uint32_t tail = DS_AtomicLoad (&ring->tail);
+    int available = RING_SLOTS - (int) (head - tail);
+
+    /* Count the receive call (including the ones that find no data) */
+    DS_AtomicAdd (&ring->receives, 1);
+
+    /* Ring is full, drop the datagram */
+    if (available <= 0) {
+        int read = recv (fd, discard_buffer, DS_DATAGRAM_SIZE, 0);
+        if (read <= 0)
+            return read;
+
+        DS_AtomicAdd (&ring->overruns, 1);
+        return 1;
+    }
+
+    /* Describe the free slots */
+    int i;
+    struct udp_message msgs [RING_SLOTS];
+    for (i = 0; i < available; ++i) {
+        DS_Datagram* slot = &ring->slots [(head + i) & (RING_SLOTS - 1)];
+        msgs [i].buf = slot->data;
+        msgs [i].buf_len = DS_DATAGRAM_SIZE;
+        msgs [i].bytes = 0;
+        msgs [i].addr = (struct sockaddr_storage*) slot->source;
+        msgs [i].addr_len = 0;
+    }
+
+    /* Read TCP socket */
+    int count = -1;
+    if (ptr->type == DS_SOCKET_TCP) {
+        msgs [0].bytes = recv (fd, msgs [0].buf, msgs [0].buf_len, 0);
+        count = (msgs [0].bytes > 0) ? 1 : msgs [0].bytes;
+    }
+
+    /* Read UDP socket */
+    else if (ptr->type == DS_SOCKET_UDP)
+        count = udp_recv_batch (fd, msgs, available, 0);
+
+    /* No data received */
+    if (count <= 0)
+        return count;
+
+    /* Fill the slot information (empty datagrams are skipped) */
+    int filled = 0;
+    uint64_t now = DS_GetMonotonicTime();
+    for (i = 0; i < count; ++i) {
+        if (msgs [i].bytes <= 0)
+            continue;
+
+        DS_Datagram* slot = &ring->slots [(head + filled) & (RING_SLOTS - 1)];
+        DS_Datagram* recv = &ring->slots [(head + i) & (RING_SLOTS - 1)];
+        if (slot != recv) {
+            memcpy (slot->data, recv->data, msgs [i].bytes);
+            memcpy (slot->source, recv->source, sizeof (slot->source));
+        }
+
+        slot->timestamp = now;
+        slot->length = msgs [i].bytes;
+        slot->source_len = msgs [i].addr_len;
+        ++filled;
+    }
+
+    /* Publish the slots to the reader */
+    DS_AtomicStore (&ring->head, head + filled);
+    return count;
+}
+
+/**
+ * Adds the given socket to the reactor
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+static void register_socket (DS_Socket* ptr)
+{
+    assert (ptr);
+
+#if defined (USE_EPOLL)
+    if (watch_fd (ptr, ptr->info.sock_in) == 0)
+        ptr->info.slot = 0;
 #else
-        fd = ptr->info.sock_in + 1;
+    if (socket_count < MAX_SOCKETS) {
+        ptr->info.slot = socket_count;
+        registry [socket_count++] = ptr;
+    }
 #endif
+}
 
-        rc = select (fd, &set, NULL, NULL, &tv);
-        if (rc > 0 && FD_ISSET (ptr->info.sock_in, &set))
-            read_socket (ptr);
+/**
+ * Removes the given socket from the reactor
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+static void unregister_socket (DS_Socket* ptr)
+{
+    assert (ptr);
+
+    /* Close the accepted connection */
+    close_peer (ptr);
+
+    /* Socket is not registered */
+    if (ptr->info.slot < 0)
+        return;
+
+#if defined (USE_EPOLL)
+    if (ptr->info.sock_in > 0)
+        epoll_ctl (epoll_fd, EPOLL_CTL_DEL, ptr->info.sock_in, NULL);
+#else
+    /* Move the last socket to the slot of the removed socket */
+    int slot = ptr->info.slot;
+    if (slot < socket_count && registry [slot] == ptr) {
+        registry [slot] = registry [--socket_count];
+        registry [slot]->info.slot = slot;
+        registry [socket_count] = NULL;
     }
+#endif
+
+    ptr->info.slot = -1;
 }
 
 /**
- * Initializes the given socket structure
+ * Stops watching the connection (or socket) whose read failed with the
+ * given \a result, when the failure is permanent. Otherwise, the reactor
+ * would be woken up for the same condition forever.
+ *
+ *     - TCP connections that are closed by the peer (or fail) are closed
+ *     - UDP sockets that fail with a hard error are removed from the reactor
  *
- * \param data raw pointer to a \c DS_Socket structure
+ * \note The \c reactor_lock must be held when calling this function
  */
-static void* create_socket (void* data)
+static void handle_read_failure (DS_Socket* ptr, const int result)
 {
-    /* Check arguments */
-    assert (data);
-    DS_Socket* ptr = (DS_Socket*) data;
+    /* TCP peer closed the connection */
+    if (ptr->type == DS_SOCKET_TCP && result == 0) {
+        close_peer (ptr);
+        return;
+    }
 
-    /* Ensure that buffer and service strings are set to 0 */
-    memset (ptr->info.buffer, 0, sizeof (ptr->info.buffer));
-    memset (ptr->info.in_service, 0, sizeof (ptr->info.in_service));
-    memset (ptr->info.out_service, 0, sizeof (ptr->info.out_service));
+    /* No more data (or empty UDP datagram) */
+    if (result >= 0 || would_block())
+        return;
 
-    /* Set service strings */
-    int len = sizeof (ptr->info.in_service);
-    SPRINTF_S (ptr->info.in_service, len, "%d", ptr->in_port);
-    SPRINTF_S (ptr->info.out_service, len, "%d", ptr->out_port);
+    /* Permanent error */
+    if (ptr->type == DS_SOCKET_TCP)
+        close_peer (ptr);
+    else
+        unregister_socket (ptr);
+}
 
-    /* Open TCP socket */
-    if (ptr->type == DS_SOCKET_TCP) {
-        ptr->info.sock_in = create_server_tcp (ptr->info.in_service, SOCKY_IPv4, 0);
-        ptr->info.sock_out = create_client_tcp (ptr->address, ptr->info.out_service, SOCKY_IPv4, 0);
+/**
+ * Reads the given socket if it is still registered with the reactor, events
+ * reported for a socket that was closed in the meantime are ignored. TCP
+ * server sockets accept the pending connection before reading.
+ *
+ * On systems with non-blocking sockets, all the pending datagrams (up to the
+ * size of the ring) are read at once.
+ *
+ * \note The \c reactor_lock must be held when calling this function
+ */
+static void dispatch (DS_Socket* ptr)
+{
+    if (!ptr || ptr->info.slot < 0 || !ptr->info.server_init || ptr->info.sock_in <= 0)
+        return;
+
+    /* Accept new TCP connections */
+    if (ptr->type == DS_SOCKET_TCP)
+        accept_peer (ptr);
+
+#if defined (_WIN32)
+    int result = read_socket (ptr);
+    if (result <= 0)
+        handle_read_failure (ptr, result);
+#else
+    int i;
+    for (i = 0; i < RING_SLOTS; ++i) {
+        int result = read_socket (ptr);
+        if (result <= 0) {
+            handle_read_failure (ptr, result);
+            break;
+        }
     }
+#endif
+}
 
-    /* Open UDP socket */
-    else if (ptr->type == DS_SOCKET_UDP) {
-        ptr->info.sock_out = create_client_udp (SOCKY_IPv4, 0);
-        ptr->info.sock_in = create_server_udp (ptr->info.in_service, SOCKY_IPv4, 0);
+/**
+ * Waits for incoming data on all registered sockets and reads the sockets
+ * that are ready. On Linux, we use epoll, on other systems we fall back to
+ * a \c select() loop with a short timeout.
+ */
+static void* run_reactor (void* data)
+{
+    (void) data;
+
+#if defined (USE_EPOLL)
+    int i;
+    struct epoll_event events [MAX_SOCKETS];
+
+    while (reactor_running) {
+        int count = epoll_wait (epoll_fd, events, MAX_SOCKETS, -1);
+
+        pthread_mutex_lock (&reactor_lock);
+        for (i = 0; i < count; ++i)
+            dispatch ((DS_Socket*) events [i].data.ptr);
+        pthread_mutex_unlock (&reactor_lock);
     }
+#else
+    int i, rc, fd;
+    fd_set set;
+    struct timeval tv;
 
-    /* Update initialized states */
-    ptr->info.server_init = (ptr->info.sock_in > 0);
-    ptr->info.client_init = (ptr->info.sock_out > 0);
+    while (reactor_running) {
+        fd = 0;
+        FD_ZERO (&set);
+
+        /* Add registered sockets to the set */
+        pthread_mutex_lock (&reactor_lock);
+        for (i = 0; i < socket_count; ++i) {
+            FD_SET (registry [i]->info.sock_in, &set);
+            fd = DS_Max (fd, registry [i]->info.sock_in + 1);
+
+            if (registry [i]->info.sock_peer > 0) {
+                FD_SET (registry [i]->info.sock_peer, &set);
+                fd = DS_Max (fd, registry [i]->info.sock_peer + 1);
+            }
+        }
+        pthread_mutex_unlock (&reactor_lock);
+
+        /* Nothing to wait for */
+        if (fd == 0) {
+            DS_Sleep (SELECT_TIMEOUT);
+            continue;
+        }
+
+        /* Wait for incoming data */
+        tv.tv_sec = 0;
+        tv.tv_usec = SELECT_TIMEOUT * 1000;
+        rc = select (fd, &set, NULL, NULL, &tv);
 
-    /* Start server loop */
-    server_loop (ptr);
+        /* Read the sockets that received data */
+        if (rc > 0) {
+            pthread_mutex_lock (&reactor_lock);
+            for (i = socket_count - 1; i >= 0; --i) {
+                DS_Socket* ptr = registry [i];
+                if (FD_ISSET (ptr->info.sock_in, &set) ||
+                    (ptr->info.sock_peer > 0 && FD_ISSET (ptr->info.sock_peer, &set)))
+                    dispatch (ptr);
+            }
+            pthread_mutex_unlock (&reactor_lock);
+        }
+    }
+#endif
 
-    /* Exit */
     return NULL;
 }
 
+/**
+ * Starts the given \a thread and shows a message box with the given
+ * \a error message if the thread cannot be started
+ */
+static void start_thread (pthread_t* thread, void* (*func) (void*),
+                          const char* error_message)
+{
+    int error = pthread_create (thread, NULL, func, NULL);
+
+    /* Warn the user when the thread cannot start */
+    if (error) {
+        DS_String caption = DS_StrNew ("LibDS");
+        DS_String message = DS_StrNew (error_message);
+        DS_ShowMessageBox (&caption, &message, DS_ICON_ERROR);
+        DS_StrRmBuf (&caption);
+        DS_StrRmBuf (&message);
+    }
+
+    /* Quit if thread cannot start */
+    assert (!error);
+}
+
 /**
  * Returns an empty socket for safe initialization
  */
@@ -167,18 +822,25 @@ DS_Socket* DS_SocketEmpty (void)
     socket->out_port = 0;
     socket->disabled = 0;
     socket->broadcast = 0;
+    socket->connect_udp = 0;
     socket->type = DS_SOCKET_UDP;
 
     /* Fill socket info structure */
     socket->info.sock_in = 0;
     socket->info.sock_out = 0;
-    socket->info.buffer_size = 0;
+    socket->info.sock_peer = -1;
+    socket->info.ring = NULL;
     socket->info.server_init = 0;
     socket->info.client_init = 0;
+    socket->info.resolved = 0;
+    socket->info.resolving = 0;
+    socket->info.connected = 0;
+    socket->info.generation = 0;
+    socket->info.open = 0;
+    socket->info.slot = -1;
 
     /* Fill strings with 0 */
     memset (socket->address, 0, sizeof (socket->address));
-    memset (socket->info.buffer, 0, sizeof (socket->info.buffer));
     memset (socket->info.in_service, 0, sizeof (socket->info.in_service));
     memset (socket->info.out_service, 0, sizeof (socket->info.out_service));
 
@@ -192,6 +854,32 @@ DS_Socket* DS_SocketEmpty (void)
 void Sockets_Init (void)
 {
     sockets_init (1);
+
+    /* Initialize the reactor */
+    reactor_running = 1;
+#if defined (USE_EPOLL)
+    epoll_fd = epoll_create (MAX_SOCKETS);
+    assert (epoll_fd >= 0);
+
+    /* Register the wakeup pipe (used to stop the reactor) */
+    int error = pipe (wakeup_pipe);
+    assert (!error);
+    struct epoll_event event;
+    memset (&event, 0, sizeof (event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl (epoll_fd, EPOLL_CTL_ADD, wakeup_pipe [0], &event);
+#else
+    socket_count = 0;
+#endif
+
+    /* Start the resolver and reactor threads */
+    lookup_count = 0;
+    resolver_running = 1;
+    start_thread (&resolver_thread, &run_resolver,
+                  "Cannot start address resolver thread!");
+    start_thread (&reactor_thread, &run_reactor,
+                  "Cannot start socket reactor thread!");
 }
 
 /**
@@ -199,14 +887,51 @@ void Sockets_Init (void)
  */
 void Sockets_Close (void)
 {
+    /* Stop the reactor thread */
+    reactor_running = 0;
+#if defined (USE_EPOLL)
+    ssize_t written = write (wakeup_pipe [1], "", 1);
+    assert (written == 1);
+    (void) written;
+#endif
+    pthread_join (reactor_thread, NULL);
+
+    /* Stop the resolver thread (a pending lookup may delay this) */
+    pthread_mutex_lock (&endpoint_lock);
+    resolver_running = 0;
+    lookup_count = 0;
+    pthread_cond_signal (&resolver_cond);
+    pthread_mutex_unlock (&endpoint_lock);
+    pthread_join (resolver_thread, NULL);
+
+    /* Free the ring pool */
+    pthread_mutex_lock (&reactor_lock);
+    while (ring_pool) {
+        DS_SocketRing* next = ring_pool->next;
+        free (ring_pool);
+        ring_pool = next;
+    }
+    pthread_mutex_unlock (&reactor_lock);
+
+    /* Release reactor resources */
+#if defined (USE_EPOLL)
+    close (epoll_fd);
+    close (wakeup_pipe [0]);
+    close (wakeup_pipe [1]);
+    epoll_fd = -1;
+    wakeup_pipe [0] = -1;
+    wakeup_pipe [1] = -1;
+#endif
+
     sockets_exit();
 }
 
 /**
- * Initializes and configures the given socket
+ * Initializes and configures the given socket and registers it with the
+ * reactor thread.
  *
- * \note The socket will be initialzed in another thread to avoid blocking
- *       the main thread of the application
+ * \note TCP client sockets are connected by the resolver thread to avoid
+ *       blocking the main thread of the application
  */
 void DS_SocketOpen (DS_Socket* ptr)
 {
@@ -217,22 +942,53 @@ void DS_SocketOpen (DS_Socket* ptr)
     if (ptr->disabled)
         return;
 
-    /* Initialize the socket in another thread */
-    pthread_t thread;
-    int error = pthread_create (&thread, NULL,
-                                &create_socket, (void*) ptr);
+    /* Ensure that service strings are set to 0 */
+    memset (ptr->info.in_service, 0, sizeof (ptr->info.in_service));
+    memset (ptr->info.out_service, 0, sizeof (ptr->info.out_service));
 
-    /* Warn the user when the socket cannot start */
-    if (error) {
-        DS_String caption = DS_StrNew ("LibDS");
-        DS_String message = DS_StrNew ("Cannot start socket thread!");
-        DS_ShowMessageBox (&caption, &message, DS_ICON_ERROR);
-        DS_StrRmBuf (&caption);
-        DS_StrRmBuf (&message);
+    /* Set service strings */
+    int len = sizeof (ptr->info.in_service);
+    SPRINTF_S (ptr->info.in_service, len, "%d", ptr->in_port);
+    SPRINTF_S (ptr->info.out_service, len, "%d", ptr->out_port);
+
+    /* Open TCP socket */
+    ptr->info.sock_in = -1;
+    ptr->info.sock_out = -1;
+    ptr->info.sock_peer = -1;
+    if (ptr->type == DS_SOCKET_TCP)
+        ptr->info.sock_in = create_server_tcp (ptr->info.in_service, SOCKY_IPv4, 0);
+
+    /* Open UDP socket */
+    else if (ptr->type == DS_SOCKET_UDP) {
+        ptr->info.sock_out = create_client_udp (SOCKY_IPv4, 0);
+        ptr->info.sock_in = create_server_udp (ptr->info.in_service, SOCKY_IPv4, 0);
     }
 
-    /* Quit if socket cannot start */
-    assert (!error);
+    /* Disable socket blocking */
+#ifndef _WIN32
+    if (ptr->info.sock_in > 0)
+        set_socket_block (ptr->info.sock_in, 0);
+#endif
+
+    /* Update initialized states and resolve the remote address */
+    pthread_mutex_lock (&endpoint_lock);
+    {
+        ptr->info.open = 1;
+        ptr->info.resolving = 0;
+        invalidate_endpoint (ptr);
+        ptr->info.server_init = (ptr->info.sock_in > 0);
+        ptr->info.client_init = (ptr->info.sock_out > 0);
+        request_lookup (ptr);
+    }
+    pthread_mutex_unlock (&endpoint_lock);
+
+    /* Register the socket with the reactor */
+    pthread_mutex_lock (&reactor_lock);
+    if (ptr->info.server_init) {
+        ptr->info.ring = acquire_ring();
+        register_socket (ptr);
+    }
+    pthread_mutex_unlock (&reactor_lock);
 }
 
 /**
@@ -246,9 +1002,25 @@ void DS_SocketClose (DS_Socket* ptr)
     /* Check arguments */
     assert (ptr);
 
-    /* Reset socket properties */
-    ptr->info.server_init = 0;
-    ptr->info.client_init = 0;
+    /* Stop receiving data */
+    pthread_mutex_lock (&reactor_lock);
+    {
+        unregister_socket (ptr);
+        release_ring (ptr->info.ring);
+        ptr->info.ring = NULL;
+        ptr->info.server_init = 0;
+    }
+    pthread_mutex_unlock (&reactor_lock);
+
+    /* Reset socket properties and forget its lookups */
+    pthread_mutex_lock (&endpoint_lock);
+    {
+        ptr->info.open = 0;
+        ptr->info.client_init = 0;
+        invalidate_endpoint (ptr);
+        cancel_lookup (ptr);
+    }
+    pthread_mutex_unlock (&endpoint_lock);
 
     /* Close sockets */
 #if defined (__ANDROID__)
@@ -262,16 +1034,18 @@ void DS_SocketClose (DS_Socket* ptr)
     /* Reset socket information structure */
     ptr->info.sock_in = -1;
     ptr->info.sock_out = -1;
-    ptr->info.buffer_size = 0;
 
     /* Reset strings */
-    memset (ptr->info.buffer, 0, sizeof (ptr->info.buffer));
     memset (ptr->info.in_service, 0, sizeof (ptr->info.in_service));
     memset (ptr->info.out_service, 0, sizeof (ptr->info.out_service));
 }
 
 /**
- * Returns any data received by the given socket
+ * Returns the oldest datagram received by the given socket, or an empty
+ * string if there is no data.
+ *
+ * \note This function is kept for compatibility, it copies the datagram
+ *       into a new string. Use \c DS_SocketPeek() to avoid the copy.
  *
  * \param ptr pointer to a \c DS_Socket structure
  */
@@ -280,78 +1054,334 @@ DS_String DS_SocketRead (DS_Socket* ptr)
     /* Check arguments */
     assert (ptr);
 
-    /* Socket is disabled or uninitialized */
-    if ((ptr->info.server_init == 0) || (ptr->disabled == 1))
+    /* Get the next datagram */
+    const DS_Datagram* datagram = DS_SocketPeek (ptr);
+    if (!datagram)
         return DS_StrNewLen (0);
 
-    /* Copy the current buffer and clear it */
-    if (ptr->info.buffer_size > 0) {
-        DS_String buffer = DS_StrNewLen (ptr->info.buffer_size);
+    /* Copy datagram to string */
+    DS_String buffer = DS_StrNewLen (datagram->length);
+    memcpy (buffer.buf, datagram->data, datagram->length);
+    DS_SocketRelease (ptr);
 
-        /* Copy buffer to string */
-        int i;
-        for (i = 0; i < (int) ptr->info.buffer_size; ++i)
-            DS_StrSetChar (&buffer, i, ptr->info.buffer [i]);
+    return buffer;
+}
 
-        /* Clear buffer info */
-        memset (ptr->info.buffer, 0, ptr->info.buffer_size);
-        ptr->info.buffer_size = 0;
+/**
+ * Lends the oldest datagram received by the given socket to the caller,
+ * without copying it. The datagram stays valid (and will not be overwritten
+ * by the reactor) until \c DS_SocketRelease() is called.
+ *
+ * Calling this function twice without releasing the datagram returns the
+ * same datagram.
+ *
+ * \note Only one thread may read a given socket
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ *
+ * \returns a pointer to the datagram, \c NULL if there are no datagrams
+ */
+const DS_Datagram* DS_SocketPeek (DS_Socket* ptr)
+{
+    /* Check arguments */
+    assert (ptr);
 
-        /* Return copied buffer */
-        return buffer;
-    }
+    /* Socket is disabled or uninitialized */
+    DS_SocketRing* ring = ptr->info.ring;
+    if (!ring || ptr->info.server_init == 0 || ptr->disabled == 1)
+        return NULL;
+
+    /* Ring is empty */
+    uint32_t tail = ring->tail;
+    uint32_t head = DS_AtomicLoad (&ring->head);
+    if (tail == head)
+        return NULL;
+
+    /* Return the oldest slot */
+    return &ring->slots [tail & (RING_SLOTS - 1)];
+}
+
+/**
+ * Returns the datagram obtained with \c DS_SocketPeek() to the receive ring,
+ * so that the reactor can re-use its slot.
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ */
+void DS_SocketRelease (DS_Socket* ptr)
+{
+    /* Check arguments */
+    assert (ptr);
+
+    /* Socket is not open */
+    DS_SocketRing* ring = ptr->info.ring;
+    if (!ring)
+        return;
+
+    /* Release the slot (if any) to the reactor */
+    uint32_t tail = ring->tail;
+    if (tail != DS_AtomicLoad (&ring->head))
+        DS_AtomicStore (&ring->tail, tail + 1);
+}
+
+/**
+ * Removes the oldest datagram from the receive ring of the given socket
+ * and copies it to \a datagram. Call this function until it returns 0 to
+ * process every received datagram in the order in which they arrived.
+ *
+ * \note Only one thread may read a given socket
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ * \param datagram the structure in which to copy the received datagram
+ *
+ * \returns 1 if a datagram was copied, 0 if there are no pending datagrams
+ */
+int DS_SocketReadDatagram (DS_Socket* ptr, DS_Datagram* datagram)
+{
+    /* Check arguments */
+    assert (ptr);
+    assert (datagram);
+
+    /* Get the oldest datagram */
+    const DS_Datagram* slot = DS_SocketPeek (ptr);
+    if (!slot)
+        return 0;
+
+    /* Copy the datagram */
+    datagram->length = slot->length;
+    datagram->timestamp = slot->timestamp;
+    datagram->source_len = slot->source_len;
+    memcpy (datagram->source, slot->source, sizeof (slot->source));
+    memcpy (datagram->data, slot->data, slot->length);
+
+    /* Release the slot to the reactor */
+    DS_SocketRelease (ptr);
+    return 1;
+}
+
+/**
+ * Returns the number of datagrams that were dropped because the receive
+ * ring of the given socket was full
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ */
+unsigned DS_SocketOverruns (const DS_Socket* ptr)
+{
+    /* Check arguments */
+    assert (ptr);
 
-    return DS_StrNewLen (0);
+    /* Socket is not open */
+    if (!ptr->info.ring)
+        return 0;
+
+    return DS_AtomicLoad (&ptr->info.ring->overruns);
 }
 
+/**
+ * Returns the number of receive calls (\c udp_recv_batch() or \c recv())
+ * that the reactor made for the given socket since it was opened, this
+ * includes the calls that found no data. It can be compared with the
+ * number of received datagrams to measure the batching of the reactor.
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ */
+unsigned DS_SocketReceiveCalls (const DS_Socket* ptr)
+{
+    /* Check arguments */
+    assert (ptr);
+
+    /* Socket is not open */
+    if (!ptr->info.ring)
+        return 0;
+
+    return DS_AtomicLoad (&ptr->info.ring->receives);
+}
 
 /**
  * Sends the given \a data using the given socket
  *
+ * \note This function is kept for compatibility, it is equivalent to
+ *       calling \c DS_SocketSendBytes() with the buffer of \a data
+ *
  * \param data the data buffer to send
  * \param ptr pointer to the socket to use to send the given \a data
  *
  * \returns number of bytes written on success, -1 on failure
  */
-int DS_SocketSend (const DS_Socket* ptr, const DS_String* data)
+int DS_SocketSend (DS_Socket* ptr, const DS_String* data)
 {
     /* Check arguments */
     assert (ptr);
     assert (data);
 
+    /* Data is empty */
+    if (DS_StrEmpty (data))
+        return 0;
+
+    return DS_SocketSendBytes (ptr, data->buf, (int) data->len);
+}
+
+/**
+ * Sends \a len bytes from the given \a buf directly, without copying them
+ *
+ * \param ptr pointer to the socket to use to send the given data
+ * \param buf the data buffer to send
+ * \param len the number of bytes to send
+ *
+ * \returns number of bytes written on success, -1 on failure
+ */
+int DS_SocketSendBytes (DS_Socket* ptr, const char* buf, const int len)
+{
+    /* Check arguments */
+    assert (ptr);
+
     /* Socket is disabled or uninitialized */
     if ((ptr->info.client_init == 0) || ptr->disabled)
         return -1;
 
     /* Data is empty */
-    if (DS_StrEmpty (data))
+    if (!buf || len <= 0)
         return 0;
 
-    /* Initialize variables*/
-    int bytes_written = 0;
-    int len = DS_StrLen (data);
-    char* bytes = DS_StrToChar (data);
-
     /* Send data using TCP */
     if (ptr->type == DS_SOCKET_TCP)
-        bytes_written = send (ptr->info.sock_out, bytes, len, 0);
+        return send (ptr->info.sock_out, buf, len, 0);
 
     /* Send data using UDP */
-    else if (ptr->type == DS_SOCKET_UDP) {
-        bytes_written = udp_sendto (ptr->info.sock_out, bytes, len,
-                                    ptr->address, ptr->info.out_service, 0);
+    if (ptr->type == DS_SOCKET_UDP)
+        return send_udp (ptr, buf, len);
+
+    return -1;
+}
+
+/**
+ * Sends several datagrams through the output socket of \a ptr with a single
+ * system call (when the platform supports it). Each datagram is sent to the
+ * cached remote endpoint of its \c destination socket, which allows sending
+ * packets to several hosts in the same tick.
+ *
+ * Datagrams for other destinations can only share the output socket of
+ * \a ptr if it is not connected and the destination is an UDP socket, the
+ * rest of the datagrams are sent with their own sockets after the batch.
+ *
+ * If the kernel only accepts a part of a batch, the remaining datagrams are
+ * sent again until all of them are sent or a send operation fails.
+ *
+ * Datagrams whose destination address has not been resolved yet (or whose
+ * destination is disabled) are not sent, their \c sent field is set to -1.
+ *
+ * \param ptr pointer to the socket used to send the datagrams
+ * \param datagrams the datagrams to send
+ * \param count the number of datagrams
+ *
+ * \returns the number of sent datagrams, -1 on failure
+ */
+int DS_SocketSendBatch (DS_Socket* ptr, DS_OutDatagram* datagrams, const int count)
+{
+    /* Check arguments */
+    assert (ptr);
+    assert (datagrams);
+
+    /* Socket is disabled, uninitialized or not UDP */
+    if ((ptr->info.client_init == 0) || ptr->disabled || ptr->type != DS_SOCKET_UDP)
+        return -1;
+
+    int i;
+    int total = 0;
+    int offset = 0;
+    int failed = 0;
+    int deferred = 0;
+
+    while (offset < count && !failed) {
+        int num = 0;
+        int done = 0;
+        int index [SOCKY_BATCH_MAX];
+        struct udp_message msgs [SOCKY_BATCH_MAX];
+        struct sockaddr_storage addrs [SOCKY_BATCH_MAX];
+
+        /* Build the batch with the cached endpoints */
+        pthread_mutex_lock (&endpoint_lock);
+        for (; offset < count && num < SOCKY_BATCH_MAX; ++offset) {
+            DS_OutDatagram* out = &datagrams [offset];
+            DS_Socket* dest = out->destination ? out->destination : ptr;
+            out->sent = -1;
+
+            /* Destination is disabled or datagram is empty */
+            if (dest->disabled || dest->info.client_init == 0 || out->length <= 0)
+                continue;
+
+            /* Datagram cannot be sent through the output socket of ptr */
+            if (dest != ptr && (dest->type != DS_SOCKET_UDP || ptr->info.connected)) {
+                out->sent = SEND_DEFERRED;
+                ++deferred;
+                continue;
+            }
+
+            /* Refresh stale endpoints in the background */
+            if (DS_GetMonotonicTime() >= dest->info.expiry)
+                request_lookup (dest);
+
+            /* Address is not known yet */
+            if (!dest->info.resolved)
+                continue;
+
+            /* Connected sockets do not need a destination address */
+            msgs [num].addr = NULL;
+            msgs [num].addr_len = 0;
+            if (dest != ptr || !ptr->info.connected) {
+                memcpy (&addrs [num], dest->info.endpoint, dest->info.endpoint_len);
+                msgs [num].addr = &addrs [num];
+                msgs [num].addr_len = dest->info.endpoint_len;
+            }
+
+            msgs [num].bytes = 0;
+            msgs [num].buf = (char*) out->data;
+            msgs [num].buf_len = out->length;
+            index [num++] = offset;
+        }
+        pthread_mutex_unlock (&endpoint_lock);
+
+        /* Send the batch, re-send the datagrams that were not accepted */
+        while (done < num) {
+            int sent = udp_send_batch (ptr->info.sock_out, msgs + done, num - done, 0);
+            if (sent <= 0) {
+                if (interrupted())
+                    continue;
+
+                failed = 1;
+                break;
+            }
+
+            for (i = 0; i < sent; ++i)
+                datagrams [index [done + i]].sent = msgs [done + i].bytes;
+
+            done += sent;
+            total += sent;
+        }
     }
 
-    /* Delete temp. buffer */
-    DS_FREE (bytes);
+    /* Send the datagrams that could not be added to the batches */
+    for (i = 0; i < count && deferred > 0; ++i) {
+        DS_OutDatagram* out = &datagrams [i];
+        if (out->sent != SEND_DEFERRED)
+            continue;
+
+        --deferred;
+        out->sent = DS_SocketSendBytes (out->destination, out->data, out->length);
+        if (out->sent > 0)
+            ++total;
+        else
+            out->sent = -1;
+    }
 
-    /* Return error code */
-    return bytes_written;
+    return (total > 0 || !failed) ? total : -1;
 }
 
 /**
  * Changes the \a address of the given socket structre
  *
+ * The cached endpoint of the socket is invalidated and a new lookup is
+ * queued. UDP sockets are not re-opened, unless they failed to initialize.
+ *
  * \param ptr pointer to a \c DS_Socket structure
  * \param address the new address to apply to the socket
  */
@@ -364,11 +1394,26 @@ void DS_SocketChangeAddress (DS_Socket* ptr, const char* address)
     if (!address)
         return;
 
-    /* Re-assign the address */
-    memset (ptr->address, 0, sizeof (ptr->address));
-    memcpy (ptr->address, address, strlen (address));
+    /* Re-assign the address and invalidate the endpoint cache */
+    int reopen = 0;
+    pthread_mutex_lock (&endpoint_lock);
+    {
+        size_t len = DS_Min (strlen (address), sizeof (ptr->address) - 1);
+        memset (ptr->address, 0, sizeof (ptr->address));
+        memcpy (ptr->address, address, len);
+        invalidate_endpoint (ptr);
+
+        if (ptr->type == DS_SOCKET_UDP &&
+                ptr->info.client_init && ptr->info.server_init)
+            request_lookup (ptr);
+        else
+            reopen = 1;
+    }
+    pthread_mutex_unlock (&endpoint_lock);
 
     /* Re-open the socket */
-    DS_SocketClose (ptr);
-    DS_SocketOpen (ptr);
+    if (reopen) {
+        DS_SocketClose (ptr);
+        DS_SocketOpen (ptr);
+    }
 }
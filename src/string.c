@@ -37,6 +37,70 @@
     #endif
 #endif
 
+#define MIN_CAPACITY 16 /* Smallest buffer allocated when a string grows */
+
+/**
+ * Returns \c 1 if the given \a string points to memory owned by somebody
+ * else (a view). Views have a capacity of 0, while the buffers allocated by
+ * this module always have a capacity of at least one byte.
+ */
+static int is_view (const DS_String* string)
+{
+    return string->cap == 0 && string->buf != NULL;
+}
+
+/**
+ * Re-allocates the buffer of the given \a string so that it can hold
+ * exactly \a size bytes, the contents of the string are preserved.
+ *
+ * The buffer of a view is never re-allocated, its contents are copied to
+ * a new buffer instead (which is then owned by the string).
+ */
+static int reallocate (DS_String* string, size_t size)
+{
+    char* buf;
+    size_t cap = size > 0 ? size : 1;
+
+    if (is_view (string)) {
+        buf = (char*) malloc (cap);
+        if (buf)
+            memcpy (buf, string->buf, string->len < size ? string->len : size);
+    }
+
+    else
+        buf = (char*) realloc (string->buf, cap);
+
+    if (buf) {
+        string->buf = buf;
+        string->cap = cap;
+        return DS_STR_SUCCESS;
+    }
+
+    return DS_STR_FAILURE;
+}
+
+/**
+ * Ensures that the given \a string can hold at least \a size bytes. The
+ * capacity is doubled when the buffer is too small, so that appending
+ * bytes one at a time has an amortized constant cost.
+ */
+static int grow (DS_String* string, size_t size)
+{
+    /* Buffer is large enough (views are always copied) */
+    size_t cap = string->cap;
+    if (string->buf && size <= cap)
+        return DS_STR_SUCCESS;
+
+    /* Calculate new capacity */
+    size_t new_cap = cap * 2;
+    if (new_cap < MIN_CAPACITY)
+        new_cap = MIN_CAPACITY;
+    if (new_cap < size)
+        new_cap = size;
+
+    return reallocate (string, new_cap);
+}
+
 /**
  * Returns the length of the given \a string
  * \warning The program will quit if \a string is \c NULL
@@ -94,7 +158,8 @@ int DS_StrCompare (const DS_String* a, const DS_String* b)
 /**
  * Deletes the data buffer of the given \a string.
  * If the data buffer is already freed, then this function
- * shall have no effect.
+ * shall have no effect. The buffer of a view is not freed,
+ * the string just stops pointing to it.
  *
  * \warning The program will quit if \a string is \c NULL
  */
@@ -105,8 +170,11 @@ int DS_StrRmBuf (DS_String* string)
 
     /* Delete the buffer */
     if (string->buf != NULL) {
+        if (!is_view (string))
+            free (string->buf);
+
         string->len = 0;
-        free (string->buf);
+        string->cap = 0;
         string->buf = NULL;
         return DS_STR_SUCCESS;
     }
@@ -116,46 +184,66 @@ int DS_StrRmBuf (DS_String* string)
 }
 
 /**
- * Resizes the given \a string to the given \a size
+ * Resizes the given \a string to the given \a size, new bytes are set
+ * to 0. The buffer is only re-allocated if the \a size exceeds the
+ * capacity of the string.
  *
  * \param string the original string structure
  * \param size the new size to apply to the string
  *
  * \warning The program will quit if \a string is \c NULL
- * \warning The program will quit if buffer of the \a string is \c NULL
  */
 int DS_StrResize (DS_String* string, size_t size)
 {
     /* Check arguments */
     assert (string);
-    assert (string->buf);
 
-    /* Initialize variables */
-    int i;
-    int oldSize = (int) string->len;
+    /* Make room for the new size */
+    if (!grow (string, size))
+        return DS_STR_FAILURE;
 
-    /* Copy old buffer */
-    char* copy = calloc (oldSize, sizeof (char));
-    for (i = 0; i < oldSize; ++i)
-        copy [i] = string->buf [i];
+    /* Clear the new bytes */
+    if (size > string->len)
+        memset (string->buf + string->len, 0, size - string->len);
 
-    /* Re-initialize the buffer */
-    free (string->buf);
-    string->buf = calloc (size, sizeof (char));
+    string->len = size;
+    return DS_STR_SUCCESS;
+}
 
-    /* Copy old buffer into start of new buffer */
-    if (string->buf) {
-        string->len = size;
-        for (i = 0; i < oldSize; ++i)
-            string->buf [i] = copy [i];
+/**
+ * Ensures that the given \a string can hold at least \a size bytes without
+ * re-allocating its buffer. The length of the string is not changed.
+ *
+ * \warning The program will quit if \a string is \c NULL
+ */
+int DS_StrReserve (DS_String* string, size_t size)
+{
+    /* Check arguments */
+    assert (string);
 
-        free (copy);
+    /* Buffer is already large enough */
+    if (string->buf && size <= string->cap)
         return DS_STR_SUCCESS;
-    }
 
-    /* Could not initialize the buffer, restore data */
-    string->buf = copy;
-    return DS_STR_FAILURE;
+    /* Never drop the contents of a view */
+    return reallocate (string, size > string->len ? size : string->len);
+}
+
+/**
+ * Releases the unused capacity of the given \a string
+ *
+ * \warning The program will quit if \a string is \c NULL
+ */
+int DS_StrShrink (DS_String* string)
+{
+    /* Check arguments */
+    assert (string);
+
+    /* Nothing to release */
+    if (!string->buf || string->cap <= string->len)
+        return DS_STR_SUCCESS;
+
+    return reallocate (string, string->len);
 }
 
 /**
@@ -165,22 +253,48 @@ int DS_StrResize (DS_String* string, size_t size)
  * \param byte the value to append at the end of the string
  *
  * \warning The program will quit if \a string is \c NULL
- * \warning The program will quit if buffer of the \a string is \c NULL
  */
 int DS_StrAppend (DS_String* string, const uint8_t byte)
 {
     /* Check arguments */
     assert (string);
-    assert (string->buf);
 
-    /* Resize string and add extra character */
-    if (DS_StrResize (string, string->len + 1)) {
-        string->buf [string->len - 1] = byte;
+    /* Make room for the new byte */
+    if (!grow (string, string->len + 1))
+        return DS_STR_FAILURE;
+
+    /* Add the byte */
+    string->buf [string->len++] = (char) byte;
+    return DS_STR_SUCCESS;
+}
+
+/**
+ * Appends \a len bytes from the given \a bytes buffer to the end of
+ * the given \a string
+ *
+ * \param string the original string
+ * \param bytes the data to append at the end of the string
+ * \param len the number of bytes to append
+ *
+ * \warning The program will quit if \a string is \c NULL
+ */
+int DS_StrAppendBytes (DS_String* string, const void* bytes, size_t len)
+{
+    /* Check arguments */
+    assert (string);
+
+    /* Nothing to append */
+    if (!bytes || len == 0)
         return DS_STR_SUCCESS;
-    }
 
-    /* String cannot be resized */
-    return DS_STR_FAILURE;
+    /* Make room for the new bytes */
+    if (!grow (string, string->len + len))
+        return DS_STR_FAILURE;
+
+    /* Copy the bytes */
+    memcpy (string->buf + string->len, bytes, len);
+    string->len += len;
+    return DS_STR_SUCCESS;
 }
 
 /**
@@ -196,24 +310,8 @@ int DS_StrJoin (DS_String* first, const DS_String* second)
     /* Check arguments */
     assert (second);
     assert (first);
-    assert (second->buf);
-    assert (first->buf);
-
-    /* Get length of initial string */
-    int append_len = (int) second->len;
-    int original_len = (int) first->len;
-
-    /* Resize the string and append the other string */
-    if (DS_StrResize (first, original_len + append_len)) {
-        int i;
-        for (i = 0; i < append_len; ++i)
-            first->buf [original_len + i] = second->buf [i];
 
-        return DS_STR_SUCCESS;
-    }
-
-    /* String cannot be resized */
-    return DS_STR_FAILURE;
+    return DS_StrAppendBytes (first, second->buf, second->len);
 }
 
 /**
@@ -227,15 +325,7 @@ int DS_StrJoinCStr (DS_String* string, const char* cstring)
     assert (string);
     assert (cstring);
 
-    /* Append each character to the string */
-    int i;
-    int len = (int) strlen (cstring);
-    for (i = 0; i < len; ++i)
-        if (!DS_StrAppend (string, cstring [i]))
-            return DS_STR_FAILURE;
-
-    /* Tell everyone how smart this function is */
-    return DS_STR_SUCCESS;
+    return DS_StrAppendBytes (string, cstring, strlen (cstring));
 }
 
 /**
@@ -254,8 +344,11 @@ int DS_StrSetChar (DS_String* string, const int pos, const char byte)
     assert (string);
     assert (string->buf);
 
-    /* Change the character at the given position */
+    /* Change the character at the given position (copy views first) */
     if (abs (pos) < (int) string->len) {
+        if (is_view (string) && !reallocate (string, string->len))
+            return DS_STR_FAILURE;
+
         string->buf [abs (pos)] = byte;
         return DS_STR_SUCCESS;
     }
@@ -280,9 +373,8 @@ char* DS_StrToChar (const DS_String* string)
     char* cstr = (char*) calloc (len, sizeof (char));
 
     /* Copy buffer data into c-string */
-    int i;
-    for (i = 0; i < (int) string->len; ++i)
-        cstr [i] = string->buf [i];
+    if (string->len > 0)
+        memcpy (cstr, string->buf, string->len);
 
     /* Add NULL-terminator */
     cstr [string->len] = 0;
@@ -334,9 +426,8 @@ DS_String DS_StrNew (const char* string)
     DS_String str = DS_StrNewLen (strlen (string));
 
     /* Copy C string data into buffer */
-    int i;
-    for (i = 0; i < (int) str.len; ++i)
-        str.buf [i] = string [i];
+    if (str.len > 0)
+        memcpy (str.buf, string, str.len);
 
     /* Return obtained string */
     return str;
@@ -349,7 +440,8 @@ DS_String DS_StrNewLen (const size_t length)
 {
     DS_String string;
     string.len = length;
-    string.buf = (char*) calloc (string.len, sizeof (char));
+    string.cap = length > 0 ? length : 1;
+    string.buf = (char*) calloc (string.cap, sizeof (char));
     return string;
 }
 
@@ -367,10 +459,9 @@ DS_String DS_StrDup (const DS_String* source)
     /* Create new empty string */
     DS_String string = DS_StrNewLen (source->len);
 
-    /* Copy each character to the new string */
-    int i;
-    for (i = 0; i < (int) string.len; ++i)
-        string.buf [i] = source->buf [i];
+    /* Copy the buffer to the new string */
+    if (string.len > 0)
+        memcpy (string.buf, source->buf, string.len);
 
     /* Return the copy */
     return string;
@@ -395,11 +486,11 @@ DS_String DS_StrFormat (const char* format, ...)
     assert (format);
 
     /* Initialize variables */
-    int init_len = 0;
     const char* f = format;
 
-    /* Initialize string */
-    DS_String string = DS_StrNewLen (init_len);
+    /* Initialize string (most strings are a bit longer than the format) */
+    DS_String string = DS_StrNewLen (0);
+    DS_StrReserve (&string, strlen (format) * 2);
 
     /* Initialize argument list */
     va_list args;
@@ -429,11 +520,8 @@ DS_String DS_StrFormat (const char* format, ...)
                 else if (next == 'f')
                     SPRINTF_S (str, sizeof (str), "%.2f", (double) va_arg (args, double));
 
-                /* Append every character to the string */
-                int i = 0;
-                int len = (int) strlen (str);
-                for (i = 0; i < len; ++i)
-                    DS_StrAppend (&string, str [i]);
+                /* Append the number to the string */
+                DS_StrAppendBytes (&string, str, strlen (str));
             }
 
             /* Handle characters */
@@ -443,12 +531,7 @@ DS_String DS_StrFormat (const char* format, ...)
             /* Handle strings */
             else if (next == 's') {
                 char* str = (char*) va_arg (args, char*);
-                int len = (int) strlen (str);
-
-                /* Append every character to the string */
-                int i = 0;
-                for (i = 0; i < len; ++i)
-                    DS_StrAppend (&string, str [i]);
+                DS_StrAppendBytes (&string, str, strlen (str));
             }
 
             /* Handle everything else */
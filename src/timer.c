@@ -22,72 +22,307 @@
  */
 
 #include "DS_Utils.h"
-#include "DS_Array.h"
 #include "DS_Timer.h"
 
 #include <stdio.h>
+#include <errno.h>
 #include <assert.h>
 
 #if defined _WIN32
     #include <windows.h>
+    #include <sys/timeb.h>
 #else
+    #include <time.h>
     #include <unistd.h>
+    #include <sys/time.h>
 #endif
 
-static DS_Array timers;
+/*
+ * Use monotonic condition variables and absolute sleeps where supported
+ */
+#if !defined _WIN32 && !defined __APPLE__
+    #define MONOTONIC_CONDS
+    #define ABSOLUTE_SLEEP
+#endif
+
+#define MAX_TIMERS 32                 /* Maximum number of scheduled timers */
+#define NSECS_PER_MSEC 1000000ULL     /* Nanoseconds in a millisecond */
+#define NSECS_PER_SEC  1000000000ULL  /* Nanoseconds in a second */
+
+/*
+ * Min-heap of the enabled timers, ordered by deadline
+ */
+static int timer_count = 0;
+static DS_Timer* queue [MAX_TIMERS];
+
+/*
+ * Scheduler thread and its synchronization objects
+ */
 static int running = 0;
+static pthread_t scheduler_thread;
+static pthread_cond_t scheduler_cond;
+static pthread_mutex_t scheduler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Timer whose callback is being called (without holding the scheduler lock),
+ * the callback condition is signaled when the callback returns
+ */
+static DS_Timer* current_callback = NULL;
+static pthread_cond_t callback_cond;
+
+/*
+ * Scheduler statistics
+ */
+static uint64_t stats_start = 0;
+static uint64_t stats_wakeups = 0;
+static uint64_t stats_expirations = 0;
+static uint64_t stats_total_drift = 0;
+static uint64_t stats_max_drift = 0;
+
+/**
+ * Stores the given \a timer in the given \a index of the queue
+ */
+static void place (DS_Timer* timer, int index)
+{
+    queue [index] = timer;
+    timer->index = index;
+}
+
+/**
+ * Moves the timer at the given \a index towards the top of the queue
+ */
+static void sift_up (int index)
+{
+    DS_Timer* timer = queue [index];
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (queue [parent]->deadline <= timer->deadline)
+            break;
+
+        place (queue [parent], index);
+        index = parent;
+    }
+
+    place (timer, index);
+}
+
+/**
+ * Moves the timer at the given \a index towards the bottom of the queue
+ */
+static void sift_down (int index)
+{
+    DS_Timer* timer = queue [index];
+
+    for (;;) {
+        int child = index * 2 + 1;
+        if (child >= timer_count)
+            break;
+
+        if (child + 1 < timer_count &&
+                queue [child + 1]->deadline < queue [child]->deadline)
+            ++child;
+
+        if (timer->deadline <= queue [child]->deadline)
+            break;
+
+        place (queue [child], index);
+        index = child;
+    }
+
+    place (timer, index);
+}
+
+/**
+ * Removes the given \a timer from the queue (if it is scheduled)
+ */
+static void unschedule (DS_Timer* timer)
+{
+    int index = timer->index;
+    if (index < 0 || index >= timer_count || queue [index] != timer)
+        return;
+
+    timer->index = -1;
+
+    /* Fill the gap with the last timer of the queue */
+    if (--timer_count > index) {
+        DS_Timer* last = queue [timer_count];
+        place (last, index);
+        sift_up (index);
+        sift_down (last->index);
+    }
+}
 
 /**
- * Updates the properties of the given \a timer
- * This function is called in a separate thread for each timer that we use.
- * This is **not** the best way to implement a timer, but its effective,
- * easy to understand and efficient. Also, this implementation does not need
- * to play with the kernel/OS to compare elapsed times periodically.
+ * Schedules (or re-schedules) the given \a timer to expire at the given
+ * \a deadline and wakes the scheduler if the timer is now the next one
+ * to expire.
  */
-static void* update_timer (void* ptr)
+static void schedule (DS_Timer* timer, const uint64_t deadline)
 {
-    assert (ptr);
-    DS_Timer* timer = (DS_Timer*) ptr;
+    timer->deadline = deadline;
+
+    /* Update the position of an already scheduled timer */
+    if (timer->index >= 0 && timer->index < timer_count &&
+            queue [timer->index] == timer) {
+        sift_up (timer->index);
+        sift_down (timer->index);
+    }
+
+    /* Insert the timer in the queue */
+    else {
+        assert (timer_count < MAX_TIMERS);
+        if (timer_count >= MAX_TIMERS)
+            return;
+
+        place (timer, timer_count++);
+        sift_up (timer->index);
+    }
 
-    while (running == 1) {
-        if (timer->enabled && timer->time > 0 && !timer->expired) {
-            timer->elapsed += timer->precision;
+    /* Let the scheduler re-calculate its sleep time */
+    if (timer->index == 0)
+        pthread_cond_signal (&scheduler_cond);
+}
 
-            if (timer->elapsed >= timer->time)
-                timer->expired = 1;
+/**
+ * Marks every timer whose deadline has passed as expired, re-arms the
+ * periodic timers and stores the timers with callbacks in \a fired.
+ *
+ * \returns the number of timers stored in \a fired
+ */
+static int expire_timers (const uint64_t now, DS_Timer** fired)
+{
+    int count = 0;
+
+    while (timer_count > 0 && queue [0]->deadline <= now) {
+        DS_Timer* timer = queue [0];
+
+        /* Update statistics */
+        uint64_t drift = now - timer->deadline;
+        stats_total_drift += drift;
+        ++stats_expirations;
+        if (drift > stats_max_drift)
+            stats_max_drift = drift;
+
+        /* Expire the timer */
+        timer->expired = 1;
+        if (timer->callback) {
+            timer->pending = 1;
+            fired [count++] = timer;
+        }
+
+        /* Re-arm periodic timers from their previous deadline (no drift) */
+        if (timer->periodic) {
+            uint64_t period = (uint64_t) timer->time * NSECS_PER_MSEC;
+            uint64_t deadline = timer->deadline + period;
+            if (deadline <= now)
+                deadline = now + period - (now - deadline) % period;
+
+            timer->deadline = deadline;
+            sift_down (0);
         }
 
-        DS_Sleep (timer->precision);
+        /* Remove one-shot timers */
+        else
+            unschedule (timer);
+    }
+
+    return count;
+}
+
+/**
+ * Sleeps until the next timer deadline, expires the timers and calls their
+ * callbacks. Callbacks are called without holding the scheduler lock, so
+ * they may start, stop or reset timers. The callback of a timer that was
+ * stopped after it expired is not called.
+ */
+static void* run_scheduler (void* ptr)
+{
+    (void) ptr;
+
+    DS_Timer* fired [MAX_TIMERS];
+
+    pthread_mutex_lock (&scheduler_lock);
+    while (running) {
+        /* Wait for the next deadline (or until a timer is scheduled) */
+        uint64_t now = DS_GetMonotonicTime();
+        if (timer_count == 0)
+            pthread_cond_wait (&scheduler_cond, &scheduler_lock);
+        else if (queue [0]->deadline > now)
+            DS_CondWaitUntil (&scheduler_cond, &scheduler_lock,
+                              queue [0]->deadline);
+
+        /* Expire timers */
+        ++stats_wakeups;
+        int count = expire_timers (DS_GetMonotonicTime(), fired);
+
+        /* Call the callbacks of the timers that were not stopped */
+        int i;
+        for (i = 0; i < count; ++i) {
+            DS_Timer* timer = fired [i];
+            if (!timer->pending)
+                continue;
+
+            timer->pending = 0;
+            current_callback = timer;
+            pthread_mutex_unlock (&scheduler_lock);
+            timer->callback (timer);
+            pthread_mutex_lock (&scheduler_lock);
+            current_callback = NULL;
+            pthread_cond_broadcast (&callback_cond);
+        }
     }
+    pthread_mutex_unlock (&scheduler_lock);
 
     return NULL;
 }
 
 /**
- * Initializes the timer array, which is used to keep track of all the timers
- * used by the library. We need to do this so that we can terminate each timer
- * thread once the module is closed.
+ * Starts the scheduler thread, which is used to expire every timer used by
+ * the library
  */
 void Timers_Init (void)
 {
+    /* Initialize the scheduler */
+    DS_CondInit (&scheduler_cond);
+    DS_CondInit (&callback_cond);
+    DS_ResetTimerStats();
     running = 1;
-    DS_ArrayInit (&timers, 10);
+
+    /* Configure the thread */
+    int error = pthread_create (&scheduler_thread, NULL,
+                                &run_scheduler, NULL);
+
+    /* Check if thread was started */
+    assert (!error);
 }
 
 /**
- * Breaks all the timer loops and stops every thread used by this module
+ * Stops the scheduler thread and removes every timer from the queue
  */
 void Timers_Close (void)
 {
+    /* Stop the scheduler */
+    pthread_mutex_lock (&scheduler_lock);
     running = 0;
-    DS_ArrayFree (&timers);
+    pthread_cond_signal (&scheduler_cond);
+    pthread_mutex_unlock (&scheduler_lock);
+    pthread_join (scheduler_thread, NULL);
+
+    /* Clear the queue */
+    pthread_mutex_lock (&scheduler_lock);
+    while (timer_count > 0)
+        unschedule (queue [0]);
+    pthread_mutex_unlock (&scheduler_lock);
+
+    /* Release the condition variables */
+    pthread_cond_destroy (&scheduler_cond);
+    pthread_cond_destroy (&callback_cond);
 }
 
 /**
  * Pauses the execution state of the program/thread for the given
  * number of \a millisecs.
- *
- * We use this function to update each timer based on its precision
  */
 void DS_Sleep (const int millisecs)
 {
@@ -99,27 +334,194 @@ void DS_Sleep (const int millisecs)
 }
 
 /**
- * Resets and disables the given \a timer
+ * Pauses the execution state of the program/thread until the monotonic
+ * clock reaches the given \a deadline (in nanoseconds).
+ *
+ * Sleeping until an absolute time (instead of sleeping for a duration)
+ * ensures that the time spent before calling this function does not delay
+ * the wakeup.
+ */
+void DS_SleepUntil (const uint64_t deadline)
+{
+#if defined ABSOLUTE_SLEEP
+    struct timespec ts;
+    ts.tv_sec = (time_t) (deadline / NSECS_PER_SEC);
+    ts.tv_nsec = (long) (deadline % NSECS_PER_SEC);
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#else
+    uint64_t now = DS_GetMonotonicTime();
+    if (deadline <= now)
+        return;
+
+#if defined _WIN32
+    Sleep ((DWORD) ((deadline - now + NSECS_PER_MSEC - 1) / NSECS_PER_MSEC));
+#else
+    usleep ((useconds_t) ((deadline - now) / 1000));
+#endif
+#endif
+}
+
+/**
+ * Returns the current value of the monotonic clock in nanoseconds.
+ *
+ * The returned value has no relation to the wall-clock time, it is only
+ * useful to compare it against other values returned by this function
+ * (e.g. to measure elapsed times or to check if a cached value is stale).
+ */
+uint64_t DS_GetMonotonicTime (void)
+{
+#if defined _WIN32
+    LARGE_INTEGER count;
+    static LARGE_INTEGER frequency;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency (&frequency);
+
+    QueryPerformanceCounter (&count);
+    return (uint64_t) ((count.QuadPart / frequency.QuadPart) * 1000000000ULL +
+                       ((count.QuadPart % frequency.QuadPart) * 1000000000ULL) /
+                       frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+/**
+ * Clears the statistics of the timer scheduler
+ */
+void DS_ResetTimerStats (void)
+{
+    pthread_mutex_lock (&scheduler_lock);
+    stats_start = DS_GetMonotonicTime();
+    stats_wakeups = 0;
+    stats_expirations = 0;
+    stats_total_drift = 0;
+    stats_max_drift = 0;
+    pthread_mutex_unlock (&scheduler_lock);
+}
+
+/**
+ * Copies the statistics of the timer scheduler to the given \a stats.
+ * Divide the number of wakeups by the uptime to obtain the wakeup rate.
+ * The drift is the time between the deadline of a timer and the moment in
+ * which the scheduler expired it.
+ */
+void DS_GetTimerStats (DS_TimerStats* stats)
+{
+    assert (stats);
+
+    pthread_mutex_lock (&scheduler_lock);
+    stats->uptime = DS_GetMonotonicTime() - stats_start;
+    stats->wakeups = stats_wakeups;
+    stats->expirations = stats_expirations;
+    stats->max_drift = stats_max_drift;
+    stats->avg_drift = 0;
+    if (stats_expirations > 0)
+        stats->avg_drift = stats_total_drift / stats_expirations;
+    pthread_mutex_unlock (&scheduler_lock);
+}
+
+/**
+ * Initializes the given condition variable so that it can be used with
+ * \c DS_CondWaitUntil()
+ */
+void DS_CondInit (pthread_cond_t* cond)
+{
+    assert (cond);
+
+#if defined MONOTONIC_CONDS
+    pthread_condattr_t attr;
+    pthread_condattr_init (&attr);
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+    pthread_cond_init (cond, &attr);
+    pthread_condattr_destroy (&attr);
+#else
+    pthread_cond_init (cond, NULL);
+#endif
+}
+
+/**
+ * Waits on the given \a cond until it is signaled or until the monotonic
+ * clock reaches the given \a deadline (in nanoseconds).
+ *
+ * \returns \c 0 if the condition was signaled, \c ETIMEDOUT otherwise
+ */
+int DS_CondWaitUntil (pthread_cond_t* cond, pthread_mutex_t* mutex,
+                      const uint64_t deadline)
+{
+    assert (cond);
+    assert (mutex);
+
+    struct timespec ts;
+
+#if defined MONOTONIC_CONDS
+    ts.tv_sec = (time_t) (deadline / NSECS_PER_SEC);
+    ts.tv_nsec = (long) (deadline % NSECS_PER_SEC);
+#else
+    /* Convert the deadline to wall-clock time */
+    uint64_t now = DS_GetMonotonicTime();
+    uint64_t wait = deadline > now ? deadline - now : 0;
+    uint64_t wall;
+
+#if defined _WIN32
+    struct __timeb64 tb;
+    _ftime64 (&tb);
+    wall = (uint64_t) tb.time * NSECS_PER_SEC + tb.millitm * NSECS_PER_MSEC;
+#else
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    wall = (uint64_t) tv.tv_sec * NSECS_PER_SEC + tv.tv_usec * 1000ULL;
+#endif
+
+    wall += wait;
+    ts.tv_sec = (time_t) (wall / NSECS_PER_SEC);
+    ts.tv_nsec = (long) (wall % NSECS_PER_SEC);
+#endif
+
+    return pthread_cond_timedwait (cond, mutex, &ts);
+}
+
+/**
+ * Resets and disables the given \a timer. The callback of the timer is not
+ * called after this function returns: a pending callback is cancelled and
+ * a callback that is already running is waited for (unless the timer is
+ * stopped by a callback, which would wait for itself).
  */
 void DS_TimerStop (DS_Timer* timer)
 {
     assert (timer);
 
+    pthread_mutex_lock (&scheduler_lock);
     timer->enabled = 0;
     timer->expired = 0;
-    timer->elapsed = 0;
+    timer->pending = 0;
+    unschedule (timer);
+
+    while (current_callback == timer &&
+           !pthread_equal (pthread_self(), scheduler_thread))
+        pthread_cond_wait (&callback_cond, &scheduler_lock);
+    pthread_mutex_unlock (&scheduler_lock);
 }
 
 /**
- * Resets and enables the given \a timer
+ * Resets and enables the given \a timer, the timer will expire once its
+ * time has elapsed (timers with a time of \c 0 never expire)
  */
 void DS_TimerStart (DS_Timer* timer)
 {
     assert (timer);
 
+    pthread_mutex_lock (&scheduler_lock);
     timer->enabled = 1;
     timer->expired = 0;
-    timer->elapsed = 0;
+    if (timer->time > 0)
+        schedule (timer, DS_GetMonotonicTime() +
+                  (uint64_t) timer->time * NSECS_PER_MSEC);
+    else
+        unschedule (timer);
+    pthread_mutex_unlock (&scheduler_lock);
 }
 
 /**
@@ -129,20 +531,20 @@ void DS_TimerReset (DS_Timer* timer)
 {
     assert (timer);
 
+    pthread_mutex_lock (&scheduler_lock);
     timer->expired = 0;
-    timer->elapsed = 0;
+    if (timer->enabled && timer->time > 0)
+        schedule (timer, DS_GetMonotonicTime() +
+                  (uint64_t) timer->time * NSECS_PER_MSEC);
+    pthread_mutex_unlock (&scheduler_lock);
 }
 
 /**
- * Initializes the given \a timer with the given \a time and \a precision.
- * The timers are updated using a threaded while loop (that sleeps the number
- * of milliseconds specified with \a precision). As stated before, this is
- * probably not the best timer implementation out there, but its simple and
- * it works perfectly for this library.
+ * Initializes the given \a timer with the given \a time.
  *
- * A word of advice, using a higher \a precision (lower value in msecs) will
- * result in increased CPU usage, this thing does not have morals and will eat
- * the whole cake if you allow it.
+ * Timers do not poll, the scheduler thread sleeps until the deadline of
+ * the next timer (measured with the monotonic clock) and expires it. The
+ * \a precision is kept for compatibility with older versions of LibDS.
  */
 void DS_TimerInit (DS_Timer* timer, const int time, const int precision)
 {
@@ -154,18 +556,36 @@ void DS_TimerInit (DS_Timer* timer, const int time, const int precision)
         return;
 
     /* Configure the timer */
+    timer->index = -1;
     timer->enabled = 0;
     timer->expired = 0;
-    timer->elapsed = 0;
+    timer->periodic = 0;
+    timer->pending = 0;
+    timer->deadline = 0;
     timer->time = time;
+    timer->data = NULL;
+    timer->callback = NULL;
     timer->initialized = 1;
     timer->precision = precision;
+}
 
-    /* Configure the thread */
-    pthread_t thread;
-    int error = pthread_create (&thread, NULL,
-                                &update_timer, (void*) timer);
+/**
+ * Sets the function to call when the given \a timer expires. The
+ * \a callback is called from the scheduler thread, so it should return
+ * quickly (e.g. by waking up another thread).
+ *
+ * \param timer the timer to configure
+ * \param callback the function to call, or \c NULL to only set \a expired
+ * \param data user data, available as \c timer->data in the callback
+ */
+void DS_TimerSetCallback (DS_Timer* timer,
+                          void (*callback) (DS_Timer*),
+                          void* data)
+{
+    assert (timer);
 
-    /* Check if thread was started */
-    assert (!error);
+    pthread_mutex_lock (&scheduler_lock);
+    timer->data = data;
+    timer->callback = callback;
+    pthread_mutex_unlock (&scheduler_lock);
 }
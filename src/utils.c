@@ -37,16 +37,19 @@
 
 /**
  * Returns a single byte value that represents the ratio between the
- * given \a value and the maximum number specified.
+ * given \a value and the maximum number specified (as a signed byte in
+ * the -127 to 127 range, see \c DS_QuantizeAxes for details).
  */
 uint8_t DS_FloatToByte (const float value, const float max)
 {
-    if (value != 0 && max != 0 && value <= max) {
-        int percent = (int) ((value / max) * (0xFF / 2));
-        return (uint8_t) (percent & 0xFF);
+    int8_t byte = 0;
+
+    if (max != 0) {
+        float ratio = value / max;
+        DS_QuantizeAxes (&ratio, &byte, 1);
     }
 
-    return 0;
+    return (uint8_t) byte;
 }
 
 /**
@@ -0,0 +1,30 @@
+#-------------------------------------------------------------------------------
+# Standalone test, the CRC32 module is compiled into the test program so
+# that each implementation can be tested and measured on its own
+#-------------------------------------------------------------------------------
+
+TARGET = crc32-test
+
+CONFIG += console
+CONFIG += testcase
+
+CONFIG -= qt
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../common
+INCLUDEPATH += $$PWD/../../include
+
+!macx* {
+    LIBS += -pthread
+}
+
+linux* {
+    LIBS += -lrt
+}
+
+HEADERS += \
+    $$PWD/../common/DS_Test.h
+
+SOURCES += \
+    $$PWD/main.c \
+    $$PWD/../../src/timer.c
@@ -0,0 +1,266 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests the CRC32 module, every implementation is compared against a
+ * bitwise reference (without lookup tables):
+ *     - Table-driven, slice-by-8 and PCLMULQDQ (when the CPU has it) code,
+ *       for every length from 0 to 4096 bytes and every start alignment
+ *     - DS_CRC32Update() with each combination of implementation flags,
+ *       including data that is split in several blocks
+ *     - DS_CRC32Combine() of every split point of a buffer
+ *     - Throughput benchmark of each implementation
+ *
+ * The reference checksums of every length are computed incrementally (one
+ * byte at a time) before the tests, so that the slow bitwise reference does
+ * not need to process each buffer again.
+ *
+ * The CRC32 module is included directly, so that its static functions and
+ * implementation flags can be used by the test.
+ */
+
+#include "../../src/crc32.c"
+#include "DS_Test.h"
+#include "DS_Timer.h"
+
+#define MAX_LENGTH 4096
+#define MAX_OFFSET 16
+#define BENCH_SIZE (64 * 1024)
+#define BENCH_ROUNDS 256
+
+/*
+ * Random test data (with room for every start offset)
+ */
+static uint8_t data [MAX_LENGTH + MAX_OFFSET];
+static uint8_t bench_data [BENCH_SIZE];
+
+/*
+ * Reference checksums of the first N bytes of the data at each start
+ * offset, and of the first N bytes of the data (used as a chained initial
+ * checksum for the data at each offset)
+ */
+static uint32_t expected [MAX_OFFSET][MAX_LENGTH + 1];
+static uint32_t prefix [MAX_LENGTH + MAX_OFFSET + 1];
+
+/*
+ * Keeps the benchmarked checksums from being optimized out
+ */
+static volatile uint32_t bench_sink;
+
+/**
+ * Bitwise CRC32 reference implementation
+ */
+static uint32_t reference (uint32_t crc, const uint8_t* p, size_t size)
+{
+    int bit;
+    crc ^= 0xFFFFFFFFUL;
+
+    while (size--) {
+        crc ^= *p++;
+        for (bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (CRC32_POLY & (0 - (crc & 1)));
+    }
+
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+/**
+ * Fills the given \a buffer with pseudo-random bytes
+ */
+static void fill_random (uint8_t* buffer, const size_t size)
+{
+    size_t i;
+    uint32_t state = 0x12345678;
+    for (i = 0; i < size; ++i) {
+        state = state * 1103515245 + 12345;
+        buffer [i] = (uint8_t) (state >> 16);
+    }
+}
+
+/**
+ * Computes the reference checksums of every length and start offset
+ */
+static void compute_references (void)
+{
+    size_t length, offset;
+
+    for (offset = 0; offset < MAX_OFFSET; ++offset) {
+        expected [offset][0] = 0;
+        for (length = 1; length <= MAX_LENGTH; ++length) {
+            expected [offset][length] = reference (expected [offset][length - 1],
+                                                   data + offset + length - 1, 1);
+        }
+    }
+
+    prefix [0] = 0;
+    for (length = 1; length <= MAX_LENGTH + MAX_OFFSET; ++length)
+        prefix [length] = reference (prefix [length - 1], data + length - 1, 1);
+}
+
+/**
+ * Compares the given internal implementation (which works with inverted
+ * checksums) with the reference for every length and start offset
+ */
+static void check_implementation (const char* name,
+                                  uint32_t (*crc32) (uint32_t, const uint8_t*, size_t),
+                                  const size_t min_length, const size_t step)
+{
+    size_t length, offset;
+    int failures = ds_test_failures;
+    DS_TEST (name);
+
+    for (offset = 0; offset < MAX_OFFSET; ++offset) {
+        for (length = min_length; length <= MAX_LENGTH; length += step) {
+            const uint8_t* p = data + offset;
+
+            /* Checksum of the data and of the data after its prefix */
+            uint32_t crc = crc32 (0xFFFFFFFFUL, p, length) ^ 0xFFFFFFFFUL;
+            DS_CHECK (crc == expected [offset][length]);
+            crc = crc32 (prefix [offset] ^ 0xFFFFFFFFUL, p, length) ^ 0xFFFFFFFFUL;
+            DS_CHECK (crc == prefix [offset + length]);
+
+            if (ds_test_failures != failures) {
+                printf ("  mismatch at length %d, offset %d\n",
+                        (int) length, (int) offset);
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Compares DS_CRC32Update() with the reference for every length and start
+ * offset, with the data processed in one block and in three blocks
+ */
+static void check_update (const char* name)
+{
+    size_t length, offset;
+    int failures = ds_test_failures;
+    DS_TEST (name);
+
+    for (offset = 0; offset < MAX_OFFSET; ++offset) {
+        for (length = 0; length <= MAX_LENGTH; ++length) {
+            const uint8_t* p = data + offset;
+            DS_CHECK (DS_CRC32Update (0, p, length) == expected [offset][length]);
+
+            size_t a = length / 3;
+            size_t b = length - length / 4;
+            uint32_t crc = DS_CRC32Update (0, p, a);
+            crc = DS_CRC32Update (crc, p + a, b - a);
+            crc = DS_CRC32Update (crc, p + b, length - b);
+            DS_CHECK (crc == expected [offset][length]);
+
+            if (ds_test_failures != failures) {
+                printf ("  mismatch at length %d, offset %d\n",
+                        (int) length, (int) offset);
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Checks the combination of the checksums of every split of the data
+ */
+static void check_combine (void)
+{
+    size_t split;
+    DS_TEST ("DS_CRC32Combine matches the checksum of the whole buffer");
+
+    uint32_t whole = expected [0][MAX_LENGTH];
+    for (split = 0; split <= MAX_LENGTH; ++split) {
+        uint32_t crc1 = expected [0][split];
+        uint32_t crc2 = reference (0, data + split, MAX_LENGTH - split);
+        DS_CHECK (DS_CRC32Combine (crc1, crc2, MAX_LENGTH - split) == whole);
+    }
+}
+
+/**
+ * Measures the throughput of the given internal implementation
+ */
+static void bench_implementation (const char* name,
+                                  uint32_t (*crc32) (uint32_t, const uint8_t*, size_t),
+                                  const int rounds)
+{
+    int i;
+    uint32_t crc = 0xFFFFFFFFUL;
+    uint64_t start = DS_GetMonotonicTime();
+    for (i = 0; i < rounds; ++i)
+        crc = crc32 (crc, bench_data, BENCH_SIZE);
+
+    bench_sink = crc;
+    DS_BENCH (name, DS_GetMonotonicTime() - start, (uint64_t) rounds * BENCH_SIZE);
+}
+
+int main (void)
+{
+    fill_random (data, sizeof (data));
+    fill_random (bench_data, sizeof (bench_data));
+    compute_references();
+    pthread_once (&crc32_once, &crc32_init);
+
+    int slice8 = use_slice8;
+    int pclmul = use_pclmul;
+    printf ("slice-by-8: %s, PCLMULQDQ: %s\n",
+            slice8 ? "yes" : "no", pclmul ? "yes" : "no");
+
+    /* Compare each implementation with the reference */
+    check_implementation ("table-driven code matches the reference",
+                          &crc32_bytewise, 0, 1);
+    if (slice8) {
+        check_implementation ("slice-by-8 code matches the reference",
+                              &crc32_slice8, 0, 1);
+    }
+#if defined (CRC32_PCLMUL)
+    if (pclmul) {
+        check_implementation ("PCLMULQDQ code matches the reference",
+                              &crc32_pclmul, PCLMUL_MIN_SIZE, 16);
+    }
+#endif
+
+    /* Check the public functions with every implementation */
+    use_pclmul = 0;
+    use_slice8 = 0;
+    check_update ("DS_CRC32Update (table-driven)");
+    use_slice8 = slice8;
+    check_update ("DS_CRC32Update (slice-by-8)");
+    use_pclmul = pclmul;
+    check_update ("DS_CRC32Update (PCLMULQDQ and slice-by-8 tail)");
+    use_slice8 = 0;
+    check_update ("DS_CRC32Update (PCLMULQDQ and table-driven tail)");
+    use_slice8 = slice8;
+    check_combine();
+
+    /* Measure the throughput of each implementation */
+    DS_TEST ("throughput benchmark (64 KB buffer, time per byte)");
+    bench_implementation ("bitwise reference", &reference, BENCH_ROUNDS / 16);
+    bench_implementation ("table-driven", &crc32_bytewise, BENCH_ROUNDS);
+    if (slice8)
+        bench_implementation ("slice-by-8", &crc32_slice8, BENCH_ROUNDS);
+#if defined (CRC32_PCLMUL)
+    if (pclmul)
+        bench_implementation ("PCLMULQDQ", &crc32_pclmul, BENCH_ROUNDS);
+#endif
+
+    return DS_TEST_RESULT();
+}
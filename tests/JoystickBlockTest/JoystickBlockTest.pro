@@ -0,0 +1,6 @@
+TARGET = joystick-block-test
+
+include ($$PWD/../Tests.pri)
+
+SOURCES += \
+    $$PWD/main.c
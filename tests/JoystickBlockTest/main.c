@@ -0,0 +1,253 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests the cached joystick blocks of the FRC 2015 robot packet:
+ *     - The cached joystick data is equal to a fresh encoding of the
+ *       joysticks after their generation changes
+ *     - The cached joystick data follows the enabled state of the robot
+ *     - Joysticks are sent with the input counts allowed by the protocol
+ *     - Benchmarks the robot packet with idle and changing joysticks
+ */
+
+#include "LibDS.h"
+#include "DS_Test.h"
+
+#include <string.h>
+
+#define JOYSTICKS 6
+#define ITERATIONS 100000
+#define HEADER_SIZE 6
+
+static DS_Protocol protocol;
+
+/**
+ * Generates a robot packet with the protocol and returns its length
+ */
+static size_t create_packet (uint8_t* buf, size_t capacity)
+{
+    DS_PacketWriter writer;
+    DS_PacketWriterInit (&writer, buf, capacity);
+    protocol.create_robot_packet (&writer);
+    DS_CHECK (!writer.overflow);
+    return writer.length;
+}
+
+/**
+ * Encodes the joysticks like the 2015 protocol does, without any cache, the
+ * joystick values are neutralized if the robot is not \a enabled
+ */
+static size_t encode_joysticks (uint8_t* buf, size_t capacity,
+                                const int enabled)
+{
+    int i, j;
+    DS_PacketWriter writer;
+    DS_PacketWriterInit (&writer, buf, capacity);
+
+    for (i = 0; i < DS_Min (DS_GetJoystickCount(), protocol.max_joysticks); ++i) {
+        int num_axes = DS_Min (DS_GetJoystickNumAxes (i), protocol.max_axis_count);
+        int num_hats = DS_Min (DS_GetJoystickNumHats (i), protocol.max_hat_count);
+        int num_buttons = DS_Min (DS_GetJoystickNumButtons (i),
+                                  protocol.max_button_count);
+        uint32_t buttons = DS_GetJoystickButtons (i) & ((1u << num_buttons) - 1);
+
+        float values [DS_MAX_JOYSTICK_AXES] = {0};
+        int8_t axes [DS_MAX_JOYSTICK_AXES] = {0};
+        for (j = 0; j < num_axes; ++j)
+            values [j] = DS_GetJoystickAxis (i, j);
+
+        if (enabled)
+            DS_QuantizeAxes (values, axes, num_axes);
+
+        DS_PacketPutU8 (&writer, (uint8_t) (7 + num_axes + num_hats * 2));
+        DS_PacketPutU8 (&writer, 0x0c);
+        DS_PacketPutU8 (&writer, (uint8_t) num_axes);
+        DS_PacketPutBytes (&writer, axes, num_axes);
+        DS_PacketPutU8 (&writer, (uint8_t) num_buttons);
+        DS_PacketPutU16BE (&writer, enabled ? (uint16_t) buttons : 0);
+        DS_PacketPutU8 (&writer, (uint8_t) num_hats);
+        for (j = 0; j < num_hats; ++j)
+            DS_PacketPutU16BE (&writer,
+                               enabled ? (uint16_t) DS_GetJoystickHat (i, j) : 0);
+    }
+
+    DS_CHECK (!writer.overflow);
+    return writer.length;
+}
+
+/**
+ * Compares the joystick data of a new robot packet with a fresh encoding
+ */
+static int packet_matches (void)
+{
+    uint8_t packet [DS_MAX_PACKET_SIZE];
+    uint8_t expected [DS_MAX_PACKET_SIZE];
+
+    size_t length = create_packet (packet, sizeof (packet));
+    size_t expected_length = encode_joysticks (expected, sizeof (expected),
+                                               DS_GetRobotEnabled());
+
+    return length == HEADER_SIZE + expected_length &&
+           memcmp (packet + HEADER_SIZE, expected, expected_length) == 0;
+}
+
+/**
+ * Changes the values of the given \a joystick
+ */
+static void move_joystick (const int joystick, const int seed)
+{
+    int i;
+    for (i = 0; i < DS_GetJoystickNumAxes (joystick); ++i)
+        DS_SetJoystickAxis (joystick, i, (float) ((seed + i) % 21 - 10) / 10);
+
+    DS_SetJoystickHat (joystick, 0, (seed * 45) % 360);
+    DS_SetJoystickButton (joystick, seed % 10, seed & 1);
+}
+
+/**
+ * Checks the cached joystick data after every kind of change
+ */
+static void test_cache (void)
+{
+    int i;
+
+    DS_TEST ("cached joystick data is equal to a fresh encoding");
+    DS_CHECK (packet_matches());
+    DS_CHECK (packet_matches());
+
+    for (i = 0; i < 100; ++i) {
+        uint32_t generation = DS_GetJoystickGeneration (i % JOYSTICKS);
+        move_joystick (i % JOYSTICKS, i + JOYSTICKS);
+        DS_CHECK (DS_GetJoystickGeneration (i % JOYSTICKS) != generation);
+        DS_CHECK (packet_matches());
+    }
+
+    DS_TEST ("cached joystick data follows the enabled state");
+    for (i = 0; i < 10; ++i) {
+        DS_SetRobotEnabled (i & 1);
+        DS_CHECK (DS_GetRobotEnabled() == (i & 1));
+        DS_CHECK (packet_matches());
+        DS_CHECK (packet_matches());
+    }
+
+    /* Change a joystick while disabled, then enable the robot */
+    DS_SetRobotEnabled (0);
+    move_joystick (0, 7);
+    DS_CHECK (packet_matches());
+    DS_SetRobotEnabled (1);
+    DS_CHECK (packet_matches());
+}
+
+/**
+ * Checks that a joystick with more inputs than the protocol supports is
+ * sent with the protocol maxima
+ */
+static void test_clamping (void)
+{
+    int i;
+    uint8_t packet [DS_MAX_PACKET_SIZE];
+    DS_TEST ("input counts are clamped to the protocol maxima");
+
+    DS_SetRobotEnabled (1);
+    DS_JoysticksReset();
+    DS_JoysticksAdd (DS_MAX_JOYSTICK_AXES, DS_MAX_JOYSTICK_HATS,
+                     DS_MAX_JOYSTICK_BUTTONS);
+    for (i = 0; i < DS_MAX_JOYSTICK_BUTTONS; ++i)
+        DS_SetJoystickButton (0, i, 1);
+    for (i = 0; i < DS_MAX_JOYSTICK_AXES; ++i)
+        DS_SetJoystickAxis (0, i, 1);
+
+    DS_CHECK (packet_matches());
+
+    /* Check the joystick block against the protocol maxima */
+    size_t length = create_packet (packet, sizeof (packet));
+    const uint8_t* block = packet + HEADER_SIZE;
+    int axes = protocol.max_axis_count;
+    int hats = protocol.max_hat_count;
+    int buttons = protocol.max_button_count;
+
+    DS_CHECK (length == (size_t) (HEADER_SIZE + 7 + axes + hats * 2));
+    DS_CHECK (block [2] == axes);
+    DS_CHECK (block [3 + axes] == buttons);
+    DS_CHECK (((block [4 + axes] << 8) | block [5 + axes]) ==
+              (1 << buttons) - 1);
+    DS_CHECK (block [6 + axes] == hats);
+}
+
+/**
+ * Measures the time to generate a robot packet
+ */
+static void bench_packets (void)
+{
+    int i;
+    uint64_t start;
+    uint8_t packet [DS_MAX_PACKET_SIZE];
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < ITERATIONS; ++i)
+        create_packet (packet, sizeof (packet));
+    DS_BENCH ("robot packet (idle joysticks)",
+              DS_GetMonotonicTime() - start, ITERATIONS);
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < ITERATIONS; ++i) {
+        DS_SetJoystickAxis (i % JOYSTICKS, 0, (float) (i % 3 - 1));
+        create_packet (packet, sizeof (packet));
+    }
+    DS_BENCH ("robot packet (one joystick changed)",
+              DS_GetMonotonicTime() - start, ITERATIONS);
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < ITERATIONS; ++i) {
+        DS_SetRobotEnabled (i & 1);
+        create_packet (packet, sizeof (packet));
+    }
+    DS_BENCH ("robot packet (enabled state changed)",
+              DS_GetMonotonicTime() - start, ITERATIONS);
+}
+
+int main (void)
+{
+    int i;
+    uint8_t packet [DS_MAX_PACKET_SIZE];
+
+    DS_Init();
+    protocol = DS_GetProtocolFRC_2015();
+
+    for (i = 0; i < JOYSTICKS; ++i) {
+        DS_JoysticksAdd (6, 1, 10);
+        move_joystick (i, i);
+    }
+
+    /* The first packets do not contain joystick data */
+    for (i = 0; i < 6; ++i)
+        create_packet (packet, sizeof (packet));
+
+    DS_SetRobotEnabled (1);
+    test_cache();
+    bench_packets();
+    test_clamping();
+
+    DS_Close();
+    return DS_TEST_RESULT();
+}
@@ -0,0 +1,30 @@
+#-------------------------------------------------------------------------------
+# Standalone test, the quantization module is compiled into the test program
+# so that the SIMD and scalar code can be compared with each other
+#-------------------------------------------------------------------------------
+
+TARGET = quantize-test
+
+CONFIG += console
+CONFIG += testcase
+
+CONFIG -= qt
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../common
+INCLUDEPATH += $$PWD/../../include
+
+!macx* {
+    LIBS += -pthread
+}
+
+linux* {
+    LIBS += -lrt
+}
+
+HEADERS += \
+    $$PWD/../common/DS_Test.h
+
+SOURCES += \
+    $$PWD/main.c \
+    $$PWD/../../src/timer.c
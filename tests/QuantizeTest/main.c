@@ -0,0 +1,215 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests the joystick axis quantization, the SIMD code (SSE2 or NEON, if the
+ * target has one of them) is compared against the scalar code:
+ *     - Every 32-bit float is quantized by both implementations, and the
+ *       scalar result is checked against an exact double precision
+ *       reference (clamped, rounded half away from zero, NaN is 0)
+ *     - Every length from 0 to 64 values and every start alignment, so that
+ *       each combination of SIMD blocks and scalar tails is used
+ *     - Throughput benchmark of both implementations
+ *
+ * The quantization module is included directly, so that its static
+ * functions can be used by the test.
+ */
+
+#include "../../src/quantize.c"
+#include "DS_Test.h"
+#include "DS_Timer.h"
+
+#include <math.h>
+#include <string.h>
+
+#define BATCH 4096
+#define MAX_LENGTH 64
+#define MAX_OFFSET 4
+#define BENCH_ROUNDS 4096
+
+/*
+ * Keeps the benchmarked results from being optimized out
+ */
+static volatile int8_t bench_sink;
+
+/**
+ * Returns the exact quantized value of the given \a value, every float
+ * multiplied by 127 (and plus 0.5) is exactly representable as a double
+ */
+static int8_t reference (float value)
+{
+    if (value != value)
+        return 0;
+
+    double scaled = (double) (value > 1 ? 1 : (value < -1 ? -1 : value)) * 127;
+    int magnitude = (int) ((scaled < 0 ? -scaled : scaled) + 0.5);
+    return (int8_t) (scaled < 0 ? -magnitude : magnitude);
+}
+
+/**
+ * Quantizes the given values one at a time with the scalar code
+ */
+static void quantize_scalar (const float* in, int8_t* out, const int n)
+{
+    int i;
+    for (i = 0; i < n; ++i)
+        out [i] = quantize_axis (in [i]);
+}
+
+/**
+ * Quantizes every 32-bit pattern with both implementations, the values are
+ * quantized in batches so that the SIMD blocks are used
+ */
+static void test_exhaustive (void)
+{
+    uint64_t bits;
+    float in [BATCH];
+    int8_t simd [BATCH];
+    int8_t scalar [BATCH];
+    uint64_t simd_errors = 0;
+    uint64_t scalar_errors = 0;
+
+    DS_TEST ("every float is quantized exactly by both implementations");
+
+    for (bits = 0; bits <= UINT32_MAX; bits += BATCH) {
+        int i;
+        for (i = 0; i < BATCH; ++i) {
+            uint32_t pattern = (uint32_t) (bits + i);
+            memcpy (&in [i], &pattern, sizeof (float));
+        }
+
+        DS_QuantizeAxes (in, simd, BATCH);
+        quantize_scalar (in, scalar, BATCH);
+
+        for (i = 0; i < BATCH; ++i) {
+            simd_errors += (simd [i] != scalar [i]);
+            scalar_errors += (scalar [i] != reference (in [i]));
+        }
+    }
+
+    DS_CHECK (simd_errors == 0);
+    DS_CHECK (scalar_errors == 0);
+}
+
+/**
+ * Quantizes every length and start alignment, including the special values
+ */
+static void test_lengths (void)
+{
+    int i;
+    int length;
+    int offset;
+    float in [MAX_LENGTH + MAX_OFFSET];
+    int8_t simd [MAX_LENGTH + MAX_OFFSET];
+    int8_t scalar [MAX_LENGTH + MAX_OFFSET];
+
+    DS_TEST ("every length and alignment gives the scalar results");
+
+    srand (2017);
+    for (i = 0; i < MAX_LENGTH + MAX_OFFSET; ++i)
+        in [i] = (float) (rand() % 2401 - 1200) / 1000;
+
+    in [1] = NAN;
+    in [7] = INFINITY;
+    in [12] = -INFINITY;
+    in [21] = -0.0f;
+    in [30] = 0.5f / 127;
+    in [41] = -1.5f / 127;
+
+    for (offset = 0; offset < MAX_OFFSET; ++offset) {
+        for (length = 0; length <= MAX_LENGTH; ++length) {
+            memset (simd, 0x55, sizeof (simd));
+            memset (scalar, 0x55, sizeof (scalar));
+
+            DS_QuantizeAxes (in + offset, simd + offset, length);
+            quantize_scalar (in + offset, scalar + offset, length);
+
+            /* Compare the whole buffer to detect writes past the end */
+            DS_CHECK (memcmp (simd, scalar, sizeof (simd)) == 0);
+        }
+    }
+}
+
+/**
+ * Measures the time to quantize values with each implementation
+ */
+static void bench_quantize (void)
+{
+    int i;
+    uint64_t start;
+    float in [BATCH];
+    int8_t out [BATCH];
+
+    for (i = 0; i < BATCH; ++i)
+        in [i] = (float) (i % 255 - 127) / 127;
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_ROUNDS; ++i) {
+        DS_QuantizeAxes (in, out, BATCH);
+        bench_sink = out [i % BATCH];
+    }
+    DS_BENCH ("DS_QuantizeAxes (per value)",
+              DS_GetMonotonicTime() - start, (uint64_t) BENCH_ROUNDS * BATCH);
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_ROUNDS; ++i) {
+        quantize_scalar (in, out, BATCH);
+        bench_sink = out [i % BATCH];
+    }
+    DS_BENCH ("scalar (per value)",
+              DS_GetMonotonicTime() - start, (uint64_t) BENCH_ROUNDS * BATCH);
+
+    /* Six axes, like a joystick */
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_ROUNDS * 64; ++i) {
+        DS_QuantizeAxes (in + (i & 63), out, 6);
+        bench_sink = out [0];
+    }
+    DS_BENCH ("DS_QuantizeAxes (6 axes)",
+              DS_GetMonotonicTime() - start, BENCH_ROUNDS * 64);
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_ROUNDS * 64; ++i) {
+        quantize_scalar (in + (i & 63), out, 6);
+        bench_sink = out [0];
+    }
+    DS_BENCH ("scalar (6 axes)",
+              DS_GetMonotonicTime() - start, BENCH_ROUNDS * 64);
+}
+
+int main (void)
+{
+#if defined (QUANTIZE_SSE2)
+    printf ("Using the SSE2 implementation\n");
+#elif defined (QUANTIZE_NEON)
+    printf ("Using the NEON implementation\n");
+#else
+    printf ("There is no SIMD implementation for this target\n");
+#endif
+
+    test_lengths();
+    test_exhaustive();
+    bench_quantize();
+
+    return DS_TEST_RESULT();
+}
@@ -0,0 +1,6 @@
+TARGET = queue-test
+
+include ($$PWD/../Tests.pri)
+
+SOURCES += \
+    $$PWD/main.c
@@ -0,0 +1,266 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Stress test and benchmark of the MPMC queue, with several producers and
+ * consumers and a small queue (so that it is full most of the time):
+ *     - DS_QUEUE_BLOCK: every item is popped exactly once, nothing is
+ *       dropped
+ *     - DS_QUEUE_DROP_OLDEST: no item is popped twice, the popped and
+ *       dropped items add up to the pushed items, and each consumer sees
+ *       the items of each producer in order
+ *     - Throughput benchmark of both policies
+ */
+
+#include "LibDS.h"
+#include "DS_Test.h"
+#include "DS_Queue.h"
+#include "DS_Atomic.h"
+
+#include <sched.h>
+#include <string.h>
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define ITEMS 100000
+#define CAPACITY 64
+
+/**
+ * Item pushed by the producers
+ */
+typedef struct {
+    uint32_t producer;
+    uint32_t sequence;
+} Item;
+
+/**
+ * State shared by the producers and consumers of a run
+ */
+typedef struct {
+    DS_Queue queue;
+    int items;
+    volatile uint32_t producers_done;
+    volatile uint32_t popped;
+    volatile uint32_t duplicates;
+    volatile uint32_t out_of_order;
+    volatile uint32_t* seen;
+} Run;
+
+/**
+ * Producer argument
+ */
+typedef struct {
+    Run* run;
+    uint32_t id;
+} Producer;
+
+/**
+ * Pushes the items of one producer, in order
+ */
+static void* produce (void* ptr)
+{
+    Producer* producer = (Producer*) ptr;
+    Item item;
+    item.producer = producer->id;
+
+    for (item.sequence = 0; item.sequence < (uint32_t) producer->run->items;
+            ++item.sequence)
+        DS_QueuePush (&producer->run->queue, &item);
+
+    return NULL;
+}
+
+/**
+ * Pops items until the producers are done and the queue is empty, marks
+ * every item as seen and checks the order of the items of each producer
+ */
+static void* consume (void* ptr)
+{
+    Run* run = (Run*) ptr;
+    Item item;
+    uint32_t popped = 0;
+    int64_t last [PRODUCERS];
+    memset (last, 0xff, sizeof (last));
+
+    for (;;) {
+        /* Stop once the queue is empty after the producers are done */
+        uint32_t done = DS_AtomicLoad (&run->producers_done);
+        if (!DS_QueuePop (&run->queue, &item)) {
+            if (done)
+                break;
+
+            sched_yield();
+            continue;
+        }
+
+        size_t index = (size_t) item.producer * run->items + item.sequence;
+        if (DS_AtomicExchange (&run->seen [index], 1))
+            DS_AtomicAdd (&run->duplicates, 1);
+
+        if ((int64_t) item.sequence <= last [item.producer])
+            DS_AtomicAdd (&run->out_of_order, 1);
+
+        last [item.producer] = item.sequence;
+        ++popped;
+    }
+
+    DS_AtomicAdd (&run->popped, popped);
+    return NULL;
+}
+
+/**
+ * Pushes and pops the items of every producer with the given \a policy
+ * and number of threads
+ *
+ * \returns the time (in nanoseconds) that it took to process the items
+ */
+static uint64_t run_queue (Run* run, const DS_QueuePolicy policy,
+                           const int producers, const int consumers,
+                           const int items)
+{
+    int i;
+    pthread_t threads [PRODUCERS + CONSUMERS];
+    Producer args [PRODUCERS];
+
+    memset (run, 0, sizeof (Run));
+    run->items = items;
+    run->seen = (volatile uint32_t*) calloc ((size_t) producers * items,
+                                             sizeof (uint32_t));
+    DS_QueueInit (&run->queue, CAPACITY, sizeof (Item), policy);
+
+    uint64_t start = DS_GetMonotonicTime();
+    for (i = 0; i < consumers; ++i)
+        pthread_create (&threads [producers + i], NULL, &consume, run);
+
+    for (i = 0; i < producers; ++i) {
+        args [i].run = run;
+        args [i].id = (uint32_t) i;
+        pthread_create (&threads [i], NULL, &produce, &args [i]);
+    }
+
+    for (i = 0; i < producers; ++i)
+        pthread_join (threads [i], NULL);
+
+    DS_AtomicStore (&run->producers_done, 1);
+    for (i = 0; i < consumers; ++i)
+        pthread_join (threads [producers + i], NULL);
+
+    return DS_GetMonotonicTime() - start;
+}
+
+/**
+ * Returns the number of items that were never popped
+ */
+static uint32_t missing_items (Run* run, const int producers)
+{
+    size_t i;
+    uint32_t missing = 0;
+    for (i = 0; i < (size_t) producers * run->items; ++i)
+        missing += !run->seen [i];
+
+    return missing;
+}
+
+/**
+ * Releases the memory of the given \a run
+ */
+static void free_run (Run* run)
+{
+    DS_QueueFree (&run->queue);
+    free ((void*) run->seen);
+}
+
+/**
+ * Checks that no item is lost or duplicated with a blocking queue
+ */
+static void test_block (void)
+{
+    Run run;
+    DS_TEST ("DS_QUEUE_BLOCK: every item is popped exactly once");
+
+    run_queue (&run, DS_QUEUE_BLOCK, PRODUCERS, CONSUMERS, ITEMS);
+    printf ("  popped: %u, dropped: %u\n", run.popped,
+            DS_QueueDropped (&run.queue));
+
+    DS_CHECK (run.popped == PRODUCERS * ITEMS);
+    DS_CHECK (run.duplicates == 0);
+    DS_CHECK (run.out_of_order == 0);
+    DS_CHECK (missing_items (&run, PRODUCERS) == 0);
+    DS_CHECK (DS_QueueDropped (&run.queue) == 0);
+    free_run (&run);
+}
+
+/**
+ * Checks that the dropped items are accounted for with a queue that drops
+ * its oldest items
+ */
+static void test_drop_oldest (void)
+{
+    Run run;
+    DS_TEST ("DS_QUEUE_DROP_OLDEST: popped + dropped == pushed");
+
+    run_queue (&run, DS_QUEUE_DROP_OLDEST, PRODUCERS, CONSUMERS, ITEMS);
+    uint32_t dropped = DS_QueueDropped (&run.queue);
+    printf ("  popped: %u, dropped: %u\n", run.popped, dropped);
+
+    DS_CHECK (run.popped + dropped == PRODUCERS * ITEMS);
+    DS_CHECK (missing_items (&run, PRODUCERS) == dropped);
+    DS_CHECK (run.duplicates == 0);
+    DS_CHECK (run.out_of_order == 0);
+    free_run (&run);
+}
+
+/**
+ * Measures the time per item of both policies
+ */
+static void bench_queue (void)
+{
+    Run run;
+    DS_TEST ("throughput benchmark (time per item)");
+
+    uint64_t time = run_queue (&run, DS_QUEUE_BLOCK, 1, 1, ITEMS);
+    DS_BENCH ("DS_QUEUE_BLOCK (1 producer, 1 consumer)", time, run.popped);
+    free_run (&run);
+
+    time = run_queue (&run, DS_QUEUE_BLOCK, PRODUCERS, CONSUMERS, ITEMS);
+    DS_BENCH ("DS_QUEUE_BLOCK (4 producers, 4 consumers)", time, run.popped);
+    free_run (&run);
+
+    time = run_queue (&run, DS_QUEUE_DROP_OLDEST, 1, 1, ITEMS);
+    DS_BENCH ("DS_QUEUE_DROP_OLDEST (1 producer, 1 consumer)", time, ITEMS);
+    free_run (&run);
+
+    time = run_queue (&run, DS_QUEUE_DROP_OLDEST, PRODUCERS, CONSUMERS, ITEMS);
+    DS_BENCH ("DS_QUEUE_DROP_OLDEST (4 producers, 4 consumers)", time,
+              PRODUCERS * ITEMS);
+    free_run (&run);
+}
+
+int main (void)
+{
+    test_block();
+    test_drop_oldest();
+    bench_queue();
+
+    return DS_TEST_RESULT();
+}
@@ -0,0 +1,6 @@
+TARGET = socket-test
+
+include ($$PWD/../Tests.pri)
+
+SOURCES += \
+    $$PWD/main.c
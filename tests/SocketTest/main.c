@@ -0,0 +1,428 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests the socket reactor:
+ *     - The number of threads does not grow when addresses change
+ *     - TCP server sockets accept connections and receive data
+ *     - A closed TCP connection does not make the reactor spin
+ *     - Batches larger than SOCKY_BATCH_MAX are sent completely, to every
+ *       destination and in order (with a batch vs. single send benchmark)
+ *     - A 10k datagrams per second blast is received completely and in
+ *       order (with a benchmark of the receive calls per datagram)
+ */
+
+#include "LibDS.h"
+#include "DS_Test.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined (__linux__)
+    #include <time.h>
+    #include <dirent.h>
+    #include <unistd.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+#endif
+
+#define TCP_PORT 5810
+#define BATCH_PORT_A 5815
+#define BATCH_PORT_B 5816
+#define BATCH_SIZE 100
+#define BENCH_DATAGRAMS 20000
+#define BLAST_PORT 5817
+#define BLAST_DATAGRAMS 20000
+#define BLAST_BURST 8
+#define BLAST_RATE 10000
+#define BLAST_WINDOW 12
+#define BLAST_TIMEOUT 10000
+
+#if defined (__linux__)
+
+/**
+ * Returns the number of threads of the process
+ */
+static int thread_count (void)
+{
+    int count = 0;
+    DIR* dir = opendir ("/proc/self/task");
+    if (!dir)
+        return -1;
+
+    struct dirent* entry;
+    while ((entry = readdir (dir)) != NULL) {
+        if (entry->d_name [0] != '.')
+            ++count;
+    }
+
+    closedir (dir);
+    return count;
+}
+
+/**
+ * Returns the CPU time used by the process (in nanoseconds)
+ */
+static uint64_t cpu_time (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Changes the addresses of an UDP and a TCP socket 1000 times and checks
+ * that the number of threads stays the same
+ */
+static void test_address_changes (void)
+{
+    int i;
+    DS_TEST ("thread count is constant across 1000 address changes");
+
+    DS_Socket* udp = DS_SocketEmpty();
+    DS_Socket* tcp = DS_SocketEmpty();
+    udp->in_port = 5811;
+    udp->out_port = 5812;
+    tcp->in_port = 5813;
+    tcp->out_port = 5814;
+    tcp->type = DS_SOCKET_TCP;
+    DS_SocketOpen (udp);
+    DS_SocketOpen (tcp);
+    DS_Sleep (50);
+
+    int before = thread_count();
+    for (i = 0; i < 1000; ++i) {
+        DS_SocketChangeAddress (udp, (i & 1) ? "127.0.0.1" : "localhost");
+        if (i % 10 == 0)
+            DS_SocketChangeAddress (tcp, (i & 2) ? "127.0.0.1" : "localhost");
+    }
+    DS_Sleep (50);
+    int after = thread_count();
+
+    printf ("  threads before: %d, after: %d\n", before, after);
+    DS_CHECK (before > 0);
+    DS_CHECK (before == after);
+
+    DS_SocketClose (udp);
+    DS_SocketClose (tcp);
+    free (udp);
+    free (tcp);
+}
+
+/**
+ * Connects to a TCP server socket, sends data and closes the connection,
+ * then checks that the reactor does not keep waking up for the closed
+ * connection (or for the listening socket)
+ */
+static void test_tcp_server (void)
+{
+    DS_TEST ("TCP server accepts data and does not spin after EOF");
+
+    DS_Socket* tcp = DS_SocketEmpty();
+    tcp->in_port = TCP_PORT;
+    tcp->type = DS_SOCKET_TCP;
+    DS_SocketOpen (tcp);
+    DS_CHECK (tcp->info.server_init);
+
+    /* Connect and send data */
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (TCP_PORT);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    int fd = socket (AF_INET, SOCK_STREAM, 0);
+    DS_CHECK (connect (fd, (struct sockaddr*) &addr, sizeof (addr)) == 0);
+    DS_CHECK (send (fd, "hello", 5, 0) == 5);
+
+    /* Wait for the data */
+    int i;
+    const DS_Datagram* datagram = NULL;
+    for (i = 0; i < 100 && !datagram; ++i) {
+        DS_Sleep (10);
+        datagram = DS_SocketPeek (tcp);
+    }
+
+    DS_CHECK (datagram != NULL);
+    if (datagram) {
+        DS_CHECK (datagram->length == 5);
+        DS_CHECK (memcmp (datagram->data, "hello", 5) == 0);
+        DS_SocketRelease (tcp);
+    }
+
+    /* Close the connection and measure the CPU usage of the process */
+    close (fd);
+    DS_Sleep (50);
+    uint64_t start = cpu_time();
+    DS_Sleep (500);
+    uint64_t used = cpu_time() - start;
+
+    printf ("  CPU time in 500 ms after EOF: %.2f ms\n", used / 1e6);
+    DS_CHECK (used < 100000000ULL);
+    DS_CHECK (tcp->info.sock_peer < 0);
+
+    DS_SocketClose (tcp);
+    free (tcp);
+}
+
+/**
+ * Creates a non-blocking UDP socket that receives datagrams on the given
+ * loopback \a port
+ */
+static int create_receiver (const int port)
+{
+    int size = 4 * 1024 * 1024;
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (port);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+    int fd = socket (AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof (size));
+    DS_CHECK (bind (fd, (struct sockaddr*) &addr, sizeof (addr)) == 0);
+    return fd;
+}
+
+/**
+ * Creates an UDP socket that sends datagrams to the given loopback \a port
+ * and waits until its address is resolved
+ */
+static DS_Socket* create_sender (const int port)
+{
+    int i;
+    DS_Socket* ptr = DS_SocketEmpty();
+    ptr->out_port = port;
+    strcpy (ptr->address, "127.0.0.1");
+    DS_SocketOpen (ptr);
+
+    for (i = 0; i < 100 && !ptr->info.resolved; ++i)
+        DS_Sleep (10);
+
+    DS_CHECK (ptr->info.resolved);
+    return ptr;
+}
+
+/**
+ * Reads every datagram queued in the given receiver \a fd
+ */
+static int drain_receiver (const int fd, int* values, const int max)
+{
+    int value;
+    int count = 0;
+    while (recv (fd, &value, sizeof (value), 0) == sizeof (value)) {
+        if (values && count < max)
+            values [count] = value;
+
+        ++count;
+    }
+
+    return count;
+}
+
+/**
+ * Sends more datagrams than fit in a single system call to two destinations
+ * and checks that all of them arrive in order, then compares the time that
+ * it takes to send datagrams in batches and one by one
+ */
+static void test_send_batch (void)
+{
+    int i;
+    int values [BATCH_SIZE];
+    DS_OutDatagram datagrams [BATCH_SIZE];
+    DS_TEST ("batches are sent completely and in order");
+
+    int fd_a = create_receiver (BATCH_PORT_A);
+    int fd_b = create_receiver (BATCH_PORT_B);
+    DS_Socket* sender = create_sender (BATCH_PORT_A);
+    DS_Socket* other = create_sender (BATCH_PORT_B);
+
+    /* Even datagrams go to the sender's address, odd ones to the other */
+    for (i = 0; i < BATCH_SIZE; ++i) {
+        values [i] = i;
+        datagrams [i].data = (const char*) &values [i];
+        datagrams [i].length = sizeof (int);
+        datagrams [i].destination = (i & 1) ? other : NULL;
+    }
+
+    DS_CHECK (DS_SocketSendBatch (sender, datagrams, BATCH_SIZE) == BATCH_SIZE);
+    for (i = 0; i < BATCH_SIZE; ++i)
+        DS_CHECK (datagrams [i].sent == sizeof (int));
+
+    /* Check that the datagrams arrived in order */
+    int received_a [BATCH_SIZE];
+    int received_b [BATCH_SIZE];
+    DS_Sleep (20);
+    int count_a = drain_receiver (fd_a, received_a, BATCH_SIZE);
+    int count_b = drain_receiver (fd_b, received_b, BATCH_SIZE);
+    DS_CHECK (count_a == BATCH_SIZE / 2);
+    DS_CHECK (count_b == BATCH_SIZE / 2);
+    for (i = 0; i < count_a && i < BATCH_SIZE / 2; ++i)
+        DS_CHECK (received_a [i] == 2 * i);
+    for (i = 0; i < count_b && i < BATCH_SIZE / 2; ++i)
+        DS_CHECK (received_b [i] == 2 * i + 1);
+
+    /* Benchmark batches of 32 datagrams against single datagrams */
+    for (i = 0; i < BATCH_SIZE; ++i)
+        datagrams [i].destination = NULL;
+
+    int sent = 0;
+    uint64_t start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_DATAGRAMS; i += 32) {
+        int count = DS_SocketSendBatch (sender, datagrams, 32);
+        sent += DS_Max (count, 0);
+        if (i % 32 == 0)
+            drain_receiver (fd_a, NULL, 0);
+    }
+    DS_BENCH ("DS_SocketSendBatch (per datagram)",
+              DS_GetMonotonicTime() - start, sent);
+
+    sent = 0;
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_DATAGRAMS; ++i) {
+        sent += DS_SocketSendBytes (sender, (const char*) &values [0], sizeof (int)) > 0;
+        if (i % 32 == 0)
+            drain_receiver (fd_a, NULL, 0);
+    }
+    DS_BENCH ("DS_SocketSendBytes", DS_GetMonotonicTime() - start, sent);
+
+    DS_SocketClose (sender);
+    DS_SocketClose (other);
+    close (fd_a);
+    close (fd_b);
+    free (sender);
+    free (other);
+}
+
+/*
+ * Number of blast datagrams read by the test, the sender never gets more
+ * than BLAST_WINDOW datagrams ahead, so that the receive ring of the socket
+ * (16 datagrams) does not overflow when the reader is not scheduled
+ */
+static volatile int blast_received = 0;
+
+/**
+ * Sends \c BLAST_DATAGRAMS numbered datagrams to the blast port at
+ * \c BLAST_RATE datagrams per second (in bursts of \c BLAST_BURST)
+ */
+static void* run_blast (void* ptr)
+{
+    int i;
+    int fd = *((int*) ptr);
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (BLAST_PORT);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+    uint64_t interval = 1000000000ULL * BLAST_BURST / BLAST_RATE;
+    uint64_t next = DS_GetMonotonicTime();
+    for (i = 0; i < BLAST_DATAGRAMS; ++i) {
+        if (i % BLAST_BURST == 0) {
+            DS_SleepUntil (next);
+            next += interval;
+        }
+
+        while (i - blast_received >= BLAST_WINDOW)
+            DS_Sleep (0);
+
+        sendto (fd, &i, sizeof (i), 0, (struct sockaddr*) &addr, sizeof (addr));
+    }
+
+    return NULL;
+}
+
+/**
+ * Blasts datagrams at a socket, checks that every datagram is delivered in
+ * order by DS_SocketReadDatagram() and reports the number of receive calls
+ * that the reactor made for each datagram
+ */
+static void test_receive_blast (void)
+{
+    DS_TEST ("a 10k pps blast is received completely and in order");
+
+    DS_Socket* receiver = DS_SocketEmpty();
+    receiver->in_port = BLAST_PORT;
+    DS_SocketOpen (receiver);
+    DS_CHECK (receiver->info.server_init);
+
+    /* Start the blast */
+    pthread_t thread;
+    blast_received = 0;
+    uint64_t start = DS_GetMonotonicTime();
+    int fd = socket (AF_INET, SOCK_DGRAM, 0);
+    pthread_create (&thread, NULL, &run_blast, &fd);
+
+    /* Read the datagrams */
+    int received = 0;
+    int ordered = 1;
+    DS_Datagram datagram;
+    uint64_t deadline = DS_GetMonotonicTime() + 1000000ULL * BLAST_TIMEOUT;
+    while (received < BLAST_DATAGRAMS && DS_GetMonotonicTime() < deadline) {
+        if (!DS_SocketReadDatagram (receiver, &datagram)) {
+            DS_Sleep (0);
+            continue;
+        }
+
+        int value = -1;
+        if (datagram.length == sizeof (int))
+            memcpy (&value, datagram.data, sizeof (int));
+
+        ordered &= (value == received);
+        blast_received = ++received;
+    }
+
+    pthread_join (thread, NULL);
+    close (fd);
+
+    uint64_t elapsed = DS_GetMonotonicTime() - start;
+    printf ("  datagrams: %d, overruns: %u, rate: %.0f datagrams/s\n",
+            received, DS_SocketOverruns (receiver), received * 1e9 / elapsed);
+    DS_BENCH_UNIT ("reactor receive calls per datagram",
+                   DS_SocketReceiveCalls (receiver), received, "calls");
+
+    DS_CHECK (received == BLAST_DATAGRAMS);
+    DS_CHECK (ordered);
+    DS_CHECK (DS_SocketOverruns (receiver) == 0);
+
+    DS_SocketClose (receiver);
+    free (receiver);
+}
+
+#endif
+
+int main (void)
+{
+    DS_Init();
+
+#if defined (__linux__)
+    test_address_changes();
+    test_tcp_server();
+    test_send_batch();
+    test_receive_blast();
+#else
+    printf ("Socket tests are only supported on Linux\n");
+#endif
+
+    DS_Close();
+    return DS_TEST_RESULT();
+}
@@ -0,0 +1,6 @@
+TARGET = string-test
+
+include ($$PWD/../Tests.pri)
+
+SOURCES += \
+    $$PWD/main.c
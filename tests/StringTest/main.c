@@ -0,0 +1,313 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests the string module:
+ *     - Views (strings with a capacity of 0) are copied before they are
+ *       modified and their memory is never re-allocated or freed
+ *     - Strings created by the module always own their buffer
+ *     - Appending bytes one at a time has an amortized constant cost
+ *       (benchmark of single-byte, chunked and reserved appends)
+ *     - Benchmark of building the joystick payload of a FRC 2015 robot
+ *       packet with six joysticks, before (one reallocation and copy per
+ *       byte) and after the strings got a capacity
+ */
+
+#include "LibDS.h"
+#include "DS_Test.h"
+
+#include <string.h>
+
+#define BENCH_BYTES (4 * 1024 * 1024)
+#define BENCH_PACKETS 100000
+#define PACKET_JOYSTICKS 6
+#define PACKET_SIZE (6 + PACKET_JOYSTICKS * 15)
+
+/**
+ * Returns a view of the given \a text
+ */
+static DS_String view_of (char* text)
+{
+    DS_String view;
+    view.buf = text;
+    view.len = strlen (text);
+    view.cap = 0;
+    return view;
+}
+
+/**
+ * Modifies views with every function that writes to a string and checks
+ * that the viewed memory is never changed
+ */
+static void test_views (void)
+{
+    DS_TEST ("views are copied before they are modified");
+
+    /* Viewed memory is on the stack, freeing it would crash the test */
+    char text [] = "LibDS";
+
+    DS_String view = view_of (text);
+    DS_CHECK (DS_StrAppend (&view, '!'));
+    DS_CHECK (view.buf != text && view.cap > 0);
+    DS_CHECK (view.len == 6 && memcmp (view.buf, "LibDS!", 6) == 0);
+    DS_StrRmBuf (&view);
+
+    view = view_of (text);
+    DS_CHECK (DS_StrJoinCStr (&view, " rocks"));
+    DS_CHECK (view.len == 11 && memcmp (view.buf, "LibDS rocks", 11) == 0);
+    DS_StrRmBuf (&view);
+
+    view = view_of (text);
+    DS_CHECK (DS_StrSetChar (&view, 0, 'l'));
+    DS_CHECK (view.buf != text && view.buf [0] == 'l');
+    DS_StrRmBuf (&view);
+
+    view = view_of (text);
+    DS_CHECK (DS_StrResize (&view, 3));
+    DS_CHECK (view.buf != text && view.len == 3);
+    DS_StrRmBuf (&view);
+
+    view = view_of (text);
+    DS_CHECK (DS_StrReserve (&view, 2));
+    DS_CHECK (view.buf != text && view.cap >= view.len);
+    DS_CHECK (memcmp (view.buf, "LibDS", 5) == 0);
+    DS_StrRmBuf (&view);
+
+    /* Shrinking a view has nothing to release */
+    view = view_of (text);
+    DS_CHECK (DS_StrShrink (&view));
+    DS_CHECK (view.buf == text);
+
+    /* Removing the buffer of a view does not free it */
+    DS_CHECK (DS_StrRmBuf (&view));
+    DS_CHECK (view.buf == NULL && view.len == 0);
+
+    DS_CHECK (strcmp (text, "LibDS") == 0);
+}
+
+/**
+ * Checks that empty strings created by the module own their buffer, so
+ * that they are never mistaken for views
+ */
+static void test_owned (void)
+{
+    DS_TEST ("strings created by the module own their buffer");
+
+    DS_String empty = DS_StrNewLen (0);
+    DS_CHECK (empty.buf != NULL && empty.cap > 0);
+    DS_CHECK (DS_StrShrink (&empty));
+    DS_CHECK (empty.cap > 0);
+    DS_CHECK (DS_StrAppend (&empty, 'x'));
+    DS_CHECK (empty.len == 1 && empty.buf [0] == 'x');
+    DS_StrRmBuf (&empty);
+
+    DS_String dup = DS_StrNew ("");
+    DS_String copy = DS_StrDup (&dup);
+    DS_CHECK (dup.cap > 0 && copy.cap > 0);
+    DS_StrRmBuf (&dup);
+    DS_StrRmBuf (&copy);
+}
+
+/**
+ * Measures the cost of appending bytes one at a time, in chunks and into
+ * a string with a reserved capacity
+ */
+static void bench_appends (void)
+{
+    int i;
+    char chunk [64];
+    DS_TEST ("append benchmark");
+    memset (chunk, 'x', sizeof (chunk));
+
+    DS_String string = DS_StrNewLen (0);
+    uint64_t start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_BYTES; ++i)
+        DS_StrAppend (&string, (uint8_t) i);
+    DS_BENCH ("DS_StrAppend", DS_GetMonotonicTime() - start, BENCH_BYTES);
+    DS_CHECK (string.len == BENCH_BYTES);
+    DS_StrRmBuf (&string);
+
+    string = DS_StrNewLen (0);
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_BYTES; i += sizeof (chunk))
+        DS_StrAppendBytes (&string, chunk, sizeof (chunk));
+    DS_BENCH ("DS_StrAppendBytes (64 bytes, per byte)",
+              DS_GetMonotonicTime() - start, BENCH_BYTES);
+    DS_CHECK (string.len == BENCH_BYTES);
+    DS_StrRmBuf (&string);
+
+    string = DS_StrNewLen (0);
+    start = DS_GetMonotonicTime();
+    DS_StrReserve (&string, BENCH_BYTES);
+    for (i = 0; i < BENCH_BYTES; ++i)
+        DS_StrAppend (&string, (uint8_t) i);
+    DS_BENCH ("DS_StrAppend (reserved)", DS_GetMonotonicTime() - start, BENCH_BYTES);
+    DS_CHECK (string.len == BENCH_BYTES);
+    DS_StrRmBuf (&string);
+}
+
+/**
+ * Appends a byte like the string module did before strings had a capacity:
+ * the buffer was copied, freed and allocated again for every byte
+ */
+static int legacy_append (DS_String* string, const uint8_t byte)
+{
+    size_t i;
+    size_t size = string->len;
+
+    char* copy = calloc (size, sizeof (char));
+    for (i = 0; i < size; ++i)
+        copy [i] = string->buf [i];
+
+    free (string->buf);
+    string->buf = calloc (size + 1, sizeof (char));
+    for (i = 0; i < size; ++i)
+        string->buf [i] = copy [i];
+
+    free (copy);
+    string->buf [size] = (char) byte;
+    string->len = size + 1;
+    return 1;
+}
+
+/**
+ * Builds the header and joystick data of a FRC 2015 robot packet (six
+ * joysticks with six axes, ten buttons and one hat) one byte at a time
+ */
+static void build_packet (DS_String* packet,
+                          int (*append) (DS_String*, const uint8_t))
+{
+    int i, j;
+
+    /* Index, tag, control, request and station */
+    append (packet, 0x00);
+    append (packet, 0x2a);
+    append (packet, 0x01);
+    append (packet, 0x04);
+    append (packet, 0x80);
+    append (packet, 0x00);
+
+    for (i = 0; i < PACKET_JOYSTICKS; ++i) {
+        append (packet, 0x0f);
+        append (packet, 0x0c);
+
+        append (packet, 6);
+        for (j = 0; j < 6; ++j)
+            append (packet, (uint8_t) (i * 16 + j));
+
+        append (packet, 10);
+        append (packet, 0x02);
+        append (packet, 0x81);
+
+        append (packet, 1);
+        append (packet, 0x00);
+        append (packet, 0x5a);
+    }
+}
+
+/**
+ * Builds the same packet as build_packet(), appending each joystick block
+ * at once
+ */
+static void build_packet_blocks (DS_String* packet)
+{
+    int i, j;
+    uint8_t header [6] = { 0x00, 0x2a, 0x01, 0x04, 0x80, 0x00 };
+    DS_StrAppendBytes (packet, header, sizeof (header));
+
+    for (i = 0; i < PACKET_JOYSTICKS; ++i) {
+        uint8_t block [15] = { 0x0f, 0x0c, 6, 0, 0, 0, 0, 0, 0,
+                               10, 0x02, 0x81, 1, 0x00, 0x5a
+                             };
+        for (j = 0; j < 6; ++j)
+            block [3 + j] = (uint8_t) (i * 16 + j);
+
+        DS_StrAppendBytes (packet, block, sizeof (block));
+    }
+}
+
+/**
+ * Measures the time to build a six joystick FRC 2015 packet in a new
+ * string with the previous and the current append code
+ */
+static void bench_packets (void)
+{
+    int i;
+    uint64_t start;
+    DS_String packet;
+    DS_String reference;
+    DS_TEST ("FRC 2015 packet benchmark (6 joysticks)");
+
+    reference = DS_StrNewLen (0);
+    build_packet_blocks (&reference);
+    DS_CHECK (reference.len == PACKET_SIZE);
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_PACKETS; ++i) {
+        packet = DS_StrNewLen (0);
+        build_packet (&packet, &legacy_append);
+        DS_StrRmBuf (&packet);
+    }
+    DS_BENCH ("before (reallocate each byte)",
+              DS_GetMonotonicTime() - start, BENCH_PACKETS);
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_PACKETS; ++i) {
+        packet = DS_StrNewLen (0);
+        build_packet (&packet, &DS_StrAppend);
+        DS_StrRmBuf (&packet);
+    }
+    DS_BENCH ("DS_StrAppend", DS_GetMonotonicTime() - start, BENCH_PACKETS);
+
+    start = DS_GetMonotonicTime();
+    for (i = 0; i < BENCH_PACKETS; ++i) {
+        packet = DS_StrNewLen (0);
+        build_packet_blocks (&packet);
+        DS_StrRmBuf (&packet);
+    }
+    DS_BENCH ("DS_StrAppendBytes (per joystick)",
+              DS_GetMonotonicTime() - start, BENCH_PACKETS);
+
+    /* Every variant builds the same packet */
+    packet = DS_StrNewLen (0);
+    build_packet (&packet, &legacy_append);
+    DS_CHECK (DS_StrCompare (&packet, &reference) == 0);
+    DS_StrRmBuf (&packet);
+
+    packet = DS_StrNewLen (0);
+    build_packet (&packet, &DS_StrAppend);
+    DS_CHECK (DS_StrCompare (&packet, &reference) == 0);
+    DS_StrRmBuf (&packet);
+
+    DS_StrRmBuf (&reference);
+}
+
+int main (void)
+{
+    test_views();
+    test_owned();
+    bench_appends();
+    bench_packets();
+
+    return DS_TEST_RESULT();
+}
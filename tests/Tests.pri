@@ -0,0 +1,20 @@
+#-------------------------------------------------------------------------------
+# Common configuration of the test programs
+#-------------------------------------------------------------------------------
+
+CONFIG += console
+CONFIG += testcase
+
+CONFIG -= qt
+CONFIG -= app_bundle
+
+DEFINES -= UNICODE QT_LARGEFILE_SUPPORT
+
+INCLUDEPATH += $$PWD/common
+HEADERS += $$PWD/common/DS_Test.h
+
+#-------------------------------------------------------------------------------
+# Include libraries
+#-------------------------------------------------------------------------------
+
+include ($$PWD/../LibDS.pri)
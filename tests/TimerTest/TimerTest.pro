@@ -0,0 +1,6 @@
+TARGET = timer-test
+
+include ($$PWD/../Tests.pri)
+
+SOURCES += \
+    $$PWD/main.c
@@ -0,0 +1,148 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests the timer scheduler:
+ *     - DS_TimerStop() waits for a callback that is already running
+ *     - No callback is called after DS_TimerStop() returns
+ *     - A callback can stop its own timer
+ */
+
+#include "LibDS.h"
+#include "DS_Test.h"
+
+/*
+ * Callback state, written by the scheduler thread
+ */
+static volatile int calls = 0;
+static volatile int started = 0;
+static volatile int finished = 0;
+
+/**
+ * Slow callback, takes 50 ms to return
+ */
+static void slow_callback (DS_Timer* timer)
+{
+    (void) timer;
+    started = 1;
+    DS_Sleep (50);
+    finished = 1;
+}
+
+/**
+ * Counts the calls of the callback
+ */
+static void count_callback (DS_Timer* timer)
+{
+    (void) timer;
+    calls = calls + 1;
+}
+
+/**
+ * Stops the timer of the callback
+ */
+static void stop_callback (DS_Timer* timer)
+{
+    DS_TimerStop (timer);
+    calls = calls + 1;
+}
+
+/**
+ * Stops a timer while its callback is running
+ */
+static void test_stop_waits (void)
+{
+    int i;
+    DS_Timer timer;
+    DS_TEST ("DS_TimerStop waits for a running callback");
+
+    timer.initialized = 0;
+    DS_TimerInit (&timer, 10, 0);
+    DS_TimerSetCallback (&timer, &slow_callback, NULL);
+    DS_TimerStart (&timer);
+
+    for (i = 0; i < 100 && !started; ++i)
+        DS_Sleep (5);
+
+    DS_CHECK (started);
+    DS_TimerStop (&timer);
+    DS_CHECK (finished);
+}
+
+/**
+ * Stops a periodic timer many times and checks that the callback is not
+ * called afterwards
+ */
+static void test_no_calls_after_stop (void)
+{
+    int i;
+    DS_Timer timer;
+    DS_TEST ("no callback is called after DS_TimerStop returns");
+
+    timer.initialized = 0;
+    DS_TimerInit (&timer, 1, 0);
+    DS_TimerSetCallback (&timer, &count_callback, NULL);
+    timer.periodic = 1;
+
+    for (i = 0; i < 50; ++i) {
+        DS_TimerStart (&timer);
+        DS_Sleep (2);
+        DS_TimerStop (&timer);
+
+        int count = calls;
+        DS_Sleep (3);
+        DS_CHECK (calls == count);
+    }
+}
+
+/**
+ * Lets a periodic timer stop itself from its callback
+ */
+static void test_stop_from_callback (void)
+{
+    DS_Timer timer;
+    DS_TEST ("a callback can stop its own timer");
+
+    calls = 0;
+    timer.initialized = 0;
+    DS_TimerInit (&timer, 5, 0);
+    DS_TimerSetCallback (&timer, &stop_callback, NULL);
+    timer.periodic = 1;
+    DS_TimerStart (&timer);
+
+    DS_Sleep (50);
+    DS_CHECK (calls == 1);
+    DS_CHECK (!timer.enabled);
+}
+
+int main (void)
+{
+    DS_Init();
+
+    test_stop_waits();
+    test_no_calls_after_stop();
+    test_stop_from_callback();
+
+    DS_Close();
+    return DS_TEST_RESULT();
+}
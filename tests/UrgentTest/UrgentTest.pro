@@ -0,0 +1,6 @@
+TARGET = urgent-test
+
+include ($$PWD/../Tests.pri)
+
+SOURCES += \
+    $$PWD/main.c
@@ -0,0 +1,249 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Tests the out-of-band robot packets with the FRC 2015 protocol and a
+ * simulated robot on the loopback interface:
+ *     - No packet is requested without communications with the robot
+ *     - No packet is requested when the state does not change
+ *     - Disable and e-stop transitions are sent with a 99th percentile
+ *       latency (from the API call to the sendto() call) below 1 ms
+ */
+
+#include "LibDS.h"
+#include "DS_Test.h"
+
+#include <string.h>
+
+#if defined (__linux__)
+    #include <poll.h>
+    #include <unistd.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+#endif
+
+#define ROBOT_PORT 1110
+#define DS_PORT 1150
+#define TRANSITIONS 500
+#define MAX_LATENCY 1000000 /* Nanoseconds */
+
+#if defined (__linux__)
+
+/*
+ * Simulated robot state
+ */
+static int robot_fd = -1;
+static volatile int robot_running = 0;
+static volatile int robot_estopped = 0;
+static pthread_t robot_thread;
+
+/**
+ * Answers every DS packet with a robot packet that echoes its index and
+ * control byte, reporting robot code and 12 volts. Like a real robot, the
+ * e-stop state is kept once it is received.
+ */
+static void* run_robot (void* ptr)
+{
+    (void) ptr;
+    uint8_t estop = 0;
+    struct pollfd pfd;
+    pfd.fd = robot_fd;
+    pfd.events = POLLIN;
+
+    while (robot_running) {
+        if (poll (&pfd, 1, 10) <= 0)
+            continue;
+
+        uint8_t packet [1024];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof (from);
+        ssize_t len = recvfrom (robot_fd, packet, sizeof (packet), 0,
+                                (struct sockaddr*) &from, &from_len);
+        if (len < 6)
+            continue;
+
+        estop |= packet [3] & 0x80;
+        robot_estopped = (estop != 0);
+        uint8_t reply [8] = { packet [0], packet [1], 0x01, packet [3] | estop,
+                              0x20, 12, 0, 0
+                            };
+        from.sin_port = htons (DS_PORT);
+        sendto (robot_fd, reply, sizeof (reply), 0,
+                (struct sockaddr*) &from, sizeof (from));
+    }
+
+    return NULL;
+}
+
+/**
+ * Starts the simulated robot
+ */
+static void start_robot (void)
+{
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (ROBOT_PORT);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+    robot_fd = socket (AF_INET, SOCK_DGRAM, 0);
+    DS_CHECK (bind (robot_fd, (struct sockaddr*) &addr, sizeof (addr)) == 0);
+
+    robot_running = 1;
+    pthread_create (&robot_thread, NULL, &run_robot, NULL);
+}
+
+/**
+ * Stops the simulated robot
+ */
+static void stop_robot (void)
+{
+    robot_running = 0;
+    pthread_join (robot_thread, NULL);
+    close (robot_fd);
+}
+
+/**
+ * Returns the number of out-of-band packets sent since the statistics were
+ * reset, and copies their latency summary to \a summary (if not \c NULL)
+ */
+static uint64_t urgent_packets (DS_HistogramSummary* summary)
+{
+    DS_SendJitterStats stats;
+    DS_GetSendJitterStats (&stats);
+    if (summary)
+        *summary = stats.urgent;
+
+    return stats.urgent.count;
+}
+
+/**
+ * Waits until the robot communications reach the given \a state
+ */
+static int wait_for_comms (const int state)
+{
+    int i;
+    for (i = 0; i < 300 && DS_GetRobotCommunications() != state; ++i)
+        DS_Sleep (10);
+
+    return DS_GetRobotCommunications() == state;
+}
+
+/**
+ * Requests state changes without a robot, then without transitions
+ */
+static void test_no_requests (void)
+{
+    int i;
+    DS_TEST ("no out-of-band packets without a link or a transition");
+
+    /* No robot link */
+    DS_ResetSendJitterStats();
+    DS_SetRobotEnabled (1);
+    DS_SetRobotEnabled (0);
+    DS_SetEmergencyStopped (1);
+    DS_SetEmergencyStopped (0);
+    DS_Sleep (10);
+    DS_CHECK (urgent_packets (NULL) == 0);
+
+    /* No transitions */
+    start_robot();
+    DS_CHECK (wait_for_comms (1));
+    DS_ResetSendJitterStats();
+    for (i = 0; i < 100; ++i)
+        DS_SetRobotEnabled (0);
+
+    DS_Sleep (10);
+    DS_CHECK (urgent_packets (NULL) == 0);
+}
+
+/**
+ * Disables and e-stops the robot and measures the time between the API
+ * calls and the sendto() calls
+ */
+static void test_transition_latency (void)
+{
+    int i;
+    DS_HistogramSummary summary;
+    DS_TEST ("disable transitions are sent in less than 1 ms (p99)");
+
+    DS_ResetSendJitterStats();
+    for (i = 0; i < TRANSITIONS; ++i) {
+        DS_SetRobotEnabled (1);
+        DS_Sleep (5);
+        DS_SetRobotEnabled (0);
+        DS_Sleep (5);
+    }
+
+    uint64_t count = urgent_packets (&summary);
+    printf ("  packets: %d, p50: %.3f ms, p99: %.3f ms, max: %.3f ms\n",
+            (int) count, summary.p50 / 1e6, summary.p99 / 1e6,
+            summary.max / 1e6);
+
+    DS_CHECK (count == TRANSITIONS);
+    DS_CHECK (summary.p99 < MAX_LATENCY);
+
+    /* E-stop the robot, then repeat the request once the robot latched it */
+    DS_TEST ("e-stop transitions are sent once");
+    DS_ResetSendJitterStats();
+    DS_SetEmergencyStopped (1);
+    DS_Sleep (2);
+    DS_CHECK (urgent_packets (NULL) == 1);
+
+    /* Replies to older packets may clear the e-stop until the robot has it */
+    for (i = 0; i < 100 && !robot_estopped; ++i) {
+        DS_SetEmergencyStopped (1);
+        DS_Sleep (10);
+    }
+
+    DS_CHECK (robot_estopped);
+    DS_Sleep (100);
+
+    DS_ResetSendJitterStats();
+    DS_SetEmergencyStopped (1);
+    DS_Sleep (10);
+    DS_CHECK (urgent_packets (NULL) == 0);
+    DS_CHECK (DS_GetEmergencyStopped());
+}
+
+#endif
+
+int main (void)
+{
+#if defined (__linux__)
+    DS_Init();
+    DS_Protocol protocol = DS_GetProtocolFRC_2015();
+    DS_ConfigureProtocol (&protocol);
+    DS_SetCustomRobotAddress ("127.0.0.1");
+
+    test_no_requests();
+    test_transition_latency();
+
+    stop_robot();
+    DS_Close();
+#else
+    printf ("Out-of-band packet tests are only supported on Linux\n");
+#endif
+
+    return DS_TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_TEST_H
+#define _LIB_DS_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "DS_Timer.h"
+
+/*
+ * Number of failed checks of the test program
+ */
+static int ds_test_failures = 0;
+
+/**
+ * Checks the given \a condition and reports it (with its location) if it
+ * is not true, the test continues so that every failure is reported
+ */
+#define DS_CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf (stderr, "%s:%d: check failed: %s\n", \
+                 __FILE__, __LINE__, #condition); \
+        ++ds_test_failures; \
+    } \
+} while (0)
+
+/**
+ * Prints the name of the test that is about to run
+ */
+#define DS_TEST(name) printf ("* %s\n", name)
+
+/**
+ * Prints the result of a benchmark, \a total_ns is the time that it took to
+ * process \a count items
+ */
+#define DS_BENCH(name, total_ns, count) \
+    DS_BENCH_UNIT (name, total_ns, count, "ns")
+
+/**
+ * Prints the result of a benchmark that is not measured in time, \a total
+ * is the amount of \a unit (e.g. system calls) used to process \a count items
+ */
+#define DS_BENCH_UNIT(name, total, count, unit) \
+    printf ("  %-40s %10.2f %s/op\n", name, \
+            (double) (total) / (double) (count), unit)
+
+/**
+ * Returns the exit code of the test program
+ */
+#define DS_TEST_RESULT() \
+    (printf (ds_test_failures ? "FAILED (%d checks)\n" : "PASSED\n", \
+             ds_test_failures), ds_test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+#endif
@@ -0,0 +1,15 @@
+#-------------------------------------------------------------------------------
+# LibDS tests and benchmarks, run them with "make check"
+#-------------------------------------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    CRC32Test \
+    JoystickBlockTest \
+    QuantizeTest \
+    QueueTest \
+    SocketTest \
+    StringTest \
+    TimerTest \
+    UrgentTest
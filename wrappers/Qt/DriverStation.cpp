@@ -28,6 +28,7 @@
 #include <QTime>
 #include <QTimer>
 #include <QDebug>
+#include <QDateTime>
 #include <QHostAddress>
 #include <QApplication>
 
@@ -119,6 +120,68 @@ int DriverStation::robotPacketLoss() const
     return 100;
 }
 
+/**
+ * Returns the median round-trip time (in milliseconds) of the robot packets
+ */
+qreal DriverStation::robotLatency() const
+{
+    DS_LinkStats stats;
+    DS_GetRobotLinkStats (&stats);
+    return stats.rtt.p50 / 1e6;
+}
+
+/**
+ * Returns the 99th percentile of the round-trip time (in milliseconds) of
+ * the robot packets
+ */
+qreal DriverStation::robotLatencyP99() const
+{
+    DS_LinkStats stats;
+    DS_GetRobotLinkStats (&stats);
+    return stats.rtt.p99 / 1e6;
+}
+
+/**
+ * Returns the 99th percentile of the time (in milliseconds) between two
+ * consecutive robot replies
+ */
+qreal DriverStation::robotReplyGapP99() const
+{
+    DS_LinkStats stats;
+    DS_GetRobotLinkStats (&stats);
+    return stats.gap.p99 / 1e6;
+}
+
+/**
+ * Returns the number of robot packets that were never answered
+ */
+int DriverStation::robotLostPackets() const
+{
+    DS_LinkStats stats;
+    DS_GetRobotLinkStats (&stats);
+    return (int) stats.lost;
+}
+
+/**
+ * Returns the number of robot replies that were received more than once
+ */
+int DriverStation::robotDuplicatedPackets() const
+{
+    DS_LinkStats stats;
+    DS_GetRobotLinkStats (&stats);
+    return (int) stats.duplicated;
+}
+
+/**
+ * Returns the number of robot replies that arrived after a newer reply
+ */
+int DriverStation::robotReorderedPackets() const
+{
+    DS_LinkStats stats;
+    DS_GetRobotLinkStats (&stats);
+    return (int) stats.reordered;
+}
+
 /**
  * Returns the date when the LibDS binary was build
  */
@@ -628,6 +691,19 @@ unsigned long DriverStation::receivedRobotBytes() const
     return DS_ReceivedRobotBytes();
 }
 
+/**
+ * Returns the time (in milliseconds since the epoch) at which the packet
+ * that triggered the event that is currently being emitted was received.
+ * If no event is being emitted, the current time is returned.
+ */
+qint64 DriverStation::eventTime() const
+{
+    if (m_eventTime)
+        return m_eventTime;
+
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
 /**
  * Returns the number of axes that the given \a joystick has.
  * If the joystick does not exist, this function will return \c 0
@@ -663,6 +739,18 @@ void DriverStation::start()
 {
     if (!DS_Initialized()) {
         DS_Init();
+
+        /* We only display the latest telemetry values */
+        DS_SetEventCoalescing (1);
+
+        /* Process events as soon as they are queued (if supported) */
+        if (DS_GetEventFD() >= 0) {
+            m_notifier = new QSocketNotifier (DS_GetEventFD(),
+                                              QSocketNotifier::Read, this);
+            connect (m_notifier, SIGNAL (activated (int)),
+                     this,       SLOT (processEvents()));
+        }
+
         processEvents();
         updateElapsedTime();
         emit statusChanged (generalStatus());
@@ -698,6 +786,14 @@ void DriverStation::restartRobotCode()
     DS_RestartRobotCode();
 }
 
+/**
+ * Clears the robot latency and packet loss statistics
+ */
+void DriverStation::resetRobotLinkStats()
+{
+    DS_ResetRobotLinkStats();
+}
+
 /**
  * Disables or enables the robot
  */
@@ -1001,6 +1097,7 @@ void DriverStation::quitDS()
 {
     if (DS_Initialized()) {
         LOG << "Stopping DS Engine...";
+        delete m_notifier;
         DS_Close();
         LOG << "DS Engine Stopped";
     }
@@ -1008,12 +1105,17 @@ void DriverStation::quitDS()
 
 /**
  * Polls for new LibDS events and emits Qt signals as appropiate.
- * This function is called every 5 milliseconds.
+ * This function is called when the LibDS event descriptor becomes readable,
+ * or every 5 milliseconds if the platform does not support it.
  */
 void DriverStation::processEvents()
 {
     DS_Event event;
     while (DS_PollEvent (&event)) {
+        /* Get the wall time at which the event was triggered */
+        qint64 age = (DS_GetMonotonicTime() - event.header.timestamp) / 1000000;
+        m_eventTime = QDateTime::currentMSecsSinceEpoch() - age;
+
         switch (event.type) {
         case DS_FMS_COMMS_CHANGED:
             emit fmsAddressChanged();
@@ -1070,7 +1172,10 @@ void DriverStation::processEvents()
         }
     }
 
-    QTimer::singleShot (5, Qt::CoarseTimer, this, SLOT (processEvents()));
+    m_eventTime = 0;
+
+    if (!m_notifier)
+        QTimer::singleShot (5, Qt::CoarseTimer, this, SLOT (processEvents()));
 }
 
 /**
@@ -29,7 +29,9 @@
 
 #include <QTime>
 #include <QObject>
+#include <QPointer>
 #include <QStringList>
+#include <QSocketNotifier>
 #include <DS_Protocol.h>
 
 class DriverStation : public QObject
@@ -156,6 +158,18 @@ class DriverStation : public QObject
                 READ radioPacketLoss)
     Q_PROPERTY (int robotPacketLoss
                 READ robotPacketLoss)
+    Q_PROPERTY (qreal robotLatency
+                READ robotLatency)
+    Q_PROPERTY (qreal robotLatencyP99
+                READ robotLatencyP99)
+    Q_PROPERTY (qreal robotReplyGapP99
+                READ robotReplyGapP99)
+    Q_PROPERTY (int robotLostPackets
+                READ robotLostPackets)
+    Q_PROPERTY (int robotDuplicatedPackets
+                READ robotDuplicatedPackets)
+    Q_PROPERTY (int robotReorderedPackets
+                READ robotReorderedPackets)
     Q_PROPERTY (bool isTestMode
                 READ isTestMode
                 NOTIFY controlModeChanged)
@@ -231,6 +245,13 @@ public:
     int radioPacketLoss() const;
     int robotPacketLoss() const;
 
+    qreal robotLatency() const;
+    qreal robotLatencyP99() const;
+    qreal robotReplyGapP99() const;
+    int robotLostPackets() const;
+    int robotDuplicatedPackets() const;
+    int robotReorderedPackets() const;
+
     bool isEnabled() const;
     bool isTestMode() const;
     bool canBeEnabled() const;
@@ -275,6 +296,8 @@ public:
     Q_INVOKABLE unsigned long receivedRadioBytes() const;
     Q_INVOKABLE unsigned long receivedRobotBytes() const;
 
+    Q_INVOKABLE qint64 eventTime() const;
+
     Q_INVOKABLE int getNumAxes (const int joystick) const;
     Q_INVOKABLE int getNumHats (const int joystick) const;
     Q_INVOKABLE int getNumButtons (const int joystick) const;
@@ -284,6 +307,7 @@ public slots:
     void rebootRobot();
     void resetJoysticks();
     void restartRobotCode();
+    void resetRobotLinkStats();
     void setEnabled (const bool enabled);
     void setTeamNumber (const int number);
     void loadProtocol (const DS_Protocol& protocol);
@@ -341,6 +365,8 @@ signals:
 private:
     QTime m_time;
     QString m_elapsedTime;
+    qint64 m_eventTime = 0;
+    QPointer<QSocketNotifier> m_notifier;
 };
 
 #endif
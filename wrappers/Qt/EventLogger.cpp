@@ -467,10 +467,10 @@ void DSEventLogger::connectSlots()
 }
 
 /**
- * Returns the current time signature
+ * Returns the time signature of the event that is being logged, which is
+ * the time at which the DS received the packet that triggered the event
  */
 qint64 DSEventLogger::currentTime()
 {
-    QDateTime time = QDateTime::currentDateTime();
-    return time.toMSecsSinceEpoch();
+    return DriverStation::getInstance()->eventTime();
 }